@@ -1,7 +1,6 @@
 #version 450
 
 layout(location = 0) in vec3 vert_pos;
-layout(location = 1) in vec3 vert_color;
 layout(location = 0) out vec3 out_vert_color;
 
 layout(set = 0, binding = 0) uniform CameraData {
@@ -11,8 +10,18 @@ layout(set = 0, binding = 0) uniform CameraData {
 }
 camera_info;
 
+struct DebugInstance {
+  mat4 model;
+  vec4 color;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer DebugInstances {
+  DebugInstance instances[];
+};
+
 void main() {
-  gl_Position =
-      camera_info.projection * camera_info.view * vec4(vert_pos, 1.0f);
-  out_vert_color = vert_color;
-}
\ No newline at end of file
+  DebugInstance instance = instances[gl_InstanceIndex];
+  gl_Position = camera_info.projection * camera_info.view * instance.model *
+                vec4(vert_pos, 1.0f);
+  out_vert_color = instance.color.rgb;
+}
@@ -1,29 +1,33 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+#include "gbuffer.glsl"
 
 layout(location = 0) in vec3 vert_normal_world;
 layout(location = 1) in vec3 vert_pos_world;
 layout(location = 2) in vec2 vert_uv;
+layout(location = 3) flat in int vert_texture_index;
+layout(location = 4) flat in int vert_bitmask;
 
 layout(location = 0) out vec4 frag_normal_world;
-layout(location = 1) out vec4 frag_pos_world;
-layout(location = 2) out vec4 frag_albedo;
-
-layout(push_constant) uniform PushConstants {
-  mat4 model;
-  int texture_index;
-  int light_index;
-  int bitmask;
-}
-push_constants;
+layout(location = 1) out vec4 frag_albedo;
+// No attachment in the compact layout, the write is discarded
+layout(location = 2) out vec4 frag_pos_world;
 
-layout(set = 0, binding = 0) uniform sampler2D textures[10];
+// Texture heap, indexed by the handles of the textures
+layout(set = 0, binding = 0) uniform sampler2D textures[];
 
 void main() {
-  if (push_constants.texture_index <= 0) {
+  if (vert_texture_index < 0) {
     discard;
   }
 
-  frag_normal_world = vec4(vert_normal_world, push_constants.bitmask);
+  frag_normal_world = pack_normal(normalize(vert_normal_world));
+  // Batches are split by texture, the qualifier keeps the access valid for
+  // draws that mix them
+  vec3 albedo =
+      texture(textures[nonuniformEXT(vert_texture_index)], vert_uv).xyz;
+  frag_albedo = pack_albedo(albedo, vert_bitmask);
   frag_pos_world = vec4(vert_pos_world, 1.0);
-  frag_albedo = texture(textures[push_constants.texture_index - 1], vert_uv);
 }
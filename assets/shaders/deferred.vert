@@ -7,6 +7,8 @@ layout(location = 2) in vec2 vert_uv;
 layout(location = 0) out vec3 frag_normal_world;
 layout(location = 1) out vec3 frag_pos_world;
 layout(location = 2) out vec2 frag_uv;
+layout(location = 3) flat out int frag_texture_index;
+layout(location = 4) flat out int frag_bitmask;
 
 layout(set = 1, binding = 0) uniform CameraData {
   mat4 view;
@@ -15,19 +17,25 @@ layout(set = 1, binding = 0) uniform CameraData {
 }
 camera_info;
 
-layout(push_constant) uniform PushConstants {
+struct InstanceData {
   mat4 model;
   int texture_index;
-  int light_index;
   int bitmask;
-}
-push_constants;
+  int light_index;
+};
+
+layout(std430, set = 1, binding = 3) readonly buffer Instances {
+  InstanceData instances[];
+};
 
 void main() {
-  gl_Position = camera_info.projection * camera_info.view *
-                push_constants.model * vec4(vert_pos, 1.0f);
+  InstanceData instance = instances[gl_InstanceIndex];
+  gl_Position = camera_info.projection * camera_info.view * instance.model *
+                vec4(vert_pos, 1.0f);
   frag_normal_world =
-      normalize(push_constants.model * vec4(vert_normal.xyz, 0.0f)).xyz;
-  frag_pos_world = (push_constants.model * vec4(vert_pos.xyz, 1.0f)).xyz;
+      normalize(instance.model * vec4(vert_normal.xyz, 0.0f)).xyz;
+  frag_pos_world = (instance.model * vec4(vert_pos.xyz, 1.0f)).xyz;
   frag_uv = vert_uv;
+  frag_texture_index = instance.texture_index;
+  frag_bitmask = instance.bitmask;
 }
\ No newline at end of file
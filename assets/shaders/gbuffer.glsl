@@ -0,0 +1,51 @@
+// G-buffer layout shared by the deferred pass and the passes reading it.
+// Attachments are normal, albedo and, in the legacy layout only, world
+// position. The compact layout stores octahedral normals in RG16 and rebuilds
+// the position from the depth buffer
+layout(constant_id = 0) const bool COMPACT_GBUFFER = false;
+
+vec2 octahedral_wrap(vec2 v) {
+  return (1.0 - abs(v.yx)) *
+         mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v, vec2(0.0)));
+}
+
+vec2 encode_normal(vec3 normal) {
+  normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+  return normal.z >= 0.0 ? normal.xy : octahedral_wrap(normal.xy);
+}
+
+vec3 decode_normal(vec2 encoded) {
+  vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+  float fold = clamp(-normal.z, 0.0, 1.0);
+  normal.xy += mix(vec2(fold), vec2(-fold),
+                   greaterThanEqual(normal.xy, vec2(0.0)));
+  return normalize(normal);
+}
+
+vec4 pack_normal(vec3 normal) {
+  return COMPACT_GBUFFER ? vec4(encode_normal(normal), 0.0, 0.0)
+                         : vec4(normal, 0.0);
+}
+
+vec3 read_normal(sampler2D normal_texture, vec2 uv) {
+  vec4 texel = texture(normal_texture, uv);
+  return COMPACT_GBUFFER ? decode_normal(texel.xy) : texel.xyz;
+}
+
+// Material bitmask goes to the albedo alpha, 8 bits
+vec4 pack_albedo(vec3 albedo, int bitmask) {
+  return vec4(albedo, float(bitmask & 0xff) / 255.0);
+}
+
+int read_bitmask(vec4 albedo) { return int(round(albedo.a * 255.0)); }
+
+// The compact layout binds the depth in place of the position attachment
+vec3 read_position(sampler2D position_texture, sampler2D depth_texture,
+                   vec2 uv, mat4 inverse_view_projection) {
+  if (!COMPACT_GBUFFER) {
+    return texture(position_texture, uv).xyz;
+  }
+  vec4 position = inverse_view_projection *
+                  vec4(uv * 2.0 - 1.0, texture(depth_texture, uv).r, 1.0);
+  return position.xyz / position.w;
+}
@@ -0,0 +1,24 @@
+#version 450
+
+layout(location = 0) in vec2 screen_uv;
+layout(location = 0) out float out_depth;
+
+// Depth buffer or the previous pyramid level
+layout(set = 1, binding = 0) uniform sampler2D source_depth;
+
+void main() {
+  ivec2 source_size = textureSize(source_depth, 0);
+  ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+  // The last texel of an odd sized source also takes the leftover row or
+  // column so that every source texel is covered
+  ivec2 reach = ivec2(2) + ivec2(equal(base + 3, source_size));
+
+  float depth = 1.0;
+  for (int y = 0; y < reach.y; y++) {
+    for (int x = 0; x < reach.x; x++) {
+      ivec2 texel = min(base + ivec2(x, y), source_size - 1);
+      depth = min(depth, texelFetch(source_depth, texel, 0).r);
+    }
+  }
+  out_depth = depth;
+}
@@ -0,0 +1,56 @@
+#version 450
+
+layout(location = 0) in vec2 screen_uv;
+layout(location = 0) out vec4 out_reflection;
+
+layout(set = 0, binding = 0) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+  vec4 position;
+  mat4 inverse_view_projection;
+  mat4 previous_view_projection;
+  uint frame_index;
+}
+camera_info;
+
+layout(set = 1, binding = 0) uniform sampler2D traced_texture;
+layout(set = 1, binding = 1) uniform sampler2D history_texture;
+layout(set = 1, binding = 2) uniform sampler2D hiz_texture; // Level 0
+
+#define HISTORY_WEIGHT 0.9f
+
+void main() {
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  ivec2 size = textureSize(traced_texture, 0);
+  vec4 traced = texelFetch(traced_texture, pixel, 0);
+
+  // History outside the range of the new neighbourhood is stale
+  vec4 neighbourhood_min = traced;
+  vec4 neighbourhood_max = traced;
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      vec4 neighbour = texelFetch(
+          traced_texture, clamp(pixel + ivec2(x, y), ivec2(0), size - 1), 0);
+      neighbourhood_min = min(neighbourhood_min, neighbour);
+      neighbourhood_max = max(neighbourhood_max, neighbour);
+    }
+  }
+
+  // Reprojected with the reflecting surface, reflections of moving objects
+  // lag behind a little
+  float depth = texelFetch(hiz_texture, pixel, 0).r;
+  vec4 world_pos = camera_info.inverse_view_projection *
+                   vec4(screen_uv * 2.0f - 1.0f, depth, 1.0f);
+  vec4 previous_pos = camera_info.previous_view_projection *
+                      vec4(world_pos.xyz / world_pos.w, 1.0f);
+  vec2 previous_uv = previous_pos.xy / previous_pos.w * 0.5f + 0.5f;
+  if (previous_pos.w <= 0.0f || any(lessThan(previous_uv, vec2(0.0))) ||
+      any(greaterThan(previous_uv, vec2(1.0)))) {
+    out_reflection = traced;
+    return;
+  }
+
+  vec4 history = clamp(texture(history_texture, previous_uv),
+                       neighbourhood_min, neighbourhood_max);
+  out_reflection = mix(traced, history, HISTORY_WEIGHT);
+}
@@ -0,0 +1,167 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "gbuffer.glsl"
+
+layout(location = 0) in vec2 screen_uv;
+layout(location = 0) out vec4 out_reflection;
+
+layout(set = 0, binding = 0) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+  vec4 position;
+  mat4 inverse_view_projection;
+  mat4 previous_view_projection;
+  uint frame_index;
+}
+camera_info;
+
+#define HIZ_LEVELS 6
+
+layout(set = 1, binding = 0) uniform sampler2D world_normal_texture;
+layout(set = 1, binding = 1) uniform sampler2D world_positions_texture;
+layout(set = 1, binding = 2) uniform sampler2D albedo_texture;
+layout(set = 1, binding = 3) uniform sampler2D depth_texture;
+layout(set = 1, binding = 4) uniform sampler2D shaded_texture;
+// Min depth pyramid, level 0 has the resolution of this pass
+layout(set = 1, binding = 5) uniform sampler2D hiz[HIZ_LEVELS];
+
+#define MAX_ITERATIONS 64
+#define MARCHING_MAX_DIST 50.0f
+#define SURFACE_THICKNESS 0.0002f
+#define MIN_DISTANCE_TO_REFLECTION 20.0f
+#define CELL_CROSSING_OFFSET 0.01f // Pixels
+
+// Sampler arrays are only indexed with constants, the level is not uniform
+float fetch_hiz(int level, ivec2 cell) {
+  switch (level) {
+  case 0:
+    return texelFetch(hiz[0], cell, 0).r;
+  case 1:
+    return texelFetch(hiz[1], cell, 0).r;
+  case 2:
+    return texelFetch(hiz[2], cell, 0).r;
+  case 3:
+    return texelFetch(hiz[3], cell, 0).r;
+  case 4:
+    return texelFetch(hiz[4], cell, 0).r;
+  default:
+    return texelFetch(hiz[5], cell, 0).r;
+  }
+}
+
+// Pixel coordinates of the full resolution and NDC depth
+vec3 get_screen_coords(vec3 world_coords, vec2 screen_size) {
+  vec4 projected_point = camera_info.projection * camera_info.view *
+                         vec4(world_coords, 1.0);
+  projected_point.xyz /= projected_point.w;
+  return vec3((projected_point.xy * 0.5f + 0.5f) * screen_size,
+              projected_point.z);
+}
+
+void main() {
+  ivec2 screen_size = textureSize(depth_texture, 0);
+  // Every frame traces another pixel of the 2x2 block, the temporal pass
+  // accumulates them
+  ivec2 jitter = ivec2(camera_info.frame_index & 1u,
+                       (camera_info.frame_index >> 1) & 1u);
+  ivec2 pixel = min(ivec2(gl_FragCoord.xy) * 2 + jitter, screen_size - 1);
+  vec2 uv = (vec2(pixel) + 0.5f) / vec2(screen_size);
+
+  out_reflection = vec4(0.0);
+  if ((read_bitmask(texture(albedo_texture, uv)) & 0x1) == 0) {
+    return;
+  }
+
+  vec3 frag_world_pos =
+      read_position(world_positions_texture, depth_texture, uv,
+                    camera_info.inverse_view_projection);
+  vec3 frag_world_normal = normalize(read_normal(world_normal_texture, uv));
+  vec3 view_vector = frag_world_pos - camera_info.position.xyz;
+  vec3 world_reflection_dir =
+      reflect(normalize(view_vector), frag_world_normal);
+
+  // Rays towards the camera end before the near plane to project properly.
+  // [2][2] is (f + n) / (n - f) and [3][2] is 2fn / (n - f), see
+  // get_projection_matrix
+  float near =
+      camera_info.projection[3][2] / (camera_info.projection[2][2] - 1.0);
+  float start_depth = -(camera_info.view * vec4(frag_world_pos, 1.0)).z;
+  float depth_change = -(camera_info.view * vec4(world_reflection_dir, 0.0)).z;
+  float ray_length = MARCHING_MAX_DIST;
+  if (depth_change < 0.0) {
+    ray_length = min(ray_length, 0.99f * (near - start_depth) / depth_change);
+  }
+
+  vec3 ray_start = get_screen_coords(frag_world_pos, vec2(screen_size));
+  vec3 ray_end = get_screen_coords(
+      frag_world_pos + world_reflection_dir * ray_length, vec2(screen_size));
+  vec3 ray_delta = ray_end - ray_start;
+  // Keeps the cell crossings finite for axis aligned rays
+  ray_delta.xy = mix(ray_delta.xy, vec2(0.001f),
+                     lessThan(abs(ray_delta.xy), vec2(0.001f)));
+  vec2 crossing_step = step(vec2(0.0), ray_delta.xy);
+  vec2 crossing_offset = sign(ray_delta.xy) * CELL_CROSSING_OFFSET;
+
+  // Starts at the exit of its own level 0 cell to leave the surface
+  int level = 0;
+  vec2 start_cell = floor(ray_start.xy / 2.0f);
+  vec2 start_exit =
+      ((start_cell + crossing_step) * 2.0f + crossing_offset - ray_start.xy) /
+      ray_delta.xy;
+  float t = min(start_exit.x, start_exit.y);
+
+  bool hit = false;
+  vec3 ray_pos = ray_start;
+  for (int i = 0; i < MAX_ITERATIONS && t <= 1.0f; i++) {
+    ray_pos = ray_start + ray_delta * t;
+    if (any(lessThan(ray_pos.xy, vec2(0.0))) ||
+        any(greaterThanEqual(ray_pos.xy, vec2(screen_size)))) {
+      break;
+    }
+
+    ivec2 level_size = max(screen_size >> (level + 1), ivec2(1));
+    ivec2 cell = min(ivec2(ray_pos.xy) >> (level + 1), level_size - 1);
+    float cell_min_depth = fetch_hiz(level, cell);
+    vec2 boundary =
+        vec2((cell + ivec2(crossing_step)) << (level + 1)) + crossing_offset;
+    vec2 boundary_t = (boundary - ray_start.xy) / ray_delta.xy;
+    float exit_t = min(boundary_t.x, boundary_t.y);
+
+    if (ray_pos.z < cell_min_depth) {
+      // In front of the whole cell, skip to its closest depth or to the
+      // next cell and coarser level if the ray leaves first
+      float depth_t = ray_delta.z > 0.0f
+                          ? (cell_min_depth - ray_start.z) / ray_delta.z
+                          : exit_t;
+      if (depth_t < exit_t && level == 0) {
+        ray_pos = ray_start + ray_delta * depth_t;
+        hit = true;
+        break;
+      } else if (depth_t < exit_t) {
+        t = depth_t;
+        level--;
+      } else {
+        t = exit_t;
+        level = min(level + 1, HIZ_LEVELS - 1);
+      }
+    } else if (level > 0) {
+      level--;
+    } else if (ray_pos.z - cell_min_depth < SURFACE_THICKNESS) {
+      hit = true;
+      break;
+    } else {
+      t = exit_t; // Passes behind the surface
+    }
+  }
+
+  if (hit) {
+    float attenuation =
+        pow(min(length(view_vector), MIN_DISTANCE_TO_REFLECTION) /
+                MIN_DISTANCE_TO_REFLECTION,
+            4);
+    out_reflection = vec4(
+        texture(shaded_texture, ray_pos.xy / vec2(screen_size)).xyz,
+        attenuation);
+  }
+}
@@ -1,4 +1,10 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "gbuffer.glsl"
+
+// Full resolution linear march, replaced by the Hi-Z reflection passes
+layout(constant_id = 1) const bool LEGACY_REFLECTIONS = true;
 
 layout(location = 0) in vec2 screen_uv;
 layout(location = 0) out vec4 out_occlusion;
@@ -8,6 +14,7 @@ layout(set = 1, binding = 0) uniform CameraData {
   mat4 view;
   mat4 projection;
   vec4 position;
+  mat4 inverse_view_projection;
 }
 camera_info;
 
@@ -43,10 +50,14 @@ bool z_test(float z1, float z2) {
   return SURFACE_THICKNESS > z_dist && z_dist > 0;
 }
 
+vec3 get_world_position() {
+  return read_position(world_positions_texture, depth_texture, screen_uv,
+                       camera_info.inverse_view_projection);
+}
+
 vec4 get_reflection_albedo() {
-  vec4 frag_world_normal = texture(world_normal_texture, screen_uv);
-  vec4 frag_world_pos = texture(world_positions_texture, screen_uv);
-  vec3 frag_pos_screen_space = get_ndc_coords(frag_world_pos.xyz);
+  vec3 frag_world_normal = read_normal(world_normal_texture, screen_uv);
+  vec4 frag_world_pos = vec4(get_world_position(), 1.0);
   vec3 view_vector = frag_world_pos.xyz - camera_info.position.xyz;
   vec3 view_dir = normalize(view_vector);
   vec3 world_reflection_dir =
@@ -65,7 +76,8 @@ vec4 get_reflection_albedo() {
                         1.0f / textureSize(depth_texture, 0).x);
   vec3 step_vector = ray_dir * step_size;
 
-  int is_reflective = int(frag_world_normal.a) & 0x1;
+  int is_reflective =
+      read_bitmask(texture(albedo_texture, screen_uv)) & 0x1;
   for (int i = 1; i < REFLECTION_MARCHING_STEP_COUNT * is_reflective; i++) {
     vec3 ray_pos = ray_start_pos.xyz + step_vector * float(i);
 
@@ -106,8 +118,8 @@ float random(vec2 st) {
 }
 
 vec4 get_occlusion_ratio() {
-  vec3 frag_position = texture(world_positions_texture, screen_uv).xyz;
-  vec3 normal = texture(world_normal_texture, screen_uv).xyz;
+  vec3 frag_position = get_world_position();
+  vec3 normal = read_normal(world_normal_texture, screen_uv);
   vec3 tangent = normalize(cross(normal, vec3(1.0, 0.0, 0.0)));
   vec3 bitangent = normalize(cross(normal, tangent));
   mat3 TBN = mat3(tangent, bitangent, normal);
@@ -137,6 +149,6 @@ vec4 get_occlusion_ratio() {
 }
 
 void main() {
-  out_reflection = get_reflection_albedo();
+  out_reflection = LEGACY_REFLECTIONS ? get_reflection_albedo() : vec4(0.0);
   out_occlusion = get_occlusion_ratio();
 }
@@ -0,0 +1,52 @@
+#version 450
+
+layout(location = 0) in vec2 screen_uv;
+layout(location = 0) out vec4 out_reflection;
+
+layout(set = 0, binding = 0) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+  vec4 position;
+}
+camera_info;
+
+layout(set = 1, binding = 0) uniform sampler2D depth_texture;
+layout(set = 1, binding = 1) uniform sampler2D hiz_texture; // Level 0
+layout(set = 1, binding = 2) uniform sampler2D reflection_texture;
+
+#define DEPTH_SIGMA 0.05f // Relative to the view depth
+
+float get_view_depth(float depth) {
+  return camera_info.projection[3][2] /
+         (depth + camera_info.projection[2][2]);
+}
+
+// Edge aware upsample of the half resolution reflections, the bilinear
+// weights are lowered for texels at another depth
+void main() {
+  ivec2 half_size = textureSize(reflection_texture, 0);
+  float view_depth = get_view_depth(texture(depth_texture, screen_uv).r);
+
+  vec2 half_coords = screen_uv * vec2(half_size) - 0.5f;
+  ivec2 base = ivec2(floor(half_coords));
+  vec2 bilinear = fract(half_coords);
+
+  vec4 reflection_sum = vec4(0.0);
+  float weight_sum = 0.0f;
+  for (int y = 0; y <= 1; y++) {
+    for (int x = 0; x <= 1; x++) {
+      ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), half_size - 1);
+      float sample_depth = get_view_depth(texelFetch(hiz_texture, texel, 0).r);
+      float weight = (x == 0 ? 1.0f - bilinear.x : bilinear.x) *
+                     (y == 0 ? 1.0f - bilinear.y : bilinear.y) *
+                     exp(-abs(sample_depth - view_depth) /
+                         (DEPTH_SIGMA * view_depth));
+      reflection_sum += texelFetch(reflection_texture, texel, 0) * weight;
+      weight_sum += weight;
+    }
+  }
+
+  out_reflection = weight_sum > 0.0001f
+                       ? reflection_sum / weight_sum
+                       : texture(reflection_texture, screen_uv);
+}
@@ -1,25 +1,34 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "gbuffer.glsl"
 
 layout(location = 0) in vec2 screen_uv;
 layout(location = 0) out vec4 out_frag_color;
 
-layout(set = 0, binding = 0) uniform sampler2D textures[10];
-
 layout(set = 1, binding = 0) uniform CameraData {
   mat4 view;
   mat4 projection;
   vec4 position;
+  mat4 inverse_view_projection;
 }
 camera_info;
 
-layout(set = 1, binding = 1) uniform LightSource {
+struct LightSource {
   vec4 position;
   vec4 color;
   vec4 direction;
   mat4 view_matrix;
   mat4 projection_matrix;
-}
-light_sources[64];
+  vec4 shadow_rect; // Atlas tile x, y and size in uv, size 0 if none
+  float range;
+};
+
+// Enabled lights only
+layout(std430, set = 1, binding = 1) readonly buffer Lights {
+  uint light_count;
+  LightSource light_sources[];
+};
 
 layout(set = 1, binding = 2) uniform sampler2D shadow_texture;
 layout(set = 1, binding = 3) uniform sampler2D world_normal;
@@ -27,6 +36,19 @@ layout(set = 1, binding = 4) uniform sampler2D world_positions;
 layout(set = 1, binding = 5) uniform sampler2D albedo_texture;
 layout(set = 1, binding = 6) uniform sampler2D depth;
 
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+// Lights reaching each froxel of the camera frustum, see LightClusters
+layout(std430, set = 1, binding = 7) readonly buffer LightClusters {
+  vec4 params; // Near, far, slice scale, slice bias
+  uvec2 ranges[CLUSTER_COUNT]; // First index and count of light_indices
+  uint light_indices[];
+}
+light_clusters;
+
 layout(push_constant) uniform PushConstants {
   mat4 model;
   int texture_index;
@@ -35,31 +57,40 @@ layout(push_constant) uniform PushConstants {
 }
 push_constants;
 
+uint get_cluster(vec4 frag_pos_world) {
+  float view_depth = -(camera_info.view * vec4(frag_pos_world.xyz, 1.0)).z;
+  int slice = int(log(max(view_depth, light_clusters.params.x)) *
+                      light_clusters.params.z +
+                  light_clusters.params.w);
+  uvec2 tile = uvec2(screen_uv * vec2(CLUSTER_TILES_X, CLUSTER_TILES_Y));
+  tile = min(tile, uvec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+  return (clamp(slice, 0, CLUSTER_SLICES - 1) * CLUSTER_TILES_Y + tile.y) *
+             CLUSTER_TILES_X +
+         tile.x;
+}
+
 vec3 ambient = vec3(0.001f);
 #define DEPTH_BIAS 0.00001f
-#define SHADOW_MAP_RESOLUTION 1024
-#define SHADOW_ATLAS_SIZE 8192
-#define SHADOW_MAP_SCALE SHADOW_MAP_RESOLUTION / SHADOW_ATLAS_SIZE
-#define MAX_LIGHTS 64
 
 float shadow_test(int light_idx, vec4 frag_pos_world) {
   float shadow = 1.0f;
+  vec4 shadow_rect = light_sources[light_idx].shadow_rect;
+  if (shadow_rect.z <= 0.0f) {
+    return shadow; // No tile in the atlas
+  }
   vec4 light_mvp_projection = light_sources[light_idx].projection_matrix *
                               light_sources[light_idx].view_matrix *
                               vec4(frag_pos_world.xyz, 1.0);
 
   vec3 shadow_coords = light_mvp_projection.xyz / light_mvp_projection.w;
-  vec2 atlas_offset = vec2(light_idx % 8, light_idx / 8) * SHADOW_MAP_SCALE;
-  vec2 shadow_coords_renormalized =
-      (shadow_coords.xy * 0.5f + 0.5f) * SHADOW_MAP_SCALE;
+  vec2 tile_coords = shadow_coords.xy * 0.5f + 0.5f;
 
   if (shadow_coords.z > -1.0f && shadow_coords.z < 1.0f &&
-      shadow_coords_renormalized.x > 0.0f &&
-      shadow_coords_renormalized.x < 1.0f &&
-      shadow_coords_renormalized.y > 0.0f &&
-      shadow_coords_renormalized.y < 1.0f) {
+      tile_coords.x > 0.0f && tile_coords.x < 1.0f && tile_coords.y > 0.0f &&
+      tile_coords.y < 1.0f) {
     float closest_depth =
-        texture(shadow_texture, shadow_coords_renormalized + atlas_offset).r;
+        texture(shadow_texture, shadow_rect.xy + tile_coords * shadow_rect.z)
+            .r;
     float current_depth = shadow_coords.z;
     shadow = (current_depth - DEPTH_BIAS) > closest_depth ? 0.0f : 1.0f;
   }
@@ -98,8 +129,11 @@ vec3 calculate_light_contrib(int light_idx, vec3 view_dir,
   float soft_cutoff =
       pow(clamp((theta_cosine - half_fov) / (0.95 - half_fov), 0.0, 1.0), 4);
 
+  // Fades out to 0 at the range so that the clusters can skip the light
+  float range_ratio = distance / light_sources[light_idx].range;
+  float range_window = clamp(1.0f - pow(range_ratio, 4), 0.0, 1.0);
   float attenuation =
-      soft_cutoff * 1.0f /
+      soft_cutoff * range_window * range_window /
       (1.0f + 0.001 * distance + 0.0001 * (distance * distance));
 
   return diffuse * attenuation + specular * attenuation;
@@ -108,16 +142,17 @@ vec3 calculate_light_contrib(int light_idx, vec3 view_dir,
 void main() {
   vec3 view_dir = normalize(camera_info.view[2].xyz);
 
-  vec4 frag_normal_world = texture(world_normal, screen_uv);
-  vec4 frag_pos_world = texture(world_positions, screen_uv);
-  float frag_depth = texture(depth, screen_uv).r;
+  vec4 frag_normal_world = vec4(read_normal(world_normal, screen_uv), 0.0);
+  vec4 frag_pos_world =
+      vec4(read_position(world_positions, depth, screen_uv,
+                         camera_info.inverse_view_projection),
+           1.0);
   vec4 frag_color = texture(albedo_texture, screen_uv);
 
   vec4 light_contrib = vec4(0);
-  for (int i = 0; i < 64; i++) {
-    if (light_sources[i].color.w < 0) {
-      continue;
-    }
+  uvec2 cluster_range = light_clusters.ranges[get_cluster(frag_pos_world)];
+  for (uint j = 0; j < cluster_range.y; j++) {
+    int i = int(light_clusters.light_indices[cluster_range.x + j]);
     float is_lit = shadow_test(i, frag_pos_world);
     light_contrib.xyz += calculate_light_contrib(i, view_dir, frag_normal_world,
                                                  frag_pos_world) *
@@ -8,14 +8,32 @@ layout(set = 0, binding = 0) uniform CameraData {
 }
 camera_info;
 
-layout(set = 0, binding = 1) uniform LightSource {
+struct LightSource {
   vec4 position;
   vec4 color;
   vec4 direction;
   mat4 view_matrix;
   mat4 projection_matrix;
-}
-light_sources[64];
+  vec4 shadow_rect; // Atlas tile x, y and size in uv, size 0 if none
+  float range;
+};
+
+// Enabled lights only
+layout(std430, set = 0, binding = 1) readonly buffer Lights {
+  uint light_count;
+  LightSource light_sources[];
+};
+
+struct InstanceData {
+  mat4 model;
+  int texture_index;
+  int bitmask;
+  int light_index;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+  InstanceData instances[];
+};
 
 layout(push_constant) uniform PushConstants {
   mat4 model;
@@ -25,7 +43,8 @@ layout(push_constant) uniform PushConstants {
 }
 push_constants;
 void main() {
-  gl_Position = light_sources[push_constants.light_index].projection_matrix *
-                light_sources[push_constants.light_index].view_matrix *
-                push_constants.model * vec4(vert_pos, 1.0f);
+  InstanceData instance = instances[gl_InstanceIndex];
+  gl_Position = light_sources[instance.light_index].projection_matrix *
+                light_sources[instance.light_index].view_matrix *
+                instance.model * vec4(vert_pos, 1.0f);
 }
\ No newline at end of file
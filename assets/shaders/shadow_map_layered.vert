@@ -0,0 +1,53 @@
+#version 450
+#extension GL_ARB_shader_viewport_layer_array : require
+
+layout(location = 0) in vec3 vert_pos;
+
+layout(set = 0, binding = 0) uniform CameraData {
+  mat4 view;
+  mat4 projection;
+}
+camera_info;
+
+struct LightSource {
+  vec4 position;
+  vec4 color;
+  vec4 direction;
+  mat4 view_matrix;
+  mat4 projection_matrix;
+  vec4 shadow_rect; // Atlas tile x, y and size in uv, size 0 if none
+  float range;
+};
+
+// Enabled lights only
+layout(std430, set = 0, binding = 1) readonly buffer Lights {
+  uint light_count;
+  LightSource light_sources[];
+};
+
+struct InstanceData {
+  mat4 model;
+  int texture_index;
+  int bitmask;
+  int light_index;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+  InstanceData instances[];
+};
+
+layout(push_constant) uniform PushConstants {
+  mat4 model;
+  int texture_index;
+  int light_index;
+  int bitmask;
+}
+push_constants;
+void main() {
+  InstanceData instance = instances[gl_InstanceIndex];
+  gl_Position = light_sources[instance.light_index].projection_matrix *
+                light_sources[instance.light_index].view_matrix *
+                instance.model * vec4(vert_pos, 1.0f);
+  // Viewports are set for the lights starting from push_constants.light_index
+  gl_ViewportIndex = instance.light_index - push_constants.light_index;
+}
\ No newline at end of file
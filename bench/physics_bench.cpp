@@ -0,0 +1,262 @@
+#include <rend/EntityRegistry.h>
+#include <rend/Systems/CharacterControllerSystem.h>
+#include <rend/Systems/PhysicsSystem.h>
+#include <rend/TimeUtils.h>
+#include <rend/Transform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless physics benchmark. Builds stacks of boxes or spheres, or a crowd
+// of walking characters, on a static floor and steps them for a fixed number
+// of frames for every combination of body and thread counts.
+//
+// Usage: rend_physics_bench [box|sphere|character] [frames]
+//
+// The bench is built with its own limits, by default large enough for the
+// whole sweep. Rows above them are reported as skipped, raise them with
+// -DREND_BENCH_MAX_ENTITIES=N -DREND_BENCH_PHYSICS_MAX_BODIES=N
+// -DREND_BENCH_PHYSICS_MAX_BODY_PAIRS=N
+// -DREND_BENCH_PHYSICS_MAX_CONTACT_CONSTRAINTS=N
+
+namespace {
+enum class Primitive { BOX, SPHERE, CHARACTER };
+
+constexpr int STACK_HEIGHT = 10;
+constexpr float BODY_SIZE = 1.0f;
+constexpr float BODY_SPACING = 1.5f;
+
+void register_components() {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  registry.register_component<Transform>();
+  registry.register_component<Rigidbody>();
+  registry.register_component<AABB>();
+  registry.register_component<CharacterController>();
+}
+
+// Same ECS path as create_primitive in the example, minus the renderable
+rend::ECS::EID create_body(Eigen::Vector3f position, Eigen::Vector3f scale,
+                           Primitive primitive, bool static_body = false) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  rend::ECS::EID eid = registry.register_entity();
+  Transform &transform = registry.add_component<Transform>(eid);
+  Rigidbody &rigidbody = registry.add_component<Rigidbody>(eid);
+
+  transform.position = position;
+  transform.scale = scale;
+
+  if (primitive == Primitive::BOX) {
+    AABB &aabb = registry.add_component<AABB>(eid);
+    aabb.min_local = -Eigen::Vector3f::Ones();
+    aabb.max_local = Eigen::Vector3f::Ones();
+    rigidbody.primitive_type = Rigidbody::PrimitiveType::BOX;
+    rigidbody.dimensions =
+        transform.scale.cwiseProduct(aabb.max_local - aabb.min_local) / 2;
+  } else {
+    rigidbody.primitive_type = Rigidbody::PrimitiveType::SPHERE;
+    rigidbody.dimensions = transform.scale;
+  }
+
+  rigidbody.static_body = static_body;
+  return eid;
+}
+
+void clear_scene() {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  std::vector<rend::ECS::EID> entities(registry.registered_entities.begin(),
+                                       registry.registered_entities.end());
+  for (rend::ECS::EID eid : entities) {
+    registry.remove_entity(eid);
+  }
+  get_jph_physics_interface().clear();
+}
+
+// Agents walking in circles, spaced out on a grid
+void build_crowd(int agent_count) {
+  int grid_size = std::ceil(std::sqrt(float(agent_count)));
+  float spacing = 2.0f;
+  float extent = grid_size * spacing;
+
+  create_body(Eigen::Vector3f{0, -1, 0},
+              Eigen::Vector3f{extent + 10.0f, 1.0f, extent + 10.0f},
+              Primitive::BOX, true);
+
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  for (int i = 0; i < agent_count; i++) {
+    rend::ECS::EID eid = registry.register_entity();
+    Transform &transform = registry.add_component<Transform>(eid);
+    CharacterController &controller =
+        registry.add_component<CharacterController>(eid);
+    transform.position =
+        Eigen::Vector3f{(i % grid_size) * spacing - extent * 0.5f, 0.0f,
+                        (i / grid_size) * spacing - extent * 0.5f};
+    float angle = i * 0.618f * 2.0f * M_PI;
+    controller.desired_velocity =
+        Eigen::Vector3f{std::cos(angle), 0.0f, std::sin(angle)} * 1.5f;
+  }
+}
+
+// Square grid of stacks, the floor covers all of them
+void build_scene(int body_count, Primitive primitive) {
+  if (primitive == Primitive::CHARACTER) {
+    build_crowd(body_count);
+    return;
+  }
+
+  int stack_count = (body_count + STACK_HEIGHT - 1) / STACK_HEIGHT;
+  int grid_size = std::ceil(std::sqrt(float(stack_count)));
+  float extent = grid_size * BODY_SPACING * BODY_SIZE;
+
+  create_body(Eigen::Vector3f{0, -1, 0},
+              Eigen::Vector3f{extent + 10.0f, 1.0f, extent + 10.0f},
+              Primitive::BOX, true);
+
+  float half_size = BODY_SIZE * 0.5f;
+  for (int i = 0; i < body_count; i++) {
+    int stack = i / STACK_HEIGHT;
+    int level = i % STACK_HEIGHT;
+    Eigen::Vector3f position{
+        (stack % grid_size) * BODY_SPACING * BODY_SIZE - extent * 0.5f,
+        half_size + level * BODY_SIZE * 1.01f,
+        (stack / grid_size) * BODY_SPACING * BODY_SIZE - extent * 0.5f};
+    create_body(position, Eigen::Vector3f::Constant(half_size), primitive);
+  }
+}
+
+struct BenchResult {
+  float step_ms = 0.0f;     // Average time of a physics step
+  float max_step_ms = 0.0f; // Slowest physics step
+  float sync_ms = 0.0f;     // Average time of copying bodies into the ECS
+  float character_ms = 0.0f; // Average time of the character update
+  float contacts = 0.0f;    // Average contact events per frame
+  uint32_t dropped = 0;     // Contact events that didn't fit the rings
+  uint32_t active_bodies = 0;
+};
+
+BenchResult run(int frames) {
+  rend::systems::PhysicsSystem physics_system{};
+  JPH::PhysicsSystemInterface &physics_interface = get_jph_physics_interface();
+  float dt = physics_interface.fixed_time_step;
+
+  rend::systems::CharacterControllerSystem character_system{};
+  physics_system.init();
+  character_system.init();
+
+  BenchResult result{};
+  for (int frame = 0; frame < frames; frame++) {
+    rend::time::TimePoint t0 = rend::time::now();
+    physics_system.step(dt);
+    rend::time::TimePoint t1 = rend::time::now();
+    physics_system.sync_transforms();
+    rend::time::TimePoint t2 = rend::time::now();
+    character_system.update(dt);
+    rend::time::TimePoint t3 = rend::time::now();
+
+    float step_ms =
+        rend::time::time_difference<rend::time::Microseconds>(t0, t1) * 0.001f;
+    result.step_ms += step_ms;
+    result.max_step_ms = std::max(result.max_step_ms, step_ms);
+    result.sync_ms +=
+        rend::time::time_difference<rend::time::Microseconds>(t1, t2) * 0.001f;
+    result.character_ms +=
+        rend::time::time_difference<rend::time::Microseconds>(t2, t3) * 0.001f;
+    result.contacts += physics_system.contact_events.size();
+    result.dropped += physics_system.dropped_contact_events;
+  }
+  result.step_ms /= frames;
+  result.sync_ms /= frames;
+  result.character_ms /= frames;
+  result.contacts /= frames;
+  result.active_bodies =
+      physics_interface.jph_physics_system->GetNumActiveBodies(
+          JPH::EBodyType::RigidBody);
+
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  for (rend::ECS::EntityRegistry::ArchetypeIterator iterator =
+           registry.archetype_iterator<CharacterController, Transform>();
+       iterator.valid(); ++iterator) {
+    character_system.remove_entity(*iterator);
+  }
+  return result;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  Primitive primitive = Primitive::BOX;
+  int frames = 300;
+  if (argc > 1 && std::strcmp(argv[1], "sphere") == 0) {
+    primitive = Primitive::SPHERE;
+  } else if (argc > 1 && std::strcmp(argv[1], "character") == 0) {
+    primitive = Primitive::CHARACTER;
+  }
+  if (argc > 2) {
+    frames = std::max(1, std::atoi(argv[2]));
+  }
+
+  std::vector<int> body_counts{1000, 2000, 5000, 10000, 20000, 50000, 100000};
+  if (primitive == Primitive::CHARACTER) {
+    body_counts = {250, 500, 1000, 2000, 4000};
+  }
+  std::vector<int> thread_counts;
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  register_components();
+
+  std::printf("# %s, %d frames, MAX_ENTITIES %d, MAX_BODIES %u, "
+              "MAX_BODY_PAIRS %u, MAX_CONTACT_CONSTRAINTS %u\n",
+              primitive == Primitive::BOX      ? "boxes"
+              : primitive == Primitive::SPHERE ? "spheres"
+                                               : "characters",
+              frames,
+              rend::ECS::MAX_ENTITIES,
+              JPH::PhysicsSystemInterface::MAX_BODIES,
+              JPH::PhysicsSystemInterface::MAX_BODY_PAIRS,
+              JPH::PhysicsSystemInterface::MAX_CONTACT_CONSTRAINTS);
+  std::printf("%8s %8s %10s %10s %10s %10s %12s %8s %8s\n", "bodies",
+              "threads", "step_ms", "max_ms", "sync_ms", "char_ms",
+              "contacts", "dropped", "active");
+
+  for (int body_count : body_counts) {
+    // The floor takes an entity and a body as well
+    if (body_count + 1 > rend::ECS::MAX_ENTITIES) {
+      std::printf("%8d skipped, over MAX_ENTITIES %d\n", body_count,
+                  rend::ECS::MAX_ENTITIES);
+      continue;
+    }
+    if (body_count + 1 > int(JPH::PhysicsSystemInterface::MAX_BODIES)) {
+      std::printf("%8d skipped, over MAX_BODIES %u\n", body_count,
+                  JPH::PhysicsSystemInterface::MAX_BODIES);
+      continue;
+    }
+
+    for (int threads : thread_counts) {
+      // The thread waiting on the jobs executes them as well
+      rend::get_job_system().set_num_threads(threads - 1);
+
+      clear_scene();
+      build_scene(body_count, primitive);
+      try {
+        BenchResult result = run(frames);
+        std::printf("%8d %8d %10.3f %10.3f %10.3f %10.3f %12.1f %8u %8u\n",
+                    body_count, threads, result.step_ms, result.max_step_ms,
+                    result.sync_ms, result.character_ms, result.contacts,
+                    result.dropped, result.active_bodies);
+      } catch (const std::runtime_error &error) {
+        std::printf("%8d %8d failed: %s\n", body_count, threads, error.what());
+      }
+    }
+  }
+
+  clear_scene();
+  return 0;
+}
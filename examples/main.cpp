@@ -9,7 +9,9 @@
 #include <rend/Audio/AudioPlayer.h>
 #include <rend/EntityRegistry.h>
 #include <rend/Systems/DebugBufferFillSystem.h>
+#include <rend/Systems/PhysicsLODSystem.h>
 #include <rend/Systems/PhysicsSystem.h>
+#include <rend/Systems/SpatialIndexSystem.h>
 
 #include <rend/InputHandler.h>
 
@@ -22,6 +24,7 @@ void register_components() {
   registry.register_component<Renderable>();
   registry.register_component<Rigidbody>();
   registry.register_component<AABB>();
+  registry.register_component<Light>();
 }
 
 enum class Primitive { DINGUS, BOX, SPHERE };
@@ -69,20 +72,34 @@ ECS::EID create_primitive(Eigen::Vector3f position, Eigen::Quaternionf rotation,
   }
 
   rigidbody.static_body = static_body;
+  rigidbody.lod.enabled = !static_body;
   return eid;
 }
 
 } // namespace rend
 
-int main() {
+int main(int argc, char **argv) {
   rend::Renderer &renderer = rend::get_renderer();
   rend::AudioPlayer audio_player{};
   rend::systems::PhysicsSystem physics_system{};
+  rend::systems::PhysicsLODSystem physics_lod_system{physics_system};
+  rend::systems::SpatialIndexSystem spatial_index_system{};
   rend::systems::DebugBufferFillSystem debug_buffer_fill_system{};
 
   audio_player.load(Path{ASSET_DIRECTORY} / Path{"audio/dingus.mp3"});
   audio_player.loop = true;
 
+  for (int i = 1; i < argc; i++) {
+    if (std::string{argv[i]} == "--compact-gbuffer") {
+      renderer.compact_gbuffer = true;
+    }
+    if (std::string{argv[i]} == "--frames-in-flight" && i + 1 < argc) {
+      renderer.frames_in_flight = std::stoi(argv[++i]);
+    }
+    if (std::string{argv[i]} == "--pipeline-cache" && i + 1 < argc) {
+      renderer.pipeline_cache_path = argv[++i];
+    }
+  }
   renderer.init();
 
   rend::input::InputHandler input_handler;
@@ -139,10 +156,12 @@ int main() {
 
   int N_LIGHTS = 6;
   int light_speeds[N_LIGHTS];
+  rend::ECS::EID light_eids[N_LIGHTS];
 
   for (int i = 0; i < N_LIGHTS; i++) {
-    LightSource &light = renderer.lights[i];
-    light.enable();
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    light_eids[i] = registry.register_entity();
+    Light &light = registry.add_component<Light>(light_eids[i]);
     light.set_color(Eigen::Vector3f{rand_float(0.2, 1), rand_float(0.2, 1),
                                     rand_float(0.2, 1)});
     light.set_position(
@@ -155,6 +174,7 @@ int main() {
   }
 
   renderer.camera->position = Eigen::Vector3f{25, 12, -24};
+  physics_lod_system.observers.push_back(renderer.camera.get());
 
   bool draw_debug = false;
   physics_system.init();
@@ -169,6 +189,8 @@ int main() {
     prev_time = t2;
 
     physics_system.update(dt);
+    physics_lod_system.update(dt);
+    spatial_index_system.update(dt);
     debug_buffer_fill_system.update(dt);
 
     if (input_handler.is_key_pressed(rend::input::KeyCode::F)) {
@@ -180,7 +202,8 @@ int main() {
     }
 
     for (int i = 0; i < N_LIGHTS; i++) {
-      LightSource &light = renderer.lights[i];
+      Light &light = rend::ECS::get_entity_registry().get_component<Light>(
+          light_eids[i]);
       Eigen::Vector3f light_right_vec = light.get_view_mat().col(0).head<3>();
       Eigen::Vector3f light_position = light.get_position();
       light.set_position(light_position +
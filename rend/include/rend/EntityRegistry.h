@@ -1,11 +1,11 @@
 
 #pragma once
+#include <algorithm>
 #include <any>
 #include <bitset>
 #include <functional>
 #include <iostream>
 #include <memory>
-#include <rend/components.h>
 #include <rend/macros.h>
 #include <typeinfo>
 #include <unordered_map>
@@ -14,7 +14,12 @@
 
 namespace rend::ECS {
 
-static constexpr int MAX_ENTITIES = 1000;
+// Can be raised at configure time with -DREND_MAX_ENTITIES=N
+#ifndef REND_MAX_ENTITIES
+#define REND_MAX_ENTITIES 1000
+#endif
+
+static constexpr int MAX_ENTITIES = REND_MAX_ENTITIES;
 static constexpr int MAX_COMPONENTS = 32;
 
 typedef uint32_t EID; // Entity ID
@@ -31,6 +36,8 @@ struct EntityRegistry {
   friend EntityRegistry &get_entity_registry();
   struct RegistryEntry {
     std::bitset<MAX_ENTITIES> mask{0}; // Entity row for a single component
+    // Registry change version of the last write to the entity's component
+    std::vector<uint64_t> versions = std::vector<uint64_t>(MAX_ENTITIES, 0);
     bool is_component_enabled(EID entity_id) { return mask.test(entity_id); }
   };
 
@@ -40,6 +47,8 @@ struct EntityRegistry {
   std::vector<RegistryEntry> component_rows; // Component rows for all entities
   std::vector<std::any> component_pools;     // Allocated components pools
   std::unordered_set<EID> registered_entities;
+  EID first_available_id = 0; // No free IDs below this one
+  uint64_t change_version = 0; // Incremented on every marked change
   std::unordered_map<std::size_t, int>
       component_indices; // Component type hash -> index in the pool
 
@@ -54,6 +63,15 @@ struct EntityRegistry {
   template <typename T> void remove_component(EID id);
   template <typename T> T &get_component(EID id);
 
+  // Components are written through references so changes can't be tracked
+  // automatically. Systems that modify a component other systems cache
+  // results for (e.g. Transforms moved by physics) have to mark it
+  template <typename T> void mark_changed(EID id);
+  // Version of the last change of the component, 0 if it was never changed.
+  // A component changed since a frame if its version is above the registry
+  // change_version seen in that frame
+  template <typename T> uint64_t get_change_version(EID id);
+
   EID register_entity();
   EID get_available_id();
 
@@ -0,0 +1,125 @@
+#pragma once
+#include <rend/EntityRegistry.h>
+#include <stdexcept>
+#include <string>
+
+// Definitions of the EntityRegistry templates. Only included by the
+// translation units that instantiate them for their components with
+// REGISTER_COMPONENT
+
+namespace rend::ECS {
+
+template <typename T> void EntityRegistry::register_component() {
+  if (registered_component_count >= MAX_COMPONENTS) {
+    throw std::runtime_error("ECS: Too many components registered");
+  }
+
+  size_t hash = typeid(T).hash_code();
+  const auto &index_iterator = component_indices.find(hash);
+  if (index_iterator != component_indices.end()) {
+    std::cerr << "ECS: Component already registered" << std::endl;
+    return;
+  }
+  int component_index = registered_component_count++;
+  component_indices.insert({hash, component_index});
+  typename ComponentPool<T>::Ptr pool = std::make_shared<ComponentPool<T>>();
+  component_pools[component_index] =
+      std::make_any<typename ComponentPool<T>::Ptr>(pool);
+}
+
+template <typename T> int EntityRegistry::get_component_index() {
+  const auto &index_iterator = component_indices.find(typeid(T).hash_code());
+  if (index_iterator == component_indices.end()) {
+    throw std::runtime_error(std::string("ECS: Component not registered: ") +
+                             typeid(T).name());
+  }
+  return index_iterator->second;
+}
+
+template <typename T> bool EntityRegistry::is_component_registered() {
+  return component_indices.find(typeid(T).hash_code()) !=
+         component_indices.end();
+}
+
+template <typename T> bool EntityRegistry::is_component_enabled(EID id) {
+  int component_index = get_component_index<T>();
+  if (id >= MAX_ENTITIES) {
+    throw std::runtime_error("ECS: Entity ID out of range");
+  }
+  if (!is_entity_enabled(id)) {
+    throw std::runtime_error("ECS: Entity not registered");
+  }
+
+  return is_component_enabled(id, component_index);
+}
+
+template <typename T> T &EntityRegistry::add_component(EID id) {
+  if (id >= MAX_ENTITIES) {
+    throw std::runtime_error("ECS: Entity ID out of range");
+  }
+
+  int component_index = get_component_index<T>();
+  if (is_component_enabled(id, component_index)) {
+    throw std::runtime_error(
+        "ECS: Component already registered for entity EID " +
+        std::to_string(id));
+  }
+
+  if (!std::any_cast<typename ComponentPool<T>::Ptr>(
+          component_pools[component_index])) {
+    throw std::runtime_error(
+        "ECS: Component pool not initialized for component " +
+        std::string{typeid(T).name()});
+  }
+
+  typename ComponentPool<T>::Ptr pool =
+      std::any_cast<typename ComponentPool<T>::Ptr>(
+          component_pools[component_index]);
+  pool->components[id] = T{}; // Default construct component
+  component_rows[component_index].mask.flip(id);
+  component_rows[component_index].versions[id] = ++change_version;
+  return pool->components[id];
+}
+
+template <typename T> void EntityRegistry::remove_component(EID id) {
+  int component_index = get_component_index<T>();
+
+  if (is_component_enabled(id, component_index)) {
+    std::cerr << "ECS: Component not registered for entity EID" << id
+              << std::endl;
+  }
+
+  component_rows[component_index].mask.flip(id);
+}
+
+template <typename T> T &EntityRegistry::get_component(EID id) {
+  int component_index = get_component_index<T>();
+
+  if (!is_component_enabled(id, component_index)) {
+    throw std::runtime_error("ECS: Component not registered for entity EID " +
+                             std::to_string(id));
+  }
+  typename ComponentPool<T>::Ptr pool =
+      std::any_cast<typename ComponentPool<T>::Ptr>(
+          component_pools[component_index]);
+
+  return pool->components[id];
+}
+
+template <typename T> void EntityRegistry::mark_changed(EID id) {
+  int component_index = get_component_index<T>();
+  if (id >= MAX_ENTITIES) {
+    throw std::runtime_error("ECS: Entity ID out of range");
+  }
+  component_rows[component_index].versions[id] = ++change_version;
+}
+
+template <typename T> uint64_t EntityRegistry::get_change_version(EID id) {
+  int component_index = get_component_index<T>();
+  if (id >= MAX_ENTITIES) {
+    throw std::runtime_error("ECS: Entity ID out of range");
+  }
+  return component_rows[component_index].versions[id];
+}
+
+} // namespace rend::ECS
@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+#include <Jolt/Jolt.h>
+
+#include <Jolt/Core/Color.h>
+#include <Jolt/Core/JobSystemThreadPool.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+
+namespace rend {
+/**
+ * @brief Engine wide worker pool. Physics, queries and any other batched work
+ * share the same threads so they don't fight each other for cores
+ *
+ */
+struct JobSystem {
+  JPH::JobSystemThreadPool *thread_pool;
+
+  JobSystem() {
+    // Jolt containers used by the pool go through the registered allocator
+    JPH::RegisterDefaultAllocator();
+    thread_pool = new JPH::JobSystemThreadPool(
+        JPH::cMaxPhysicsJobs, JPH::cMaxPhysicsBarriers,
+        std::max<int>(1, std::thread::hardware_concurrency() - 1));
+  }
+
+  JobSystem(const JobSystem &) = delete;
+
+  ~JobSystem() { delete thread_pool; }
+
+  void set_num_threads(int num_threads) {
+    thread_pool->SetNumThreads(num_threads);
+  }
+
+  // Worker threads + the thread that waits on the jobs
+  uint32_t get_max_concurrency() const {
+    return thread_pool->GetMaxConcurrency();
+  }
+
+  // Splits count items into batches so that every worker gets a few of them
+  uint32_t get_batch_size(uint32_t count, uint32_t min_batch_size = 16) const {
+    uint32_t batches = get_max_concurrency() * 4;
+    return std::max(min_batch_size, (count + batches - 1) / batches);
+  }
+
+  /**
+   * @brief Runs function(begin, end, batch_index) over [0, count) in batches
+   * of batch_size and blocks until all of them are done. Must not be called
+   * from inside a job.
+   */
+  template <typename Function>
+  void parallel_for(uint32_t count, uint32_t batch_size,
+                    const Function &function) {
+    if (count == 0) {
+      return;
+    }
+    uint32_t batch_count = (count + batch_size - 1) / batch_size;
+    if (batch_count == 1) {
+      function(0u, count, 0u);
+      return;
+    }
+
+    // Jobs only capture a pointer and an index so that std::function
+    // doesn't have to allocate
+    struct Context {
+      const Function *function;
+      uint32_t count;
+      uint32_t batch_size;
+    } context{&function, count, batch_size};
+
+    JPH::JobSystem::Barrier *barrier = thread_pool->CreateBarrier();
+    for (uint32_t batch = 0; batch < batch_count; batch++) {
+      JPH::JobHandle handle = thread_pool->CreateJob(
+          "rend::parallel_for", JPH::Color::sGreen, [&context, batch]() {
+            uint32_t begin = batch * context.batch_size;
+            uint32_t end = std::min(context.count, begin + context.batch_size);
+            (*context.function)(begin, end, batch);
+          });
+      barrier->AddJob(handle);
+    }
+    thread_pool->WaitForJobs(barrier);
+    thread_pool->DestroyBarrier(barrier);
+  }
+};
+
+inline JobSystem &get_job_system() {
+  static JobSystem job_system{};
+  return job_system;
+}
+} // namespace rend
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <rend/macros.h>
+#include <rend/math_utils.h>
+
+enum LightType { POINT_LIGHT, DIRECTIONAL_LIGHT };
+
+/**
+ * @brief Spot light component. Setters only flag the light as dirty, the view
+ * and projection matrices are recomputed once when they are next read
+ *
+ */
+class Light {
+  Eigen::Vector3f position = Eigen::Vector3f::Zero();
+  Eigen::Vector3f direction = Eigen::Vector3f::UnitZ();
+  Eigen::Vector3f color = Eigen::Vector3f::Ones();
+  float intensity = 1.0f;
+  float fov = M_PI * 0.6f;
+  float range = 500.0f; // Nothing is lit further away
+  LightType type = DIRECTIONAL_LIGHT;
+  bool is_enabled = true;
+
+  Eigen::Matrix4f view_matrix;
+  Eigen::Matrix4f projection_matrix;
+  bool dirty = true;
+
+public:
+  void set_intensity(float intensity) { this->intensity = intensity; }
+  void disable() { is_enabled = false; }
+  void enable() { is_enabled = true; }
+  bool enabled() const { return is_enabled; }
+
+  Eigen::Vector3f get_position() const { return position; }
+  Eigen::Vector3f get_direction() const { return direction; }
+  Eigen::Vector3f get_color() const { return color; }
+  float get_intensity() const { return intensity; }
+  float get_fov() const { return fov; }
+  float get_range() const { return range; }
+  LightType get_type() const { return type; }
+
+  const Eigen::Matrix4f &get_view_mat() {
+    update_VP();
+    return view_matrix;
+  }
+  const Eigen::Matrix4f &get_projection_mat() {
+    update_VP();
+    return projection_matrix;
+  }
+
+  void set_fov(float fov) {
+    this->fov = fov;
+    dirty = true;
+  }
+  void set_type(LightType type) { this->type = type; }
+  void set_direction(const Eigen::Vector3f &dir) {
+    direction = dir;
+    dirty = true;
+  }
+  void set_position(const Eigen::Vector3f &pos) {
+    position = pos;
+    dirty = true;
+  }
+  // Also the far plane of the shadow projection
+  void set_range(float range) {
+    this->range = range;
+    dirty = true;
+  }
+  void set_color(const Eigen::Vector3f &col) { color = col; }
+
+  // Recomputes the matrices if the light moved since they were last read
+  void update_VP() {
+    if (!dirty) {
+      return;
+    }
+    projection_matrix =
+        get_projection_matrix(180.0f * get_fov() / M_PI, 1, 0.01f, range);
+    view_matrix = get_view_matrix(get_position(), get_direction());
+    dirty = false;
+  }
+
+  /**
+   * @brief Smallest sphere around the lit cone
+   *
+   */
+  void get_bounding_sphere(Eigen::Vector3f &center, float &radius) const {
+    float half_fov = 0.5f * get_fov();
+    if (half_fov > M_PI_4) {
+      // Wide cone, the sphere through the rim of the base
+      center = get_position() + get_direction() * range * std::cos(half_fov);
+      radius = range * std::sin(half_fov);
+    } else {
+      // Narrow cone, the sphere through the apex and the rim
+      radius = range / (2.0f * std::cos(half_fov));
+      center = get_position() + get_direction() * radius;
+    }
+  }
+};
@@ -1,9 +1,10 @@
 #pragma once
 #include <Eigen/Dense>
-#include <rend/Rendering/Vulkan/Mesh.h>
 #include <rend/Transform.h>
 #include <rend/math_utils.h>
 
+class Mesh;
+
 struct AABB {
   Eigen::Vector3f min_local;
   Eigen::Vector3f max_local;
@@ -22,29 +23,8 @@ struct AABB {
     this->max_local = max_local;
   }
 
-  AABB(const Mesh &mesh) {
-    min_local.setZero();
-    max_local.setZero();
-    min_global.setZero();
-    max_global.setZero();
-    if (mesh.vertex_count() > 0) {
-      min_local = mesh.get_vertex_pos(0);
-      max_local = mesh.get_vertex_pos(0);
-
-      // Model space coords
-      for (int v_idx = 0; v_idx < mesh.vertex_count(); v_idx++) {
-        Eigen::Vector3f vertex_pos = mesh.get_vertex_pos(v_idx);
-        for (int i = 0; i < 3; i++) {
-          if (vertex_pos(i) < min_local(i)) {
-            min_local(i) = vertex_pos(i);
-          }
-          if (vertex_pos(i) > max_local(i)) {
-            max_local(i) = vertex_pos(i);
-          }
-        }
-      }
-    }
-  }
+  // Bounds of the mesh vertices, defined with the renderer
+  AABB(const Mesh &mesh);
 };
 
 inline Eigen::Matrix<float, 8, 4>
@@ -74,6 +54,17 @@ inline Eigen::Matrix<float, 8, 4> get_global_aabb_vertices(const AABB &aabb) {
   return get_cube_vertices(aabb.min_global, aabb.max_global);
 }
 
+// Updates the global bounds from the local bounds placed by transform
+inline void update_global_aabb(AABB &aabb, const Transform &transform) {
+  Eigen::Matrix<float, 8, 4> vertices =
+      (transform.get_model_matrix() * get_local_aabb_vertices(aabb).transpose())
+          .transpose();
+  std::pair<Eigen::Vector3f, Eigen::Vector3f> span =
+      compute_span(vertices.block<8, 3>(0, 0));
+  aabb.min_global = span.first;
+  aabb.max_global = span.second;
+}
+
 /**
  * @brief Checks if two AABBs intersect
  * Note that both should be in the common frame of reference
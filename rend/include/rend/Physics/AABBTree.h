@@ -0,0 +1,521 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <rend/EntityRegistry.h>
+#include <rend/Physics/Frustum.h>
+
+namespace rend::physics {
+struct Bounds {
+  Eigen::Vector3f min = Eigen::Vector3f::Zero();
+  Eigen::Vector3f max = Eigen::Vector3f::Zero();
+
+  Bounds() {}
+  Bounds(const Eigen::Vector3f &min, const Eigen::Vector3f &max)
+      : min(min), max(max) {}
+
+  // Inverted bounds that any grow() overwrites
+  static Bounds empty() {
+    return Bounds{
+        Eigen::Vector3f::Constant(std::numeric_limits<float>::max()),
+        Eigen::Vector3f::Constant(std::numeric_limits<float>::lowest())};
+  }
+
+  void grow(const Eigen::Vector3f &point) {
+    min = min.cwiseMin(point);
+    max = max.cwiseMax(point);
+  }
+
+  void grow(const Bounds &other) {
+    min = min.cwiseMin(other.min);
+    max = max.cwiseMax(other.max);
+  }
+
+  Bounds merged(const Bounds &other) const {
+    return Bounds{min.cwiseMin(other.min), max.cwiseMax(other.max)};
+  }
+
+  Bounds expanded(float margin) const {
+    return Bounds{min.array() - margin, max.array() + margin};
+  }
+
+  Eigen::Vector3f center() const { return (min + max) * 0.5f; }
+
+  float surface_area() const {
+    Eigen::Vector3f size = (max - min).cwiseMax(0.0f);
+    return 2.0f * (size.x() * size.y() + size.y() * size.z() +
+                   size.z() * size.x());
+  }
+
+  bool contains(const Bounds &other) const {
+    return (min.array() <= other.min.array()).all() &&
+           (max.array() >= other.max.array()).all();
+  }
+
+  bool overlaps(const Bounds &other) const {
+    return (min.array() <= other.max.array()).all() &&
+           (max.array() >= other.min.array()).all();
+  }
+
+  // Zero inside the bounds
+  float squared_distance(const Eigen::Vector3f &point) const {
+    return (min - point).cwiseMax(point - max).cwiseMax(0.0f).squaredNorm();
+  }
+
+  // Slab test, distance is where the ray enters the bounds
+  bool intersect_ray(const Eigen::Vector3f &origin,
+                     const Eigen::Vector3f &inv_direction, float max_distance,
+                     float &distance) const {
+    Eigen::Array3f t1 = (min - origin).array() * inv_direction.array();
+    Eigen::Array3f t2 = (max - origin).array() * inv_direction.array();
+    float t_enter = std::max(t1.min(t2).maxCoeff(), 0.0f);
+    float t_exit = std::min(t1.max(t2).minCoeff(), max_distance);
+    distance = t_enter;
+    return t_enter <= t_exit;
+  }
+};
+
+/**
+ * @brief Incremental bounding volume hierarchy over entity bounds.
+ * Leaves store bounds enlarged by a margin so that small moves don't touch
+ * the tree. Leaves that move out of them are refitted in place, which is
+ * cheap but slowly degrades the tree, so the tree is rebuilt with binned SAH
+ * once its cost has grown past rebuild_threshold times the cost of the last
+ * build.
+ *
+ */
+class AABBTree {
+public:
+  static constexpr int NULL_NODE = -1;
+
+  struct Hit {
+    ECS::EID eid;
+    float distance;
+  };
+
+  float margin = 0.1f;            // Enlargement of the leaf bounds
+  float rebuild_threshold = 1.5f; // Relative to the cost of the last build
+
+  // Returns the proxy of the entity, which stays valid until removed
+  int insert(ECS::EID eid, const Bounds &bounds) {
+    int leaf = allocate_node();
+    nodes[leaf].eid = eid;
+    nodes[leaf].tight = bounds;
+    nodes[leaf].bounds = bounds.expanded(margin);
+    insert_leaf(leaf);
+    leaf_count++;
+    return leaf;
+  }
+
+  void remove(int proxy) {
+    remove_leaf(proxy);
+    free_node(proxy);
+    leaf_count--;
+  }
+
+  // Returns true if the leaf left its enlarged bounds and had to be refitted
+  bool update(int proxy, const Bounds &bounds) {
+    nodes[proxy].tight = bounds;
+    if (nodes[proxy].bounds.contains(bounds)) {
+      return false;
+    }
+    nodes[proxy].bounds = bounds.expanded(margin);
+    refit(nodes[proxy].parent);
+    return true;
+  }
+
+  ECS::EID get_eid(int proxy) const { return nodes[proxy].eid; }
+  const Bounds &get_bounds(int proxy) const { return nodes[proxy].tight; }
+  size_t size() const { return leaf_count; }
+
+  void clear() {
+    nodes.clear();
+    root = NULL_NODE;
+    free_list = NULL_NODE;
+    leaf_count = 0;
+    built_cost = 0.0f;
+  }
+
+  // Surface area heuristic cost of the internal nodes relative to the root
+  float get_cost() const {
+    if (root == NULL_NODE || nodes[root].is_leaf()) {
+      return 0.0f;
+    }
+    float area_sum = 0.0f;
+    std::vector<int> stack{root};
+    while (!stack.empty()) {
+      const Node &node = nodes[stack.back()];
+      stack.pop_back();
+      if (node.is_leaf()) {
+        continue;
+      }
+      area_sum += node.bounds.surface_area();
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+    float root_area = nodes[root].bounds.surface_area();
+    return root_area > 0.0f ? area_sum / root_area : 0.0f;
+  }
+
+  // Rebuilds the tree with binned SAH, proxies stay valid
+  void rebuild() {
+    std::vector<int> leaves;
+    leaves.reserve(leaf_count);
+    if (root != NULL_NODE) {
+      std::vector<int> stack{root};
+      while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        if (nodes[index].is_leaf()) {
+          leaves.push_back(index);
+          continue;
+        }
+        stack.push_back(nodes[index].left);
+        stack.push_back(nodes[index].right);
+        free_node(index);
+      }
+    }
+
+    root = leaves.empty() ? NULL_NODE : build(leaves, 0, leaves.size());
+    if (root != NULL_NODE) {
+      nodes[root].parent = NULL_NODE;
+    }
+    built_cost = get_cost();
+  }
+
+  bool rebuild_if_degraded() {
+    if (leaf_count < 2 || get_cost() <= rebuild_threshold * built_cost) {
+      return false;
+    }
+    rebuild();
+    return true;
+  }
+
+  // Appends the entities whose bounds overlap bounds
+  void query_box(const Bounds &bounds, std::vector<ECS::EID> &result) const {
+    traverse([&](const Node &node) { return node.bounds.overlaps(bounds); },
+             [&](const Node &leaf) {
+               if (leaf.tight.overlaps(bounds)) {
+                 result.push_back(leaf.eid);
+               }
+             });
+  }
+
+  void query_frustum(const Frustum &frustum,
+                     std::vector<ECS::EID> &result) const {
+    traverse(
+        [&](const Node &node) {
+          return frustum.intersects_box(node.bounds.min, node.bounds.max);
+        },
+        [&](const Node &leaf) {
+          if (frustum.intersects_box(leaf.tight.min, leaf.tight.max)) {
+            result.push_back(leaf.eid);
+          }
+        });
+  }
+
+  // Appends the entities hit by the ray, sorted by distance along the ray
+  void query_ray(const Eigen::Vector3f &origin,
+                 const Eigen::Vector3f &direction, float max_distance,
+                 std::vector<Hit> &result) const {
+    Eigen::Vector3f inv_direction = direction.cwiseInverse();
+    size_t first = result.size();
+    float distance;
+    traverse(
+        [&](const Node &node) {
+          return node.bounds.intersect_ray(origin, inv_direction, max_distance,
+                                           distance);
+        },
+        [&](const Node &leaf) {
+          if (leaf.tight.intersect_ray(origin, inv_direction, max_distance,
+                                       distance)) {
+            result.push_back(Hit{leaf.eid, distance});
+          }
+        });
+    std::sort(result.begin() + first, result.end(),
+              [](const Hit &a, const Hit &b) { return a.distance < b.distance; });
+  }
+
+  // Appends the k entities closest to point, closest first
+  void query_nearest(const Eigen::Vector3f &point, size_t k,
+                     std::vector<Hit> &result) const {
+    if (root == NULL_NODE || k == 0) {
+      return;
+    }
+    typedef std::pair<float, int> Entry; // Squared distance, node
+    auto farther = [](const Entry &a, const Entry &b) {
+      return a.first > b.first;
+    };
+    auto closer = [](const Entry &a, const Entry &b) {
+      return a.first < b.first;
+    };
+    // Closest node first
+    std::priority_queue<Entry, std::vector<Entry>, decltype(farther)> open(
+        farther);
+    // Farthest of the best k first
+    std::priority_queue<Entry, std::vector<Entry>, decltype(closer)> best(
+        closer);
+
+    open.push({nodes[root].bounds.squared_distance(point), root});
+    while (!open.empty()) {
+      Entry entry = open.top();
+      open.pop();
+      if (best.size() == k && entry.first > best.top().first) {
+        break; // Nothing left that is closer
+      }
+      const Node &node = nodes[entry.second];
+      if (node.is_leaf()) {
+        best.push({node.tight.squared_distance(point), entry.second});
+        if (best.size() > k) {
+          best.pop();
+        }
+        continue;
+      }
+      open.push({nodes[node.left].bounds.squared_distance(point), node.left});
+      open.push(
+          {nodes[node.right].bounds.squared_distance(point), node.right});
+    }
+
+    size_t first = result.size();
+    result.resize(first + best.size());
+    for (size_t i = result.size(); i > first; i--) {
+      result[i - 1] = Hit{nodes[best.top().second].eid,
+                          std::sqrt(best.top().first)};
+      best.pop();
+    }
+  }
+
+private:
+  static constexpr int BIN_COUNT = 12;
+
+  struct Node {
+    Bounds bounds; // Enlarged for leaves
+    Bounds tight;  // Leaves only
+    int parent = NULL_NODE;
+    int left = NULL_NODE;
+    int right = NULL_NODE;
+    ECS::EID eid = ECS::MAX_ENTITIES;
+
+    bool is_leaf() const { return left == NULL_NODE; }
+  };
+
+  std::vector<Node> nodes;
+  int root = NULL_NODE;
+  int free_list = NULL_NODE; // Linked through Node::parent
+  size_t leaf_count = 0;
+  float built_cost = 0.0f;
+
+  int allocate_node() {
+    if (free_list == NULL_NODE) {
+      nodes.emplace_back();
+      return nodes.size() - 1;
+    }
+    int index = free_list;
+    free_list = nodes[index].parent;
+    nodes[index] = Node{};
+    return index;
+  }
+
+  void free_node(int index) {
+    nodes[index].parent = free_list;
+    free_list = index;
+  }
+
+  template <typename NodePredicate, typename LeafFunction>
+  void traverse(const NodePredicate &visit_node,
+                const LeafFunction &visit_leaf) const {
+    if (root == NULL_NODE) {
+      return;
+    }
+    std::vector<int> stack{root};
+    while (!stack.empty()) {
+      const Node &node = nodes[stack.back()];
+      stack.pop_back();
+      if (!visit_node(node)) {
+        continue;
+      }
+      if (node.is_leaf()) {
+        visit_leaf(node);
+        continue;
+      }
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+
+  void refit(int index) {
+    while (index != NULL_NODE) {
+      Node &node = nodes[index];
+      node.bounds = nodes[node.left].bounds.merged(nodes[node.right].bounds);
+      index = node.parent;
+    }
+  }
+
+  // Area added to the subtree of index by inserting bounds into it
+  float get_insertion_cost(int index, const Bounds &bounds) const {
+    float merged_area = nodes[index].bounds.merged(bounds).surface_area();
+    if (nodes[index].is_leaf()) {
+      return merged_area;
+    }
+    return merged_area - nodes[index].bounds.surface_area();
+  }
+
+  void insert_leaf(int leaf) {
+    if (root == NULL_NODE) {
+      root = leaf;
+      nodes[leaf].parent = NULL_NODE;
+      return;
+    }
+
+    // Descend towards the sibling that increases the total area the least
+    const Bounds leaf_bounds = nodes[leaf].bounds;
+    int index = root;
+    while (!nodes[index].is_leaf()) {
+      float area = nodes[index].bounds.surface_area();
+      float merged_area = nodes[index].bounds.merged(leaf_bounds).surface_area();
+      float new_parent_cost = 2.0f * merged_area;
+      // Every node on the way down grows by this much
+      float inherited_cost = 2.0f * (merged_area - area);
+
+      float left_cost =
+          get_insertion_cost(nodes[index].left, leaf_bounds) + inherited_cost;
+      float right_cost =
+          get_insertion_cost(nodes[index].right, leaf_bounds) + inherited_cost;
+      if (new_parent_cost < left_cost && new_parent_cost < right_cost) {
+        break;
+      }
+      index = left_cost < right_cost ? nodes[index].left : nodes[index].right;
+    }
+
+    int sibling = index;
+    int old_parent = nodes[sibling].parent;
+    int new_parent = allocate_node();
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].left = sibling;
+    nodes[new_parent].right = leaf;
+    nodes[new_parent].bounds = nodes[sibling].bounds.merged(leaf_bounds);
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    if (old_parent == NULL_NODE) {
+      root = new_parent;
+      return;
+    }
+    if (nodes[old_parent].left == sibling) {
+      nodes[old_parent].left = new_parent;
+    } else {
+      nodes[old_parent].right = new_parent;
+    }
+    refit(old_parent);
+  }
+
+  void remove_leaf(int leaf) {
+    if (leaf == root) {
+      root = NULL_NODE;
+      return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grand_parent = nodes[parent].parent;
+    int sibling =
+        nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+    nodes[sibling].parent = grand_parent;
+    if (grand_parent == NULL_NODE) {
+      root = sibling;
+    } else {
+      if (nodes[grand_parent].left == parent) {
+        nodes[grand_parent].left = sibling;
+      } else {
+        nodes[grand_parent].right = sibling;
+      }
+      refit(grand_parent);
+    }
+    free_node(parent);
+  }
+
+  // Builds the subtree over leaves[begin, end), returns its root
+  int build(std::vector<int> &leaves, size_t begin, size_t end) {
+    if (end - begin == 1) {
+      return leaves[begin];
+    }
+
+    Bounds centroid_bounds = Bounds::empty();
+    for (size_t i = begin; i < end; i++) {
+      centroid_bounds.grow(nodes[leaves[i]].bounds.center());
+    }
+    Eigen::Vector3f extents = centroid_bounds.max - centroid_bounds.min;
+    int axis;
+    float extent = extents.maxCoeff(&axis);
+
+    size_t mid = (begin + end) / 2;
+    if (extent > std::numeric_limits<float>::epsilon()) {
+      auto get_bin = [&](int leaf) {
+        float offset =
+            nodes[leaf].bounds.center()(axis) - centroid_bounds.min(axis);
+        return std::min(BIN_COUNT - 1, int(offset / extent * BIN_COUNT));
+      };
+
+      Bounds bin_bounds[BIN_COUNT];
+      int bin_counts[BIN_COUNT] = {};
+      for (int bin = 0; bin < BIN_COUNT; bin++) {
+        bin_bounds[bin] = Bounds::empty();
+      }
+      for (size_t i = begin; i < end; i++) {
+        int bin = get_bin(leaves[i]);
+        bin_bounds[bin].grow(nodes[leaves[i]].bounds);
+        bin_counts[bin]++;
+      }
+
+      // Cost of everything right of a split plane
+      float right_costs[BIN_COUNT] = {};
+      Bounds accumulated = Bounds::empty();
+      int count = 0;
+      for (int bin = BIN_COUNT - 1; bin > 0; bin--) {
+        accumulated.grow(bin_bounds[bin]);
+        count += bin_counts[bin];
+        right_costs[bin] = count > 0 ? count * accumulated.surface_area() : 0;
+      }
+
+      // Split after best_bin
+      int best_bin = -1;
+      float best_cost = std::numeric_limits<float>::max();
+      accumulated = Bounds::empty();
+      count = 0;
+      for (int bin = 0; bin < BIN_COUNT - 1; bin++) {
+        accumulated.grow(bin_bounds[bin]);
+        count += bin_counts[bin];
+        if (count == 0 || count == int(end - begin)) {
+          continue;
+        }
+        float cost = count * accumulated.surface_area() + right_costs[bin + 1];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_bin = bin;
+        }
+      }
+
+      if (best_bin >= 0) {
+        mid = std::partition(leaves.begin() + begin, leaves.begin() + end,
+                             [&](int leaf) { return get_bin(leaf) <= best_bin; }) -
+              leaves.begin();
+      }
+    }
+
+    int left = build(leaves, begin, mid);
+    int right = build(leaves, mid, end);
+    int node = allocate_node();
+    nodes[node].left = left;
+    nodes[node].right = right;
+    nodes[node].bounds = nodes[left].bounds.merged(nodes[right].bounds);
+    nodes[left].parent = node;
+    nodes[right].parent = node;
+    return node;
+  }
+};
+} // namespace rend::physics
@@ -0,0 +1,237 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include <Jolt/Jolt.h>
+
+#include <Jolt/Geometry/AABox.h>
+#include <Jolt/Physics/Character/CharacterVirtual.h>
+#include <Jolt/Physics/Collision/CollisionDispatch.h>
+#include <Jolt/Physics/Collision/ShapeCast.h>
+#include <Jolt/Physics/Collision/ShapeFilter.h>
+
+namespace rend::physics {
+/**
+ * @brief Character vs character collision against the poses the characters
+ * had when build was called. Characters moving in parallel only read this
+ * copy, never the state other workers are writing. The characters are
+ * binned into a uniform grid, queries only visit the cells around them
+ * instead of every other character.
+ *
+ * Characters in cells with the same parity in every axis are more than a
+ * cell apart. When the cell size covers two characters and the reach of a
+ * character during an update, they can't find each other, so the cells of
+ * one parity can be updated in parallel.
+ *
+ */
+class CharacterSnapshotCollision : public JPH::CharacterVsCharacterCollision {
+public:
+  struct Entry {
+    JPH::CharacterVirtual *character;
+    uint32_t index; // Into the characters passed to build
+    const JPH::Shape *shape;
+    JPH::RMat44 transform; // Center of mass
+    float padding;
+    JPH::AABox bounds; // World space, padding included
+  };
+
+  struct Cell {
+    int32_t x, y, z;
+    uint32_t first; // Entries of the cell are [first, first + count)
+    uint32_t count;
+
+    // Cells of the same parity can be updated at the same time
+    uint32_t get_parity() const {
+      return (x & 1) | (y & 1) << 1 | (z & 1) << 2;
+    }
+  };
+  static constexpr uint32_t PARITY_COUNT = 8;
+
+  /**
+   * @brief Copies the poses of the characters and bins them
+   *
+   * @param reach How far a character can move and look for contacts during
+   * one update
+   */
+  void build(const std::vector<JPH::CharacterVirtual *> &characters,
+             float reach) {
+    entries.clear();
+    cells.clear();
+    max_half_extent = 0.0f;
+    for (uint32_t i = 0; i < characters.size(); i++) {
+      JPH::CharacterVirtual *character = characters[i];
+      Entry entry;
+      entry.character = character;
+      entry.index = i;
+      entry.shape = character->GetShape();
+      entry.transform = character->GetCenterOfMassTransform();
+      entry.padding = character->GetCharacterPadding();
+      entry.bounds = entry.shape->GetWorldSpaceBounds(
+          entry.transform, JPH::Vec3::sReplicate(1.0f));
+      entry.bounds.ExpandBy(JPH::Vec3::sReplicate(entry.padding));
+      max_half_extent =
+          std::max(max_half_extent, entry.bounds.GetExtent().ReduceMax());
+      entries.push_back(entry);
+    }
+    cell_size = std::max(2.0f * max_half_extent + reach, MIN_CELL_SIZE);
+
+    std::sort(entries.begin(), entries.end(),
+              [&](const Entry &a, const Entry &b) {
+                return get_cell_key(a) < get_cell_key(b);
+              });
+    for (uint32_t i = 0; i < entries.size(); i++) {
+      std::tuple<int32_t, int32_t, int32_t> key = get_cell_key(entries[i]);
+      if (cells.empty() ||
+          std::tie(cells.back().x, cells.back().y, cells.back().z) != key) {
+        cells.push_back(Cell{std::get<0>(key), std::get<1>(key),
+                             std::get<2>(key), i, 0});
+      }
+      cells.back().count++;
+    }
+  }
+
+  const std::vector<Entry> &get_entries() const { return entries; }
+  const std::vector<Cell> &get_cells() const { return cells; }
+  float get_cell_size() const { return cell_size; }
+
+  void
+  CollideCharacter(const JPH::CharacterVirtual *inCharacter,
+                   JPH::RMat44Arg inCenterOfMassTransform,
+                   const JPH::CollideShapeSettings &inCollideShapeSettings,
+                   JPH::RVec3Arg inBaseOffset,
+                   JPH::CollideShapeCollector &ioCollector) const override {
+    const JPH::Shape *shape = inCharacter->GetShape();
+    JPH::Mat44 transform =
+        inCenterOfMassTransform.PostTranslated(-inBaseOffset).ToMat44();
+    JPH::AABox bounds = shape->GetWorldSpaceBounds(inCenterOfMassTransform,
+                                                   JPH::Vec3::sReplicate(1.0f));
+    bounds.ExpandBy(
+        JPH::Vec3::sReplicate(inCollideShapeSettings.mMaxSeparationDistance));
+
+    JPH::CollideShapeSettings settings = inCollideShapeSettings;
+    for_each_overlapping(bounds, [&](const Entry &entry) {
+      if (entry.character == inCharacter || ioCollector.ShouldEarlyOut()) {
+        return;
+      }
+      // The collector looks the character up for its velocity
+      ioCollector.SetUserData(reinterpret_cast<JPH::uint64>(entry.character));
+      // Detect the padding of the other character as well
+      settings.mMaxSeparationDistance =
+          inCollideShapeSettings.mMaxSeparationDistance + entry.padding;
+      JPH::CollisionDispatch::sCollideShapeVsShape(
+          shape, entry.shape, JPH::Vec3::sReplicate(1.0f),
+          JPH::Vec3::sReplicate(1.0f), transform,
+          entry.transform.PostTranslated(-inBaseOffset).ToMat44(),
+          JPH::SubShapeIDCreator(), JPH::SubShapeIDCreator(), settings,
+          ioCollector);
+    });
+    ioCollector.SetUserData(0);
+  }
+
+  void CastCharacter(const JPH::CharacterVirtual *inCharacter,
+                     JPH::RMat44Arg inCenterOfMassTransform,
+                     JPH::Vec3Arg inDirection,
+                     const JPH::ShapeCastSettings &inShapeCastSettings,
+                     JPH::RVec3Arg inBaseOffset,
+                     JPH::CastShapeCollector &ioCollector) const override {
+    JPH::ShapeCast shape_cast(
+        inCharacter->GetShape(), JPH::Vec3::sReplicate(1.0f),
+        inCenterOfMassTransform.PostTranslated(-inBaseOffset).ToMat44(),
+        inDirection);
+
+    // Bounds of the whole sweep, in world space
+    JPH::AABox bounds = shape_cast.mShapeWorldBounds;
+    JPH::AABox end_bounds = bounds;
+    end_bounds.Translate(inDirection);
+    bounds.Encapsulate(end_bounds);
+    bounds.Translate(JPH::Vec3(inBaseOffset));
+
+    JPH::ShapeFilter shape_filter;
+    for_each_overlapping(bounds, [&](const Entry &entry) {
+      if (entry.character == inCharacter || ioCollector.ShouldEarlyOut()) {
+        return;
+      }
+      ioCollector.SetUserData(reinterpret_cast<JPH::uint64>(entry.character));
+      JPH::CollisionDispatch::sCastShapeVsShapeWorldSpace(
+          shape_cast, inShapeCastSettings, entry.shape,
+          JPH::Vec3::sReplicate(1.0f), shape_filter,
+          entry.transform.PostTranslated(-inBaseOffset).ToMat44(),
+          JPH::SubShapeIDCreator(), JPH::SubShapeIDCreator(), ioCollector);
+    });
+    ioCollector.SetUserData(0);
+  }
+
+private:
+  // Keeps the grid coarse when the characters barely move
+  static constexpr float MIN_CELL_SIZE = 1.0f;
+
+  std::vector<Entry> entries; // Sorted by cell
+  std::vector<Cell> cells;    // Sorted by x, y and z
+  float cell_size = MIN_CELL_SIZE;
+  float max_half_extent = 0.0f;
+
+  int32_t get_cell_coordinate(float value) const {
+    return static_cast<int32_t>(std::floor(value / cell_size));
+  }
+
+  std::tuple<int32_t, int32_t, int32_t>
+  get_cell_key(const Entry &entry) const {
+    JPH::Vec3 center = entry.bounds.GetCenter();
+    return {get_cell_coordinate(center.GetX()),
+            get_cell_coordinate(center.GetY()),
+            get_cell_coordinate(center.GetZ())};
+  }
+
+  // Calls function for every entry whose bounds overlap bounds
+  template <typename Function>
+  void for_each_overlapping(const JPH::AABox &bounds,
+                            const Function &function) const {
+    auto visit_cell = [&](const Cell &cell) {
+      for (uint32_t i = cell.first; i < cell.first + cell.count; i++) {
+        if (entries[i].bounds.Overlaps(bounds)) {
+          function(entries[i]);
+        }
+      }
+    };
+
+    // Entries are binned by their center, they stick out of their cell by
+    // up to max_half_extent
+    JPH::Vec3 min = bounds.mMin - JPH::Vec3::sReplicate(max_half_extent);
+    JPH::Vec3 max = bounds.mMax + JPH::Vec3::sReplicate(max_half_extent);
+    int32_t min_x = get_cell_coordinate(min.GetX());
+    int32_t min_y = get_cell_coordinate(min.GetY());
+    int32_t min_z = get_cell_coordinate(min.GetZ());
+    int32_t max_x = get_cell_coordinate(max.GetX());
+    int32_t max_y = get_cell_coordinate(max.GetY());
+    int32_t max_z = get_cell_coordinate(max.GetZ());
+    int64_t range_cells = int64_t(max_x - min_x + 1) * (max_y - min_y + 1) *
+                          (max_z - min_z + 1);
+    if (range_cells > static_cast<int64_t>(cells.size())) {
+      for (const Cell &cell : cells) {
+        visit_cell(cell);
+      }
+      return;
+    }
+
+    for (int32_t x = min_x; x <= max_x; x++) {
+      for (int32_t y = min_y; y <= max_y; y++) {
+        for (int32_t z = min_z; z <= max_z; z++) {
+          auto iterator = std::lower_bound(
+              cells.begin(), cells.end(), std::make_tuple(x, y, z),
+              [](const Cell &cell,
+                 const std::tuple<int32_t, int32_t, int32_t> &key) {
+                return std::tie(cell.x, cell.y, cell.z) < key;
+              });
+          if (iterator != cells.end() && iterator->x == x &&
+              iterator->y == y && iterator->z == z) {
+            visit_cell(*iterator);
+          }
+        }
+      }
+    }
+  }
+};
+} // namespace rend::physics
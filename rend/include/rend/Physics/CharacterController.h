@@ -0,0 +1,27 @@
+#pragma once
+#include <Eigen/Dense>
+
+#include <Jolt/Jolt.h>
+
+#include <Jolt/Physics/Character/CharacterVirtual.h>
+
+// Capsule shaped character moved by the CharacterControllerSystem. The
+// transform position is at the feet of the character
+struct CharacterController {
+  float height = 1.2f; // Height of the cylindrical part of the capsule
+  float radius = 0.3f;
+  float mass = 70.0f;
+  float max_strength = 100.0f;  // Max force applied to dynamic bodies
+  float max_slope_angle = 0.8f; // Radians, steeper slopes can't be walked on
+  float jump_speed = 4.0f;
+
+  // Input
+  Eigen::Vector3f desired_velocity = Eigen::Vector3f::Zero(); // Horizontal
+  bool jump = false; // Consumed by the next update
+
+  // State
+  Eigen::Vector3f velocity = Eigen::Vector3f::Zero();
+  bool on_ground = false;
+
+  JPH::Ref<JPH::CharacterVirtual> character; // Created by the system's init
+};
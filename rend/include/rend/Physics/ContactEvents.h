@@ -0,0 +1,233 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <rend/EntityRegistry.h>
+
+#include <Jolt/Jolt.h>
+
+#include <Jolt/Physics/Body/Body.h>
+#include <Jolt/Physics/Body/BodyLockInterface.h>
+#include <Jolt/Physics/Collision/ContactListener.h>
+
+namespace rend::physics {
+struct ContactEvent {
+  enum class Type { ADDED, PERSISTED, REMOVED };
+  Type type;
+  ECS::EID eid1; // MAX_ENTITIES if the body is gone
+  ECS::EID eid2;
+  // Not available for removed contacts
+  Eigen::Vector3f point;  // On the first body, world space
+  Eigen::Vector3f normal; // From the first body to the second
+  float penetration_depth;
+};
+
+/**
+ * @brief Contact listener that records contact events without locking.
+ * Jolt invokes the callbacks from all of its worker threads, every thread
+ * claims its own single producer ring buffer with an atomic increment and
+ * the events are drained on the main thread after the update. Events that
+ * don't fit are dropped and counted.
+ *
+ */
+class ContactEventStream : public JPH::ContactListener {
+public:
+  static constexpr uint32_t DEFAULT_CAPACITY = 8192; // Events per thread
+
+  explicit ContactEventStream(uint32_t capacity_per_thread = DEFAULT_CAPACITY,
+                              uint32_t thread_count = 0) {
+    if (thread_count == 0) {
+      // Workers + the thread waiting on the jobs
+      thread_count = std::max(1u, std::thread::hardware_concurrency()) + 1;
+    }
+    uint32_t capacity = 1;
+    while (capacity < capacity_per_thread) {
+      capacity <<= 1;
+    }
+    rings.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; i++) {
+      rings.emplace_back(std::make_unique<Ring>(capacity));
+    }
+    generation = next_generation().fetch_add(1) + 1;
+  }
+
+  ContactEventStream(const ContactEventStream &) = delete;
+
+  virtual void OnContactAdded(const JPH::Body &inBody1,
+                              const JPH::Body &inBody2,
+                              const JPH::ContactManifold &inManifold,
+                              JPH::ContactSettings &ioSettings) override {
+    push(make_event(RawEvent::ADDED, inBody1, inBody2, inManifold));
+  }
+
+  virtual void OnContactPersisted(const JPH::Body &inBody1,
+                                  const JPH::Body &inBody2,
+                                  const JPH::ContactManifold &inManifold,
+                                  JPH::ContactSettings &ioSettings) override {
+    push(make_event(RawEvent::PERSISTED, inBody1, inBody2, inManifold));
+  }
+
+  // Bodies can't be accessed here, their entities are looked up when draining
+  virtual void
+  OnContactRemoved(const JPH::SubShapeIDPair &inSubShapePair) override {
+    RawEvent event{};
+    event.type = RawEvent::REMOVED;
+    event.body1 = inSubShapePair.GetBody1ID().GetIndexAndSequenceNumber();
+    event.body2 = inSubShapePair.GetBody2ID().GetIndexAndSequenceNumber();
+    push(event);
+  }
+
+  /**
+   * @brief Appends all recorded events to events and resets the rings. Must
+   * be called while the physics system is not updating
+   *
+   */
+  void drain(const JPH::BodyLockInterfaceNoLock &body_lock_interface,
+             std::vector<ContactEvent> &events) {
+    uint32_t used_rings =
+        std::min<uint32_t>(claimed_rings.load(std::memory_order_acquire),
+                           static_cast<uint32_t>(rings.size()));
+    for (uint32_t ring_idx = 0; ring_idx < used_rings; ring_idx++) {
+      Ring &ring = *rings[ring_idx];
+      uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+      uint32_t head = ring.head.load(std::memory_order_acquire);
+      for (; tail != head; tail++) {
+        events.push_back(
+            resolve(ring.events[tail & ring.mask], body_lock_interface));
+      }
+      ring.tail.store(tail, std::memory_order_release);
+    }
+
+    // Threads claim their rings again on the next update. This way threads
+    // recreated by the job system don't leak rings
+    claimed_rings.store(0, std::memory_order_relaxed);
+    generation = next_generation().fetch_add(1) + 1;
+  }
+
+  // Events lost since the last call because a ring was full
+  uint32_t take_dropped_count() { return dropped.exchange(0); }
+
+private:
+  struct RawEvent {
+    enum Type : uint8_t { ADDED, PERSISTED, REMOVED };
+    Type type;
+    uint32_t body1; // Body IDs, only used by removed events
+    uint32_t body2;
+    ECS::EID eid1;
+    ECS::EID eid2;
+    float point[3];
+    float normal[3];
+    float penetration_depth;
+  };
+
+  // Single producer single consumer ring
+  struct Ring {
+    std::vector<RawEvent> events;
+    uint32_t mask;
+    alignas(64) std::atomic<uint32_t> head{0}; // Written by the producer
+    alignas(64) std::atomic<uint32_t> tail{0}; // Written by the consumer
+
+    explicit Ring(uint32_t capacity) : events(capacity), mask(capacity - 1) {}
+  };
+
+  struct ThreadSlot {
+    uint64_t generation = 0;
+    uint32_t ring_idx = 0;
+  };
+
+  std::vector<std::unique_ptr<Ring>> rings;
+  std::atomic<uint32_t> claimed_rings{0};
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<uint64_t> generation{0};
+
+  static std::atomic<uint64_t> &next_generation() {
+    static std::atomic<uint64_t> counter{0};
+    return counter;
+  }
+
+  static ThreadSlot &get_thread_slot() {
+    thread_local ThreadSlot slot{};
+    return slot;
+  }
+
+  static RawEvent make_event(RawEvent::Type type, const JPH::Body &body1,
+                             const JPH::Body &body2,
+                             const JPH::ContactManifold &manifold) {
+    RawEvent event{};
+    event.type = type;
+    event.eid1 = static_cast<ECS::EID>(body1.GetUserData());
+    event.eid2 = static_cast<ECS::EID>(body2.GetUserData());
+    JPH::RVec3 point = manifold.GetWorldSpaceContactPointOn1(0);
+    event.point[0] = point.GetX();
+    event.point[1] = point.GetY();
+    event.point[2] = point.GetZ();
+    event.normal[0] = manifold.mWorldSpaceNormal.GetX();
+    event.normal[1] = manifold.mWorldSpaceNormal.GetY();
+    event.normal[2] = manifold.mWorldSpaceNormal.GetZ();
+    event.penetration_depth = manifold.mPenetrationDepth;
+    return event;
+  }
+
+  void push(const RawEvent &event) {
+    ThreadSlot &slot = get_thread_slot();
+    uint64_t current_generation = generation.load(std::memory_order_relaxed);
+    if (slot.generation != current_generation) {
+      slot.generation = current_generation;
+      slot.ring_idx = claimed_rings.fetch_add(1, std::memory_order_acq_rel);
+    }
+    if (slot.ring_idx >= rings.size()) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Ring &ring = *rings[slot.ring_idx];
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    uint32_t tail = ring.tail.load(std::memory_order_acquire);
+    if (head - tail > ring.mask) { // Full
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    ring.events[head & ring.mask] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  static ContactEvent
+  resolve(const RawEvent &raw,
+          const JPH::BodyLockInterfaceNoLock &body_lock_interface) {
+    ContactEvent event{};
+    event.eid1 = raw.eid1;
+    event.eid2 = raw.eid2;
+    event.point = Eigen::Vector3f{raw.point[0], raw.point[1], raw.point[2]};
+    event.normal = Eigen::Vector3f{raw.normal[0], raw.normal[1], raw.normal[2]};
+    event.penetration_depth = raw.penetration_depth;
+
+    switch (raw.type) {
+    case RawEvent::ADDED:
+      event.type = ContactEvent::Type::ADDED;
+      break;
+    case RawEvent::PERSISTED:
+      event.type = ContactEvent::Type::PERSISTED;
+      break;
+    case RawEvent::REMOVED:
+      event.type = ContactEvent::Type::REMOVED;
+      event.eid1 = get_eid(JPH::BodyID{raw.body1}, body_lock_interface);
+      event.eid2 = get_eid(JPH::BodyID{raw.body2}, body_lock_interface);
+      break;
+    }
+    return event;
+  }
+
+  static ECS::EID
+  get_eid(JPH::BodyID body_id,
+          const JPH::BodyLockInterfaceNoLock &body_lock_interface) {
+    const JPH::Body *body = body_lock_interface.TryGetBody(body_id);
+    return body ? static_cast<ECS::EID>(body->GetUserData())
+                : static_cast<ECS::EID>(ECS::MAX_ENTITIES);
+  }
+};
+} // namespace rend::physics
@@ -0,0 +1,53 @@
+#pragma once
+#include <Eigen/Dense>
+
+namespace rend::physics {
+/**
+ * @brief View frustum as six planes. A point p is inside a plane when
+ * normal.dot(p) + d >= 0
+ *
+ */
+struct Frustum {
+  enum Plane { LEFT, RIGHT, BOTTOM, TOP, NEAR, FAR, PLANE_COUNT };
+
+  Eigen::Matrix<float, PLANE_COUNT, 4> planes; // Rows of (normal, d)
+
+  Frustum() { planes.setZero(); } // Contains everything
+
+  /**
+   * @brief Extracts the planes from the rows of projection * view (Gribb &
+   * Hartmann). Expects the clip space of get_projection_matrix, which is
+   * -w <= z <= w, so the planes are a conservative fit for Vulkan's 0 <= z <= w
+   *
+   */
+  static Frustum from_view_projection(const Eigen::Matrix4f &view_projection) {
+    Frustum frustum;
+    const Eigen::Matrix4f &m = view_projection;
+    frustum.planes.row(LEFT) = m.row(3) + m.row(0);
+    frustum.planes.row(RIGHT) = m.row(3) - m.row(0);
+    frustum.planes.row(BOTTOM) = m.row(3) + m.row(1);
+    frustum.planes.row(TOP) = m.row(3) - m.row(1);
+    frustum.planes.row(NEAR) = m.row(3) + m.row(2);
+    frustum.planes.row(FAR) = m.row(3) - m.row(2);
+    for (int i = 0; i < PLANE_COUNT; i++) {
+      frustum.planes.row(i) /= frustum.planes.row(i).head<3>().norm();
+    }
+    return frustum;
+  }
+
+  bool intersects_sphere(const Eigen::Vector3f &center, float radius) const {
+    return ((planes.leftCols<3>() * center).array() + planes.col(3).array() >=
+            -radius)
+        .all();
+  }
+
+  // Tests the corner furthest along each plane normal
+  bool intersects_box(const Eigen::Vector3f &min,
+                      const Eigen::Vector3f &max) const {
+    Eigen::Matrix<float, PLANE_COUNT, 3> normals = planes.leftCols<3>();
+    Eigen::Matrix<float, PLANE_COUNT, 1> distances =
+        normals.cwiseMax(0.0f) * max + normals.cwiseMin(0.0f) * min;
+    return (distances.array() + planes.col(3).array() >= 0.0f).all();
+  }
+};
+} // namespace rend::physics
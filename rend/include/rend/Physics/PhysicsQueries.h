@@ -0,0 +1,47 @@
+#pragma once
+#include <Eigen/Dense>
+#include <rend/EntityRegistry.h>
+
+namespace rend::physics {
+// Inputs of the batched queries on the PhysicsSystemInterface. Directions are
+// expected to be normalized, max_distance is measured along them.
+// skip_kinematic ignores kinematic bodies, e.g. the ones the physics LOD moves
+
+struct RayQuery {
+  Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+  Eigen::Vector3f direction = -Eigen::Vector3f::UnitY();
+  float max_distance = 1.0f;
+  ECS::EID ignore_eid = ECS::MAX_ENTITIES; // e.g. the agent casting the ray
+  bool skip_kinematic = false;
+};
+
+struct SphereCastQuery {
+  Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+  Eigen::Vector3f direction = -Eigen::Vector3f::UnitY();
+  float radius = 0.5f;
+  float max_distance = 1.0f;
+  ECS::EID ignore_eid = ECS::MAX_ENTITIES;
+  bool skip_kinematic = false;
+};
+
+struct BoxCastQuery {
+  Eigen::Quaternionf rotation = Eigen::Quaternionf::Identity();
+  Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+  Eigen::Vector3f half_extents = Eigen::Vector3f::Constant(0.5f);
+  Eigen::Vector3f direction = -Eigen::Vector3f::UnitY();
+  float max_distance = 1.0f;
+  ECS::EID ignore_eid = ECS::MAX_ENTITIES;
+  bool skip_kinematic = false;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// Closest hit of a single query
+struct QueryHit {
+  bool hit = false;
+  ECS::EID eid = ECS::MAX_ENTITIES; // Entity owning the hit body
+  float distance = 0.0f;            // Along the query direction
+  Eigen::Vector3f point = Eigen::Vector3f::Zero();
+  Eigen::Vector3f normal = Eigen::Vector3f::Zero();
+};
+} // namespace rend::physics
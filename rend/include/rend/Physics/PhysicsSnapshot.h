@@ -0,0 +1,122 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <rend/EntityRegistry.h>
+#include <rend/Physics/Rigidbody.h>
+#include <rend/Transform.h>
+
+#include <Jolt/Jolt.h>
+
+#include <Jolt/Physics/Body/Body.h>
+#include <Jolt/Physics/StateRecorder.h>
+
+namespace rend::physics {
+/**
+ * @brief Jolt state recorder that writes into a buffer which is kept between
+ * saves. Once the buffer has grown to the size of the scene, saving a state
+ * no longer allocates
+ *
+ */
+class SnapshotRecorder : public JPH::StateRecorder {
+public:
+  explicit SnapshotRecorder(size_t reserved_bytes = 0) {
+    data.reserve(reserved_bytes);
+  }
+
+  // Starts a new recording, keeps the allocated memory
+  void clear() {
+    data.clear();
+    rewind();
+  }
+
+  // Moves the read position back to the start of the recording
+  void rewind() {
+    read_position = 0;
+    failed = false;
+  }
+
+  size_t size() const { return data.size(); }
+
+  virtual void WriteBytes(const void *inData, size_t inNumBytes) override {
+    const uint8_t *bytes = static_cast<const uint8_t *>(inData);
+    data.insert(data.end(), bytes, bytes + inNumBytes);
+  }
+
+  virtual void ReadBytes(void *outData, size_t inNumBytes) override {
+    if (read_position + inNumBytes > data.size()) {
+      failed = true;
+      std::memset(outData, 0, inNumBytes);
+      return;
+    }
+    std::memcpy(outData, data.data() + read_position, inNumBytes);
+    read_position += inNumBytes;
+  }
+
+  virtual bool IsEOF() const override { return read_position >= data.size(); }
+
+  virtual bool IsFailed() const override { return failed; }
+
+private:
+  std::vector<uint8_t> data;
+  size_t read_position = 0;
+  bool failed = false;
+};
+
+// Records only the bodies set in recorded, the rest of the scene is left out.
+// Restoring has to use the same filter the state was saved with
+class RecordedBodiesFilter : public JPH::StateRecorderFilter {
+public:
+  explicit RecordedBodiesFilter(
+      const std::bitset<ECS::MAX_ENTITIES> &recorded)
+      : recorded(recorded) {}
+
+  virtual bool ShouldSaveBody(const JPH::Body &inBody) const override {
+    JPH::uint64 eid = inBody.GetUserData();
+    return eid < static_cast<JPH::uint64>(ECS::MAX_ENTITIES) &&
+           recorded.test(eid);
+  }
+
+private:
+  const std::bitset<ECS::MAX_ENTITIES> &recorded;
+};
+
+/**
+ * @brief Physics state of a frame: the Jolt simulation and the ECS
+ * components it drives. Reuse the same snapshot for every save, saves only
+ * record the bodies that are active or were changed since the previous save
+ * into it. Sleeping bodies still have the state of the save that last
+ * recorded them, their components are kept here to put them back
+ *
+ */
+struct PhysicsSnapshot {
+  // Components of a simulated entity as of the last save that recorded it
+  struct SavedBody {
+    Transform transform;
+    Rigidbody rigidbody;
+  };
+
+  SnapshotRecorder recorder;
+  std::vector<SavedBody> bodies; // Indexed by EID
+  std::bitset<ECS::MAX_ENTITIES> saved{0};    // bodies[eid] holds a copy
+  std::bitset<ECS::MAX_ENTITIES> recorded{0}; // Recorded by the last save
+  uint64_t change_version = 0; // Registry change_version of the last save
+  float step_time_elapsed = 0.0f;
+  bool valid = false;
+
+  PhysicsSnapshot(size_t reserved_bytes = 0)
+      : recorder(reserved_bytes), bodies(ECS::MAX_ENTITIES) {}
+
+  // The next save records every simulated body again
+  void clear() {
+    recorder.clear();
+    saved.reset();
+    recorded.reset();
+    change_version = 0;
+    step_time_elapsed = 0.0f;
+    valid = false;
+  }
+};
+} // namespace rend::physics
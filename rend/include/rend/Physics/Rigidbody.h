@@ -7,6 +7,21 @@
 
 struct Rigidbody {
   enum class PrimitiveType { BOX, CAPSULE, SPHERE, CYLINDER };
+
+  // Simulation level of detail, managed by the PhysicsLODSystem
+  enum class LODLevel {
+    FULL,    // Simulated every step
+    REDUCED, // Kinematic, velocity integrated every update_interval frames
+    FROZEN   // Deactivated until an observer comes close or it is hit
+  };
+
+  struct LODPolicy {
+    bool enabled = false;
+    float reduced_distance = 50.0f; // Distance to the closest observer
+    float frozen_distance = 150.0f;
+    int update_interval = 4; // Frames between updates of REDUCED bodies
+  };
+
   float mass;
   float damping;
   float gravity;
@@ -16,6 +31,13 @@ struct Rigidbody {
   Eigen::Vector3f dimensions = Eigen::Vector3f::Ones();
   Eigen::Vector3f com_offset = Eigen::Vector3f::Zero();
 
+  LODPolicy lod;
+  LODLevel lod_level = LODLevel::FULL;
+  int lod_cooldown = 0; // Frames until the body can be demoted again
+  // Velocities of a FROZEN body, restored when it is promoted
+  Eigen::Vector3f frozen_linear_velocity = Eigen::Vector3f::Zero();
+  Eigen::Vector3f frozen_angular_velocity = Eigen::Vector3f::Zero();
+
   Rigidbody()
       : mass(1.0f), damping(0.99999f), gravity(9.8f), static_body(false),
         primitive_type(PrimitiveType::BOX) {
@@ -0,0 +1,96 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <vector>
+
+#include <rend/Physics/Frustum.h>
+
+namespace rend {
+/**
+ * @brief World space boxes stored as centers and half extents, one array per
+ * coordinate, so that the frustum tests run on whole batches of boxes
+ *
+ */
+struct CullingBounds {
+  static constexpr int BATCH_SIZE = 256;
+
+  void clear() { count = 0; }
+  size_t size() const { return count; }
+
+  Eigen::Vector3f get_min(size_t index) const {
+    return centers.col(index) - extents.col(index);
+  }
+  Eigen::Vector3f get_max(size_t index) const {
+    return centers.col(index) + extents.col(index);
+  }
+
+  void reserve(size_t capacity) {
+    if (capacity <= static_cast<size_t>(centers.cols())) {
+      return;
+    }
+    centers.conservativeResize(3, capacity);
+    extents.conservativeResize(3, capacity);
+  }
+
+  void add(const Eigen::Vector3f &min, const Eigen::Vector3f &max) {
+    if (count == static_cast<size_t>(centers.cols())) {
+      reserve(std::max<size_t>(BATCH_SIZE, 2 * count));
+    }
+    centers.col(count) = 0.5f * (min + max);
+    extents.col(count) = 0.5f * (max - min);
+    count++;
+  }
+
+  // Box in local space placed by model, bounded by rotating the extents
+  void add(const Eigen::Vector3f &min_local, const Eigen::Vector3f &max_local,
+           const Eigen::Matrix4f &model) {
+    Eigen::Vector3f center =
+        model.block<3, 3>(0, 0) * (0.5f * (min_local + max_local)) +
+        model.block<3, 1>(0, 3);
+    Eigen::Vector3f extent = model.block<3, 3>(0, 0).cwiseAbs() *
+                             (0.5f * (max_local - min_local));
+    add(center - extent, center + extent);
+  }
+
+  /**
+   * @brief Appends the indices of the boxes that intersect the frustum.
+   * Every plane is tested against a batch of boxes at once, the tests
+   * are conservative near the frustum corners
+   *
+   */
+  void cull(const rend::physics::Frustum &frustum,
+            std::vector<uint32_t> &visible) const {
+    Eigen::Array<float, 1, BATCH_SIZE> distance;
+    Eigen::Array<bool, 1, BATCH_SIZE> inside;
+    for (size_t begin = 0; begin < count; begin += BATCH_SIZE) {
+      int batch = std::min<size_t>(BATCH_SIZE, count - begin);
+      auto batch_centers = centers.middleCols(begin, batch).array();
+      auto batch_extents = extents.middleCols(begin, batch).array();
+
+      inside.head(batch).setConstant(true);
+      for (int plane = 0; plane < rend::physics::Frustum::PLANE_COUNT;
+           plane++) {
+        Eigen::Vector4f p = frustum.planes.row(plane);
+        distance.head(batch) = p(0) * batch_centers.row(0) +
+                               p(1) * batch_centers.row(1) +
+                               p(2) * batch_centers.row(2) + p(3) +
+                               std::abs(p(0)) * batch_extents.row(0) +
+                               std::abs(p(1)) * batch_extents.row(1) +
+                               std::abs(p(2)) * batch_extents.row(2);
+        inside.head(batch) = inside.head(batch) && distance.head(batch) >= 0.0f;
+      }
+
+      for (int i = 0; i < batch; i++) {
+        if (inside(i)) {
+          visible.push_back(begin + i);
+        }
+      }
+    }
+  }
+
+private:
+  Eigen::Matrix3Xf centers;
+  Eigen::Matrix3Xf extents;
+  size_t count = 0;
+};
+} // namespace rend
@@ -0,0 +1,276 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace rend {
+// Unit meshes drawn as line lists, placed by the instance model matrix
+enum class DebugPrimitive : uint32_t {
+  LINE,   // From (0, 0, 0) to (0, 0, 1)
+  BOX,    // Edges of [-1, 1]^3
+  SPHERE, // Meridians and the equator of a unit sphere
+  COUNT
+};
+constexpr uint32_t DEBUG_PRIMITIVE_COUNT =
+    static_cast<uint32_t>(DebugPrimitive::COUNT);
+constexpr int DEBUG_SPHERE_RESOLUTION = 20;
+
+// Layout matches the instance buffer of debug.vert
+struct DebugInstance {
+  float model[16];
+  float color[4];
+};
+
+// Instances [first, first + count) of one primitive after merging
+struct DebugInstanceRange {
+  uint32_t first;
+  uint32_t count;
+};
+
+// Vertex ranges of the primitives in the mesh built by
+// build_debug_primitive_vertices
+struct DebugVertexRange {
+  uint32_t first;
+  uint32_t count;
+};
+
+/**
+ * @brief Appends the positions of all unit primitives as line list vertices,
+ * ranges are indexed by DebugPrimitive
+ *
+ */
+inline void build_debug_primitive_vertices(
+    std::vector<Eigen::Vector3f> &vertices,
+    DebugVertexRange ranges[DEBUG_PRIMITIVE_COUNT]) {
+  auto begin_range = [&](DebugPrimitive primitive) {
+    ranges[static_cast<uint32_t>(primitive)].first = vertices.size();
+  };
+  auto end_range = [&](DebugPrimitive primitive) {
+    DebugVertexRange &range = ranges[static_cast<uint32_t>(primitive)];
+    range.count = vertices.size() - range.first;
+  };
+
+  begin_range(DebugPrimitive::LINE);
+  vertices.push_back(Eigen::Vector3f::Zero());
+  vertices.push_back(Eigen::Vector3f::UnitZ());
+  end_range(DebugPrimitive::LINE);
+
+  begin_range(DebugPrimitive::BOX);
+  for (int corner = 0; corner < 8; corner++) {
+    for (int axis = 0; axis < 3; axis++) {
+      if (corner & (1 << axis)) {
+        continue; // Every edge once, from the corner with the lower value
+      }
+      auto get_corner = [](int corner) {
+        return Eigen::Vector3f{corner & 1 ? 1.0f : -1.0f,
+                               corner & 2 ? 1.0f : -1.0f,
+                               corner & 4 ? 1.0f : -1.0f};
+      };
+      vertices.push_back(get_corner(corner));
+      vertices.push_back(get_corner(corner | (1 << axis)));
+    }
+  }
+  end_range(DebugPrimitive::BOX);
+
+  begin_range(DebugPrimitive::SPHERE);
+  for (int ring = 0; ring <= DEBUG_SPHERE_RESOLUTION; ring++) {
+    // Last ring is the equator, the others are meridians around Y
+    Eigen::Matrix3f rotation =
+        ring == DEBUG_SPHERE_RESOLUTION
+            ? Eigen::AngleAxisf(M_PI_2, Eigen::Vector3f::UnitX())
+                  .toRotationMatrix()
+            : Eigen::AngleAxisf(ring * 2 * M_PI / DEBUG_SPHERE_RESOLUTION,
+                                Eigen::Vector3f::UnitY())
+                  .toRotationMatrix();
+    for (int i = 0; i < DEBUG_SPHERE_RESOLUTION; i++) {
+      for (int j = i; j <= i + 1; j++) {
+        float theta = j * 2 * M_PI / DEBUG_SPHERE_RESOLUTION;
+        vertices.push_back(rotation *
+                           Eigen::Vector3f{cosf(theta), sinf(theta), 0.0f});
+      }
+    }
+  }
+  end_range(DebugPrimitive::SPHERE);
+}
+
+/**
+ * @brief Records debug primitive instances from any number of threads
+ * without locking. Every thread claims its own recording buffer with an
+ * atomic increment, merge gathers them into one instance array grouped by
+ * primitive. Buffers keep their capacity between frames so recording
+ * doesn't allocate once it has warmed up. A thread remembers its buffer per
+ * recorder, so it can record into several of them.
+ *
+ */
+class DebugDrawRecorder {
+public:
+  explicit DebugDrawRecorder(uint32_t thread_count = 0) {
+    if (thread_count == 0) {
+      // Workers + the thread waiting on the jobs
+      thread_count = std::max(1u, std::thread::hardware_concurrency()) + 1;
+    }
+    buffers.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; i++) {
+      buffers.emplace_back(std::make_unique<ThreadBuffer>());
+    }
+    id = next_generation().fetch_add(1) + 1;
+    generation = next_generation().fetch_add(1) + 1;
+  }
+
+  DebugDrawRecorder(const DebugDrawRecorder &) = delete;
+
+  void add(DebugPrimitive primitive, const Eigen::Matrix4f &model,
+           const Eigen::Vector3f &color) {
+    ThreadBuffer *buffer = get_thread_buffer();
+    if (buffer == nullptr) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    DebugInstance instance;
+    Eigen::Matrix4f::Map(instance.model) = model;
+    Eigen::Vector4f::Map(instance.color) << color, 1.0f;
+    buffer->instances[static_cast<uint32_t>(primitive)].push_back(instance);
+  }
+
+  void line(const Eigen::Vector3f &start, const Eigen::Vector3f &end,
+            const Eigen::Vector3f &color) {
+    // Only the Z column matters for the unit line
+    Eigen::Matrix4f model = Eigen::Matrix4f::Zero();
+    model.block<3, 1>(0, 2) = end - start;
+    model.block<3, 1>(0, 3) = start;
+    model(3, 3) = 1.0f;
+    add(DebugPrimitive::LINE, model, color);
+  }
+
+  // Box with the given local bounds placed by model
+  void box(const Eigen::Vector3f &min, const Eigen::Vector3f &max,
+           const Eigen::Matrix4f &model, const Eigen::Vector3f &color) {
+    Eigen::Matrix4f box_model = Eigen::Matrix4f::Identity();
+    box_model.diagonal().head<3>() = (max - min) * 0.5f;
+    box_model.block<3, 1>(0, 3) = (max + min) * 0.5f;
+    add(DebugPrimitive::BOX, model * box_model, color);
+  }
+
+  void sphere(const Eigen::Vector3f &center, float radius,
+              const Eigen::Vector3f &color) {
+    Eigen::Matrix4f model = Eigen::Matrix4f::Identity();
+    model.diagonal().head<3>().setConstant(radius);
+    model.block<3, 1>(0, 3) = center;
+    add(DebugPrimitive::SPHERE, model, color);
+  }
+
+  // Recorded since the last merge. Must not be called while other threads
+  // are recording
+  uint32_t get_instance_count() const {
+    uint32_t used_buffers =
+        std::min<uint32_t>(claimed_buffers.load(std::memory_order_acquire),
+                           static_cast<uint32_t>(buffers.size()));
+    uint32_t count = 0;
+    for (uint32_t buffer_idx = 0; buffer_idx < used_buffers; buffer_idx++) {
+      for (const std::vector<DebugInstance> &instances :
+           buffers[buffer_idx]->instances) {
+        count += instances.size();
+      }
+    }
+    return count;
+  }
+
+  /**
+   * @brief Copies the recorded instances to dst grouped by primitive and
+   * clears the recording buffers. Instances beyond capacity are dropped.
+   * Must not be called while other threads are recording
+   *
+   * @return Total number of instances written
+   */
+  uint32_t merge(DebugInstance *dst, uint32_t capacity,
+                 DebugInstanceRange ranges[DEBUG_PRIMITIVE_COUNT]) {
+    uint32_t used_buffers =
+        std::min<uint32_t>(claimed_buffers.load(std::memory_order_acquire),
+                           static_cast<uint32_t>(buffers.size()));
+    uint32_t written = 0;
+    for (uint32_t primitive = 0; primitive < DEBUG_PRIMITIVE_COUNT;
+         primitive++) {
+      ranges[primitive].first = written;
+      for (uint32_t buffer_idx = 0; buffer_idx < used_buffers; buffer_idx++) {
+        std::vector<DebugInstance> &instances =
+            buffers[buffer_idx]->instances[primitive];
+        uint32_t count = std::min<uint32_t>(instances.size(),
+                                            capacity - written);
+        std::copy(instances.begin(), instances.begin() + count,
+                  dst + written);
+        written += count;
+        dropped.fetch_add(instances.size() - count, std::memory_order_relaxed);
+        instances.clear();
+      }
+      ranges[primitive].count = written - ranges[primitive].first;
+    }
+
+    // Threads claim their buffers again on the next frame
+    claimed_buffers.store(0, std::memory_order_relaxed);
+    generation = next_generation().fetch_add(1) + 1;
+    return written;
+  }
+
+  // Instances lost since the last call because they didn't fit
+  uint32_t take_dropped_count() { return dropped.exchange(0); }
+
+private:
+  struct ThreadBuffer {
+    std::vector<DebugInstance> instances[DEBUG_PRIMITIVE_COUNT];
+  };
+
+  struct ThreadSlot {
+    uint64_t recorder_id = 0;
+    uint64_t generation = 0;
+    uint32_t buffer_idx = 0;
+  };
+  // Recorders a thread can alternate between without claiming new buffers,
+  // a thread using more of them drops its slots round robin
+  static constexpr uint32_t THREAD_SLOT_COUNT = 4;
+
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  std::atomic<uint32_t> claimed_buffers{0};
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<uint64_t> generation{0};
+  uint64_t id; // Keys the thread slots, unique like the generations
+
+  static std::atomic<uint64_t> &next_generation() {
+    static std::atomic<uint64_t> counter{0};
+    return counter;
+  }
+
+  ThreadBuffer *get_thread_buffer() {
+    thread_local ThreadSlot slots[THREAD_SLOT_COUNT]{};
+    thread_local uint32_t next_slot = 0;
+    ThreadSlot *slot = nullptr;
+    for (ThreadSlot &thread_slot : slots) {
+      if (thread_slot.recorder_id == id) {
+        slot = &thread_slot;
+        break;
+      }
+    }
+    if (slot == nullptr) {
+      slot = &slots[next_slot];
+      next_slot = (next_slot + 1) % THREAD_SLOT_COUNT;
+      slot->recorder_id = id;
+      slot->generation = 0;
+    }
+
+    uint64_t current_generation = generation.load(std::memory_order_relaxed);
+    if (slot->generation != current_generation) {
+      slot->generation = current_generation;
+      slot->buffer_idx =
+          claimed_buffers.fetch_add(1, std::memory_order_acq_rel);
+    }
+    if (slot->buffer_idx >= buffers.size()) {
+      return nullptr;
+    }
+    return buffers[slot->buffer_idx].get();
+  }
+};
+} // namespace rend
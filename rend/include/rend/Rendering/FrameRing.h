@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace rend {
+/**
+ * @brief Suballocates transient per-frame data from a ring of equally sized
+ * frame regions. Every frame takes the next region and allocates linearly
+ * from its start, a region is reused once frame_count frames have passed
+ * so the device must be done with it by then. Offsets are aligned for
+ * dynamic uniform and storage buffer bindings
+ *
+ */
+class FrameRingAllocator {
+public:
+  void init(size_t frame_size, uint32_t frame_count, size_t alignment) {
+    if (frame_count == 0 || alignment == 0 ||
+        (alignment & (alignment - 1)) != 0) {
+      throw std::runtime_error("Invalid frame ring parameters");
+    }
+    this->alignment = alignment;
+    this->frame_size = align_up(frame_size, alignment);
+    this->frame_count = frame_count;
+    frame_begin = 0;
+    head = 0;
+  }
+
+  void begin_frame(uint64_t frame_number) {
+    frame_begin = (frame_number % frame_count) * frame_size;
+    head = 0;
+  }
+
+  // Offset from the start of the ring, false if the region is full
+  bool allocate(size_t size, size_t &offset) {
+    size_t aligned_size = align_up(size, alignment);
+    if (head + aligned_size > frame_size) {
+      return false;
+    }
+    offset = frame_begin + head;
+    head += aligned_size;
+    return true;
+  }
+
+  size_t get_frame_size() const { return frame_size; }
+  size_t get_frame_count() const { return frame_count; }
+  size_t get_alignment() const { return alignment; }
+  // Of the current frame region
+  size_t get_frame_begin() const { return frame_begin; }
+  size_t get_used() const { return head; }
+
+  static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+private:
+  size_t frame_size = 0;
+  uint32_t frame_count = 0;
+  size_t alignment = 1;
+  size_t frame_begin = 0;
+  size_t head = 0;
+};
+} // namespace rend
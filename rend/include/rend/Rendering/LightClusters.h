@@ -0,0 +1,188 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace rend {
+/**
+ * @brief Froxel grid over the camera frustum with the lights that reach each
+ * froxel. Tiles split the screen evenly, slices split the view depth
+ * exponentially so that the froxels stay close to cubes. Expects a symmetric
+ * perspective projection looking down -z, as made by get_projection_matrix
+ *
+ */
+class LightClusters {
+public:
+  static constexpr uint32_t TILES_X = 16;
+  static constexpr uint32_t TILES_Y = 9;
+  static constexpr uint32_t SLICES = 24;
+  static constexpr uint32_t CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+  // Start of the shader storage buffer, followed by the ranges and the
+  // light indices
+  struct Header {
+    float near;
+    float far;
+    float slice_scale; // slice = log(depth) * slice_scale + slice_bias
+    float slice_bias;
+  };
+
+  Header header{};
+  // First index into light_indices and the light count of every cluster
+  std::vector<uint32_t> ranges = std::vector<uint32_t>(2 * CLUSTER_COUNT, 0);
+  std::vector<uint32_t> light_indices;
+
+  static uint32_t get_cluster_index(uint32_t x, uint32_t y, uint32_t slice) {
+    return (slice * TILES_Y + y) * TILES_X + x;
+  }
+
+  // Recomputes the froxel bounds when the projection changes
+  void set_projection(const Eigen::Matrix4f &projection, float near,
+                      float far) {
+    if (projection == this->projection && near == header.near &&
+        far == header.far) {
+      return;
+    }
+    this->projection = projection;
+    header.near = near;
+    header.far = far;
+    header.slice_scale = SLICES / std::log(far / near);
+    header.slice_bias = -std::log(near) * header.slice_scale;
+
+    cluster_min.resize(3, CLUSTER_COUNT);
+    cluster_max.resize(3, CLUSTER_COUNT);
+    for (uint32_t slice = 0; slice < SLICES; slice++) {
+      float depth_near = get_slice_depth(slice);
+      float depth_far = get_slice_depth(slice + 1);
+      for (uint32_t y = 0; y < TILES_Y; y++) {
+        for (uint32_t x = 0; x < TILES_X; x++) {
+          Eigen::Vector2f ndc_min{2.0f * x / TILES_X - 1.0f,
+                                  2.0f * y / TILES_Y - 1.0f};
+          Eigen::Vector2f ndc_max{2.0f * (x + 1) / TILES_X - 1.0f,
+                                  2.0f * (y + 1) / TILES_Y - 1.0f};
+          Eigen::Vector3f min = Eigen::Vector3f::Constant(INFINITY);
+          Eigen::Vector3f max = Eigen::Vector3f::Constant(-INFINITY);
+          for (float depth : {depth_near, depth_far}) {
+            for (const Eigen::Vector2f &ndc : {ndc_min, ndc_max}) {
+              Eigen::Vector3f corner = get_view_position(ndc, depth);
+              min = min.cwiseMin(corner);
+              max = max.cwiseMax(corner);
+            }
+          }
+          uint32_t cluster = get_cluster_index(x, y, slice);
+          cluster_min.col(cluster) = min;
+          cluster_max.col(cluster) = max;
+        }
+      }
+    }
+  }
+
+  void clear() {
+    cluster_lights.clear();
+    light_indices.clear();
+    std::fill(ranges.begin(), ranges.end(), 0);
+  }
+
+  /**
+   * @brief Bins the light into the froxels its bounding sphere touches. Only
+   * the froxels inside the screen rect and depth range of the sphere are
+   * tested
+   *
+   * @param center_view sphere center in view space
+   */
+  void add_light(uint32_t light_index, const Eigen::Vector3f &center_view,
+                 float radius) {
+    float depth = -center_view.z();
+    if (depth + radius < header.near || depth - radius > header.far) {
+      return;
+    }
+    uint32_t slice_begin = get_slice(depth - radius);
+    uint32_t slice_end = get_slice(depth + radius);
+
+    // Screen rect of the sphere's box clipped to the near plane. The
+    // projected coordinate x / depth is extreme at one of the depth bounds
+    float depth_min = std::max(depth - radius, header.near);
+    float depth_max = depth + radius;
+    Eigen::Vector2f box_min = center_view.head<2>().array() - radius;
+    Eigen::Vector2f box_max = center_view.head<2>().array() + radius;
+    Eigen::Vector2f scale{projection(0, 0), projection(1, 1)};
+    Eigen::Vector2f ndc_min =
+        (box_min / depth_min).cwiseMin(box_min / depth_max).cwiseProduct(scale);
+    Eigen::Vector2f ndc_max =
+        (box_max / depth_min).cwiseMax(box_max / depth_max).cwiseProduct(scale);
+    uint32_t x_begin = get_tile(ndc_min.x(), TILES_X);
+    uint32_t x_end = get_tile(ndc_max.x(), TILES_X);
+    uint32_t y_begin = get_tile(ndc_min.y(), TILES_Y);
+    uint32_t y_end = get_tile(ndc_max.y(), TILES_Y);
+
+    for (uint32_t slice = slice_begin; slice <= slice_end; slice++) {
+      for (uint32_t y = y_begin; y <= y_end; y++) {
+        for (uint32_t x = x_begin; x <= x_end; x++) {
+          uint32_t cluster = get_cluster_index(x, y, slice);
+          Eigen::Vector3f closest =
+              center_view.cwiseMax(cluster_min.col(cluster))
+                  .cwiseMin(cluster_max.col(cluster));
+          if ((closest - center_view).squaredNorm() <= radius * radius) {
+            cluster_lights.push_back(ClusterLight{cluster, light_index});
+          }
+        }
+      }
+    }
+  }
+
+  // Fills the ranges and the light indices of the added lights, the lights
+  // of a cluster keep the order they were added in
+  void build() {
+    for (const ClusterLight &entry : cluster_lights) {
+      ranges[2 * entry.cluster + 1]++;
+    }
+    uint32_t offset = 0;
+    for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+      ranges[2 * cluster] = offset;
+      offset += ranges[2 * cluster + 1];
+      ranges[2 * cluster + 1] = 0;
+    }
+    light_indices.resize(offset);
+    for (const ClusterLight &entry : cluster_lights) {
+      uint32_t &count = ranges[2 * entry.cluster + 1];
+      light_indices[ranges[2 * entry.cluster] + count++] = entry.light_index;
+    }
+  }
+
+  uint32_t get_slice(float depth) const {
+    float slice = std::log(std::max(depth, header.near)) * header.slice_scale +
+                  header.slice_bias;
+    return std::clamp<int>(slice, 0, SLICES - 1);
+  }
+
+  float get_slice_depth(uint32_t slice) const {
+    return header.near *
+           std::pow(header.far / header.near, static_cast<float>(slice) /
+                                                  SLICES);
+  }
+
+private:
+  struct ClusterLight {
+    uint32_t cluster;
+    uint32_t light_index;
+  };
+  std::vector<ClusterLight> cluster_lights;
+
+  Eigen::Matrix4f projection = Eigen::Matrix4f::Zero();
+  Eigen::Matrix3Xf cluster_min; // View space bounds of every froxel
+  Eigen::Matrix3Xf cluster_max;
+
+  Eigen::Vector3f get_view_position(const Eigen::Vector2f &ndc,
+                                    float depth) const {
+    return Eigen::Vector3f{ndc.x() * depth / projection(0, 0),
+                           ndc.y() * depth / projection(1, 1), -depth};
+  }
+
+  static uint32_t get_tile(float ndc, uint32_t tile_count) {
+    return std::clamp<int>(std::floor((ndc * 0.5f + 0.5f) * tile_count), 0,
+                           tile_count - 1);
+  }
+};
+} // namespace rend
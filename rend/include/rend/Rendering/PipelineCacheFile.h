@@ -0,0 +1,174 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include <vector>
+
+namespace rend {
+constexpr uint32_t PIPELINE_CACHE_UUID_SIZE = 16; // VK_UUID_SIZE
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505252; // "RRPC"
+constexpr uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+// Device and driver a pipeline cache was written by, from
+// VkPhysicalDeviceProperties
+struct PipelineCacheDevice {
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint32_t driver_version;
+  uint8_t cache_uuid[PIPELINE_CACHE_UUID_SIZE]; // pipelineCacheUUID
+};
+
+// Precedes the data of vkGetPipelineCacheData in the file
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint32_t driver_version;
+  uint8_t cache_uuid[PIPELINE_CACHE_UUID_SIZE];
+  uint32_t padding;
+  uint64_t data_size;
+  uint64_t checksum; // Of the data
+};
+static_assert(sizeof(PipelineCacheFileHeader) == 56,
+              "Pipeline cache file header has padding");
+
+// Start of the data returned by vkGetPipelineCacheData,
+// VkPipelineCacheHeaderVersionOne
+constexpr uint32_t PIPELINE_CACHE_VK_HEADER_SIZE =
+    16 + PIPELINE_CACHE_UUID_SIZE;
+constexpr uint32_t PIPELINE_CACHE_VK_HEADER_VERSION = 1;
+
+inline uint64_t pipeline_cache_checksum(const uint8_t *data, size_t size) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+inline std::vector<uint8_t>
+pack_pipeline_cache(const PipelineCacheDevice &device,
+                    const std::vector<uint8_t> &data) {
+  PipelineCacheFileHeader header{};
+  header.magic = PIPELINE_CACHE_MAGIC;
+  header.version = PIPELINE_CACHE_FILE_VERSION;
+  header.vendor_id = device.vendor_id;
+  header.device_id = device.device_id;
+  header.driver_version = device.driver_version;
+  memcpy(header.cache_uuid, device.cache_uuid, PIPELINE_CACHE_UUID_SIZE);
+  header.data_size = data.size();
+  header.checksum = pipeline_cache_checksum(data.data(), data.size());
+
+  std::vector<uint8_t> file(sizeof(header) + data.size());
+  memcpy(file.data(), &header, sizeof(header));
+  if (!data.empty()) {
+    memcpy(file.data() + sizeof(header), data.data(), data.size());
+  }
+  return file;
+}
+
+/**
+ * @brief Extracts the cache data of a file written by pack_pipeline_cache.
+ * Drivers should ignore incompatible data but some crash on it, so the data
+ * is only handed out when the file was written for the same device, driver
+ * and cache UUID, its own Vulkan header agrees and the checksum matches
+ *
+ * @return False if the file can't be used
+ */
+inline bool unpack_pipeline_cache(const std::vector<uint8_t> &file,
+                                  const PipelineCacheDevice &device,
+                                  std::vector<uint8_t> &data) {
+  PipelineCacheFileHeader header;
+  if (file.size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, file.data(), sizeof(header));
+  if (header.magic != PIPELINE_CACHE_MAGIC ||
+      header.version != PIPELINE_CACHE_FILE_VERSION ||
+      header.vendor_id != device.vendor_id ||
+      header.device_id != device.device_id ||
+      header.driver_version != device.driver_version ||
+      memcmp(header.cache_uuid, device.cache_uuid,
+             PIPELINE_CACHE_UUID_SIZE) != 0 ||
+      header.data_size != file.size() - sizeof(header)) {
+    return false;
+  }
+
+  const uint8_t *cache_data = file.data() + sizeof(header);
+  if (header.data_size < PIPELINE_CACHE_VK_HEADER_SIZE ||
+      pipeline_cache_checksum(cache_data, header.data_size) !=
+          header.checksum) {
+    return false;
+  }
+
+  uint32_t vk_header[4]; // Size, version, vendor and device
+  memcpy(vk_header, cache_data, sizeof(vk_header));
+  if (vk_header[0] < PIPELINE_CACHE_VK_HEADER_SIZE ||
+      vk_header[0] > header.data_size ||
+      vk_header[1] != PIPELINE_CACHE_VK_HEADER_VERSION ||
+      vk_header[2] != device.vendor_id || vk_header[3] != device.device_id ||
+      memcmp(cache_data + sizeof(vk_header), device.cache_uuid,
+             PIPELINE_CACHE_UUID_SIZE) != 0) {
+    return false;
+  }
+
+  data.assign(cache_data, cache_data + header.data_size);
+  return true;
+}
+
+// False if the file is missing, unreadable or can't be used
+inline bool read_pipeline_cache_file(const std::filesystem::path &path,
+                                     const PipelineCacheDevice &device,
+                                     std::vector<uint8_t> &data) {
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream) {
+    return false;
+  }
+  std::vector<uint8_t> file(static_cast<size_t>(stream.tellg()));
+  stream.seekg(0);
+  if (!stream.read(reinterpret_cast<char *>(file.data()), file.size())) {
+    return false;
+  }
+  return unpack_pipeline_cache(file, device, data);
+}
+
+// Written to a temporary file first and renamed over path. Every call uses
+// its own temporary name, so processes writing at the same time don't write
+// into each other's file, the last rename wins. Where rename is atomic (POSIX)
+// readers see either the old or the new cache, anything else fails the
+// checksum when read
+inline bool write_pipeline_cache_file(const std::filesystem::path &path,
+                                      const PipelineCacheDevice &device,
+                                      const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> file = pack_pipeline_cache(device, data);
+  std::random_device random;
+  std::ostringstream suffix;
+  suffix << ".tmp." << std::hex << random() << random();
+  std::filesystem::path temporary_path = path;
+  temporary_path += suffix.str();
+  std::error_code error;
+  {
+    std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!stream ||
+        !stream.write(reinterpret_cast<const char *>(file.data()),
+                      file.size())) {
+      stream.close();
+      std::filesystem::remove(temporary_path, error);
+      return false;
+    }
+  }
+  std::filesystem::rename(temporary_path, path, error);
+  if (error) {
+    std::error_code remove_error;
+    std::filesystem::remove(temporary_path, remove_error);
+    return false;
+  }
+  return true;
+}
+} // namespace rend
@@ -0,0 +1,118 @@
+#pragma once
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace rend {
+/**
+ * @brief Screen split into square tiles, marked by the projected bounds of
+ * world space boxes. Full screen passes are scissored to the runs of marked
+ * tiles so that the unmarked parts of the screen are not shaded at all
+ *
+ */
+class ScreenTileMask {
+public:
+  // Pixel rect of consecutive marked tiles in one tile row
+  struct Span {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  void resize(uint32_t width, uint32_t height, uint32_t tile_size) {
+    this->width = width;
+    this->height = height;
+    this->tile_size = tile_size;
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+    marks.assign(tiles_x * tiles_y, false);
+  }
+
+  void clear() { std::fill(marks.begin(), marks.end(), false); }
+
+  void mark_all() { std::fill(marks.begin(), marks.end(), true); }
+
+  /**
+   * @brief Marks the tiles under the screen rect of the box. Boxes crossing
+   * the camera plane mark the whole screen
+   *
+   * @param view_projection projection with y pointing down the screen
+   */
+  void add_box(const Eigen::Vector3f &min, const Eigen::Vector3f &max,
+               const Eigen::Matrix4f &view_projection) {
+    Eigen::Vector2f ndc_min = Eigen::Vector2f::Constant(INFINITY);
+    Eigen::Vector2f ndc_max = Eigen::Vector2f::Constant(-INFINITY);
+    for (int corner = 0; corner < 8; corner++) {
+      Eigen::Vector4f point{corner & 1 ? max.x() : min.x(),
+                            corner & 2 ? max.y() : min.y(),
+                            corner & 4 ? max.z() : min.z(), 1.0f};
+      Eigen::Vector4f clip = view_projection * point;
+      if (clip.w() <= 1e-5f) {
+        mark_all();
+        return;
+      }
+      Eigen::Vector2f ndc = clip.head<2>() / clip.w();
+      ndc_min = ndc_min.cwiseMin(ndc);
+      ndc_max = ndc_max.cwiseMax(ndc);
+    }
+    if (ndc_max.x() < -1.0f || ndc_max.y() < -1.0f || ndc_min.x() > 1.0f ||
+        ndc_min.y() > 1.0f) {
+      return;
+    }
+    uint32_t x_begin = get_tile(ndc_min.x(), width, tiles_x);
+    uint32_t x_end = get_tile(ndc_max.x(), width, tiles_x);
+    uint32_t y_begin = get_tile(ndc_min.y(), height, tiles_y);
+    uint32_t y_end = get_tile(ndc_max.y(), height, tiles_y);
+    for (uint32_t y = y_begin; y <= y_end; y++) {
+      std::fill(marks.begin() + y * tiles_x + x_begin,
+                marks.begin() + y * tiles_x + x_end + 1, true);
+    }
+  }
+
+  bool is_marked(uint32_t tile_x, uint32_t tile_y) const {
+    return marks[tile_y * tiles_x + tile_x];
+  }
+
+  // Replaces spans with the runs of marked tiles, clipped to the screen
+  void get_spans(std::vector<Span> &spans) const {
+    spans.clear();
+    for (uint32_t y = 0; y < tiles_y; y++) {
+      uint32_t x = 0;
+      while (x < tiles_x) {
+        if (!is_marked(x, y)) {
+          x++;
+          continue;
+        }
+        uint32_t begin = x;
+        while (x < tiles_x && is_marked(x, y)) {
+          x++;
+        }
+        uint32_t pixel_x = begin * tile_size;
+        uint32_t pixel_y = y * tile_size;
+        spans.push_back(Span{pixel_x, pixel_y,
+                             std::min(x * tile_size, width) - pixel_x,
+                             std::min(pixel_y + tile_size, height) - pixel_y});
+      }
+    }
+  }
+
+  uint32_t get_tiles_x() const { return tiles_x; }
+  uint32_t get_tiles_y() const { return tiles_y; }
+
+private:
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t tile_size = 1;
+  uint32_t tiles_x = 0;
+  uint32_t tiles_y = 0;
+  std::vector<bool> marks;
+
+  uint32_t get_tile(float ndc, uint32_t pixels, uint32_t tile_count) const {
+    float pixel = (std::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * pixels;
+    return std::min<uint32_t>(pixel / tile_size, tile_count - 1);
+  }
+};
+} // namespace rend
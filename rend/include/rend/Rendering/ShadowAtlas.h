@@ -0,0 +1,137 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rend {
+// Square tile of the shadow atlas in texels, size 0 means no tile
+struct ShadowAtlasRect {
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint32_t size = 0;
+};
+
+/**
+ * @brief Largest power of two atlas side whose texels fit into the budget
+ *
+ */
+constexpr uint32_t get_shadow_atlas_resolution(size_t budget_bytes,
+                                               size_t bytes_per_texel) {
+  uint32_t resolution = 1;
+  while (static_cast<size_t>(2 * resolution) * (2 * resolution) *
+             bytes_per_texel <=
+         budget_bytes) {
+    resolution *= 2;
+  }
+  return resolution;
+}
+
+/**
+ * @brief Quadtree allocator of square power of two tiles. Every node of the
+ * quadtree is either free, allocated or split into four children. Free nodes
+ * are kept in a list per level, allocating a tile splits the smallest free
+ * node that is large enough
+ *
+ */
+class ShadowAtlasAllocator {
+  uint32_t atlas_resolution;
+  uint32_t min_tile_size;
+  std::vector<std::vector<ShadowAtlasRect>> free_nodes; // Per level
+
+public:
+  // Requested tile of a light, more important lights are placed first
+  struct Request {
+    int light_index;
+    float importance;
+    uint32_t size;
+  };
+
+  ShadowAtlasAllocator(uint32_t atlas_resolution, uint32_t min_tile_size)
+      : atlas_resolution(atlas_resolution), min_tile_size(min_tile_size) {
+    uint32_t levels = 1;
+    for (uint32_t size = atlas_resolution; size > min_tile_size; size /= 2) {
+      levels++;
+    }
+    free_nodes.resize(levels);
+    clear();
+  }
+
+  uint32_t get_atlas_resolution() const { return atlas_resolution; }
+
+  // Frees all the tiles
+  void clear() {
+    for (std::vector<ShadowAtlasRect> &nodes : free_nodes) {
+      nodes.clear();
+    }
+    free_nodes[0].push_back(ShadowAtlasRect{0, 0, atlas_resolution});
+  }
+
+  /**
+   * @brief Allocates a tile of size rounded up to a power of two
+   *
+   * @return false if there is no free tile of that size
+   */
+  bool allocate(uint32_t size, ShadowAtlasRect &rect) {
+    int level = get_level(size);
+    int free_level = level;
+    while (free_level >= 0 && free_nodes[free_level].empty()) {
+      free_level--;
+    }
+    if (free_level < 0) {
+      return false;
+    }
+
+    rect = free_nodes[free_level].back();
+    free_nodes[free_level].pop_back();
+    // Keep the first quadrant, free the other three
+    for (; free_level < level; free_level++) {
+      rect.size /= 2;
+      free_nodes[free_level + 1].push_back(
+          ShadowAtlasRect{rect.x + rect.size, rect.y + rect.size, rect.size});
+      free_nodes[free_level + 1].push_back(
+          ShadowAtlasRect{rect.x, rect.y + rect.size, rect.size});
+      free_nodes[free_level + 1].push_back(
+          ShadowAtlasRect{rect.x + rect.size, rect.y, rect.size});
+    }
+    return true;
+  }
+
+  /**
+   * @brief Repacks the atlas for the requests. Requests are served in order
+   * of importance, a request that doesn't fit is halved until it does or
+   * reaches the minimum tile size, in which case the light gets no tile
+   *
+   * @param rects tile of every light, indexed by Request::light_index
+   */
+  void allocate(std::vector<Request> &requests,
+                std::vector<ShadowAtlasRect> &rects) {
+    clear();
+    std::sort(requests.begin(), requests.end(),
+              [](const Request &a, const Request &b) {
+                return a.importance > b.importance;
+              });
+    for (const Request &request : requests) {
+      ShadowAtlasRect &rect = rects[request.light_index];
+      rect = ShadowAtlasRect{};
+      for (uint32_t size = request.size; size >= min_tile_size; size /= 2) {
+        if (allocate(size, rect)) {
+          break;
+        }
+      }
+    }
+  }
+
+private:
+  int get_level(uint32_t size) const {
+    int level = 0;
+    for (uint32_t level_size = atlas_resolution / 2;
+         level_size >= std::max(size, min_tile_size) &&
+         level + 1 < static_cast<int>(free_nodes.size());
+         level_size /= 2) {
+      level++;
+    }
+    return level;
+  }
+};
+} // namespace rend
@@ -15,6 +15,14 @@ struct Binding {
 
 using BindingMatrix = std::vector<std::vector<Binding>>;
 
+// Set allocated and written outside of the materials, like the texture heap.
+// Every material using it binds the same set in every frame
+struct SharedDescriptorSet {
+  int set_idx; // Its bindings in the matrix are left empty
+  VkDescriptorSetLayout layout;
+  VkDescriptorSet descriptor_set;
+};
+
 struct DescriptorSetAssembler {
   VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
   std::vector<Binding> bindings;
@@ -62,32 +70,126 @@ struct DescriptorSetAllocator {
   VkDevice device;
 
   std::vector<VkDescriptorSetLayout> layouts;
+  // Sets of the current frame, the ones bound when recording
   std::vector<VkDescriptorSet> descriptor_sets;
+  // A copy of the sets for every frame in flight, so that a frame can write
+  // its descriptors while the GPU still reads the sets of the earlier ones
+  std::vector<std::vector<VkDescriptorSet>> frame_descriptor_sets;
+  // One per dynamic buffer binding, ordered by set and binding as
+  // vkCmdBindDescriptorSets expects them when all sets are bound
+  std::vector<uint32_t> dynamic_offsets;
+  std::vector<std::vector<int>> dynamic_offset_indices; // -1 if not dynamic
 
   void init(std::vector<std::vector<Binding>> &bindings, VkDevice device,
-            VkDescriptorPool descriptor_pool) {
+            VkDescriptorPool descriptor_pool, uint32_t frame_count = 1,
+            const std::vector<SharedDescriptorSet> &shared_sets = {}) {
     this->device = device;
     this->bindings = bindings;
     assemblers.resize(bindings.size());
     layouts.resize(bindings.size(), VK_NULL_HANDLE);
-    descriptor_sets.resize(bindings.size(), VK_NULL_HANDLE);
+    dynamic_offsets.clear();
+    dynamic_offset_indices.resize(bindings.size());
+    writes.resize(bindings.size());
+    owned_set_indices.clear();
+    std::vector<VkDescriptorSet> shared_descriptor_sets(bindings.size(),
+                                                        VK_NULL_HANDLE);
+    for (const SharedDescriptorSet &shared : shared_sets) {
+      if (shared.set_idx >= bindings.size() ||
+          !bindings[shared.set_idx].empty()) {
+        throw std::runtime_error("Invalid shared set");
+      }
+      layouts[shared.set_idx] = shared.layout;
+      shared_descriptor_sets[shared.set_idx] = shared.descriptor_set;
+    }
+    std::vector<VkDescriptorSetLayout> owned_layouts;
     for (int set_idx = 0; set_idx < bindings.size(); set_idx++) {
+      if (shared_descriptor_sets[set_idx] != VK_NULL_HANDLE) {
+        continue;
+      }
       assemblers[set_idx].assemble_layout(bindings[set_idx], device);
       layouts[set_idx] = assemblers[set_idx].descriptor_set_layout;
+      owned_set_indices.push_back(set_idx);
+      owned_layouts.push_back(layouts[set_idx]);
+      dynamic_offset_indices[set_idx].assign(bindings[set_idx].size(), -1);
+      writes[set_idx].resize(bindings[set_idx].size());
+      for (int b_idx = 0; b_idx < bindings[set_idx].size(); b_idx++) {
+        if (is_dynamic(bindings[set_idx][b_idx].type)) {
+          dynamic_offset_indices[set_idx][b_idx] = dynamic_offsets.size();
+          dynamic_offsets.push_back(0);
+        }
+      }
     }
     VkDescriptorSetAllocateInfo alloc_info = {};
     alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     alloc_info.pNext = nullptr;
     alloc_info.descriptorPool = descriptor_pool;
-    alloc_info.descriptorSetCount = layouts.size();
-    alloc_info.pSetLayouts = layouts.data();
-    if (vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.data()) !=
-        VK_SUCCESS) {
-      throw std::runtime_error("Failed to allocate descriptor sets");
+    alloc_info.descriptorSetCount = owned_layouts.size();
+    alloc_info.pSetLayouts = owned_layouts.data();
+    std::vector<VkDescriptorSet> owned_sets(owned_layouts.size());
+    frame_descriptor_sets.resize(frame_count);
+    frame_versions.resize(frame_count);
+    frame_update_counts.assign(frame_count, 0);
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+      frame_descriptor_sets[frame] = shared_descriptor_sets;
+      if (!owned_sets.empty() &&
+          vkAllocateDescriptorSets(device, &alloc_info, owned_sets.data()) !=
+              VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor sets");
+      }
+      for (int i = 0; i < owned_sets.size(); i++) {
+        frame_descriptor_sets[frame][owned_set_indices[i]] = owned_sets[i];
+      }
+      frame_versions[frame].resize(bindings.size());
+      for (int set_idx = 0; set_idx < bindings.size(); set_idx++) {
+        frame_versions[frame][set_idx].assign(bindings[set_idx].size(), 0);
+      }
     }
+    descriptor_sets = frame_descriptor_sets[0];
+    current_frame = -1;
   }
 
-  void bind_buffer(int set_idx, int binding_idx, BufferAllocation &allocation) {
+  /**
+   * @brief Makes the sets of the frame current and brings them up to date
+   * with the writes made since the frame was last current. Call once the
+   * GPU is done with the previous use of the frame
+   *
+   */
+  void begin_frame(uint32_t frame_idx) {
+    current_frame = frame_idx;
+    descriptor_sets = frame_descriptor_sets[frame_idx];
+    // Writes flushed to the other frames are outdated here even when
+    // nothing is dirty
+    update_frame(frame_idx);
+  }
+
+  /**
+   * @brief Applies the writes made since the last flush to the sets of the
+   * current frame in a single vkUpdateDescriptorSets. Bindings only take
+   * effect once flushed, call before binding the sets. Does nothing outside
+   * of a frame
+   *
+   */
+  void flush() {
+    int frame_idx = get_write_frame();
+    if (frame_idx >= 0 && dirty) {
+      update_frame(frame_idx);
+    }
+  }
+
+  // Changes whenever the sets of the frame are written. Command buffers
+  // that bound them before have to be recorded again
+  uint64_t get_update_count(uint32_t frame_idx) const {
+    return frame_update_counts[frame_idx];
+  }
+
+  // Writes made until the next begin_frame are deferred, the sets of every
+  // frame may be in use
+  void end_frame() { current_frame = -1; }
+
+  // Range is used for bindings without a size, dynamic storage bindings
+  // can't use the whole buffer
+  void bind_buffer(int set_idx, int binding_idx, BufferAllocation &allocation,
+                   VkDeviceSize range = VK_WHOLE_SIZE) {
     if (set_idx >= assemblers.size() ||
         binding_idx >= assemblers[set_idx].bindings.size()) {
       throw std::runtime_error("Binding index out of range");
@@ -101,23 +203,33 @@ struct DescriptorSetAllocator {
       VkDescriptorBufferInfo buffer_info = {};
       buffer_info.buffer = allocation.buffer;
       buffer_info.offset = d * descriptor_size;
-      buffer_info.range = descriptor_size;
+      // Size 0 binds the whole buffer, for storage buffers that grow
+      buffer_info.range = descriptor_size > 0 ? descriptor_size : range;
       buffer_infos.push_back(buffer_info);
     }
 
-    if (assemblers[set_idx].bindings[binding_idx].type !=
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER &&
-        assemblers[set_idx].bindings[binding_idx].type !=
-            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+    VkDescriptorType type = assemblers[set_idx].bindings[binding_idx].type;
+    if (type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER &&
+        type != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER && !is_dynamic(type)) {
       throw std::runtime_error("Binding type mismatch");
     }
 
-    VkWriteDescriptorSet write = vk_struct_init::get_descriptor_write_info(
-        binding_idx, descriptor_sets[set_idx],
-        assemblers[set_idx].bindings[binding_idx].type, descriptor_count,
-        buffer_infos.data(), nullptr);
+    commit_write(set_idx, binding_idx, std::move(buffer_infos), {});
+  }
+
+  // Offset applied to a dynamic buffer binding on the next bind
+  void set_dynamic_offset(int set_idx, int binding_idx, uint32_t offset) {
+    if (set_idx >= dynamic_offset_indices.size() ||
+        binding_idx >= dynamic_offset_indices[set_idx].size() ||
+        dynamic_offset_indices[set_idx][binding_idx] < 0) {
+      throw std::runtime_error("Binding is not dynamic");
+    }
+    dynamic_offsets[dynamic_offset_indices[set_idx][binding_idx]] = offset;
+  }
 
-    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+  static bool is_dynamic(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
   }
 
   void bind_image(int set_idx, int binding_idx, ImageAllocation &allocation,
@@ -139,12 +251,7 @@ struct DescriptorSetAllocator {
     image_info.imageView = allocation.view;
     image_info.sampler = sampler;
 
-    VkWriteDescriptorSet write = vk_struct_init::get_descriptor_write_info(
-        binding_idx, descriptor_sets[set_idx],
-        assemblers[set_idx].bindings[binding_idx].type, 1, nullptr,
-        &image_info);
-
-    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    commit_write(set_idx, binding_idx, {}, {image_info});
   }
 
   void bind_image_infos(int set_idx, int binding_idx,
@@ -161,19 +268,145 @@ struct DescriptorSetAllocator {
       throw std::runtime_error("Binding type mismatch");
     }
 
-    VkWriteDescriptorSet write = vk_struct_init::get_descriptor_write_info(
-        binding_idx, descriptor_sets[set_idx],
-        assemblers[set_idx].bindings[binding_idx].type, image_infos.size(),
-        nullptr, image_infos.data());
-
-    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    commit_write(set_idx, binding_idx, {}, std::move(image_infos));
   }
 
   void destroy(VkDescriptorPool descriptor_pool) {
-    vkFreeDescriptorSets(device, descriptor_pool, descriptor_sets.size(),
-                         descriptor_sets.data());
-    for (auto &assembler : assemblers) {
-      assembler.destroy();
+    // Shared sets belong to their owner
+    std::vector<VkDescriptorSet> owned_sets;
+    for (std::vector<VkDescriptorSet> &sets : frame_descriptor_sets) {
+      owned_sets.clear();
+      for (int set_idx : owned_set_indices) {
+        owned_sets.push_back(sets[set_idx]);
+      }
+      if (!owned_sets.empty()) {
+        vkFreeDescriptorSets(device, descriptor_pool, owned_sets.size(),
+                             owned_sets.data());
+      }
+    }
+    for (int set_idx : owned_set_indices) {
+      assemblers[set_idx].destroy();
+    }
+  }
+
+private:
+  // Last resources bound to a binding
+  struct DescriptorWrite {
+    std::vector<VkDescriptorBufferInfo> buffer_infos;
+    std::vector<VkDescriptorImageInfo> image_infos;
+    uint64_t hash = 0;    // Of the infos, rejects most changes early
+    uint64_t version = 0; // 0 if never written
+  };
+  std::vector<std::vector<DescriptorWrite>> writes; // Per set and binding
+  std::vector<int> owned_set_indices; // Sets that aren't shared
+  // Version of every write the sets of a frame were last updated with
+  std::vector<std::vector<std::vector<uint64_t>>> frame_versions;
+  std::vector<uint64_t> frame_update_counts;
+  int current_frame = -1; // -1 outside of a frame
+  bool dirty = false; // Written since the last flush
+  std::vector<VkWriteDescriptorSet> batched_writes;
+
+  // Without frames in flight the only sets are always current
+  int get_write_frame() const {
+    return frame_descriptor_sets.size() == 1 ? 0 : current_frame;
+  }
+
+  static uint64_t hash_combine(uint64_t hash, uint64_t value) {
+    // FNV-1a over the 64 bit values
+    return (hash ^ value) * 1099511628211ull;
+  }
+
+  static uint64_t
+  hash_infos(const std::vector<VkDescriptorBufferInfo> &buffer_infos,
+             const std::vector<VkDescriptorImageInfo> &image_infos) {
+    // Field by field, the structs have padding
+    uint64_t hash = 14695981039346656037ull;
+    for (const VkDescriptorBufferInfo &info : buffer_infos) {
+      hash = hash_combine(hash, reinterpret_cast<uint64_t>(info.buffer));
+      hash = hash_combine(hash, info.offset);
+      hash = hash_combine(hash, info.range);
+    }
+    for (const VkDescriptorImageInfo &info : image_infos) {
+      hash = hash_combine(hash, reinterpret_cast<uint64_t>(info.sampler));
+      hash = hash_combine(hash, reinterpret_cast<uint64_t>(info.imageView));
+      hash = hash_combine(hash, info.imageLayout);
+    }
+    return hash;
+  }
+
+  static bool
+  same_infos(const DescriptorWrite &write,
+             const std::vector<VkDescriptorBufferInfo> &buffer_infos,
+             const std::vector<VkDescriptorImageInfo> &image_infos) {
+    if (write.buffer_infos.size() != buffer_infos.size() ||
+        write.image_infos.size() != image_infos.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < buffer_infos.size(); i++) {
+      const VkDescriptorBufferInfo &a = write.buffer_infos[i];
+      const VkDescriptorBufferInfo &b = buffer_infos[i];
+      if (a.buffer != b.buffer || a.offset != b.offset || a.range != b.range) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < image_infos.size(); i++) {
+      const VkDescriptorImageInfo &a = write.image_infos[i];
+      const VkDescriptorImageInfo &b = image_infos[i];
+      if (a.sampler != b.sampler || a.imageView != b.imageView ||
+          a.imageLayout != b.imageLayout) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void update_frame(uint32_t frame_idx) {
+    dirty = false;
+    batched_writes.clear();
+    for (int set_idx = 0; set_idx < writes.size(); set_idx++) {
+      for (int b_idx = 0; b_idx < writes[set_idx].size(); b_idx++) {
+        if (frame_versions[frame_idx][set_idx][b_idx] !=
+            writes[set_idx][b_idx].version) {
+          batched_writes.push_back(get_write(frame_idx, set_idx, b_idx));
+        }
+      }
+    }
+    if (!batched_writes.empty()) {
+      vkUpdateDescriptorSets(device, batched_writes.size(),
+                             batched_writes.data(), 0, nullptr);
+      frame_update_counts[frame_idx]++;
+    }
+  }
+
+  VkWriteDescriptorSet get_write(uint32_t frame_idx, int set_idx,
+                                 int binding_idx) {
+    DescriptorWrite &write = writes[set_idx][binding_idx];
+    frame_versions[frame_idx][set_idx][binding_idx] = write.version;
+    bool buffer = !write.buffer_infos.empty();
+    return vk_struct_init::get_descriptor_write_info(
+        binding_idx, frame_descriptor_sets[frame_idx][set_idx],
+        assemblers[set_idx].bindings[binding_idx].type,
+        buffer ? write.buffer_infos.size() : write.image_infos.size(),
+        buffer ? write.buffer_infos.data() : nullptr,
+        buffer ? nullptr : write.image_infos.data());
+  }
+
+  // Applied to the current frame on the next flush, to the other frames
+  // when they begin. Binding what is already bound is skipped, so the sets
+  // aren't written and command buffers that bound them stay valid
+  void commit_write(int set_idx, int binding_idx,
+                    std::vector<VkDescriptorBufferInfo> buffer_infos,
+                    std::vector<VkDescriptorImageInfo> image_infos) {
+    DescriptorWrite &write = writes[set_idx][binding_idx];
+    uint64_t hash = hash_infos(buffer_infos, image_infos);
+    if (write.version > 0 && write.hash == hash &&
+        same_infos(write, buffer_infos, image_infos)) {
+      return;
     }
+    write.buffer_infos = std::move(buffer_infos);
+    write.image_infos = std::move(image_infos);
+    write.hash = hash;
+    write.version++;
+    dirty = true;
   }
 };
\ No newline at end of file
@@ -1,15 +1,12 @@
 #pragma once
 
 #include <memory>
-#include <rend/LightSource.h>
 #include <rend/Rendering/Vulkan/DescriptorSet.h>
 #include <rend/Rendering/Vulkan/RenderPipelineBuilder.h>
 #include <rend/Rendering/Vulkan/Shader.h>
 #include <rend/Rendering/Vulkan/Texture.h>
 #include <unordered_map>
 
-constexpr int MAX_LIGHTS = 64;
-
 struct PushConstants {
   float model[16];
   int texture_idx;
@@ -17,26 +14,56 @@ struct PushConstants {
   int bitmask;
 };
 
+// Per instance data of the instanced passes, std430 layout
+struct InstanceData {
+  float model[16];
+  int texture_idx;
+  int bitmask;
+  int light_index; // Shadow passes only
+  int padding;
+};
+
+// Enabled light as seen by the shaders, std430 layout
+struct LightSource {
+  float position[3];
+  float fov;
+  float color[3];
+  float intensity;
+  float direction[3];
+  float type;
+  float view_matrix[16];
+  float projection_matrix[16];
+  float shadow_rect[4]; // Atlas tile x, y and size in uv, size 0 if none
+  float range;
+  float padding[3];
+};
+
+// Start of the light storage buffer, the packed lights follow it
+struct LightBufferHeader {
+  uint32_t light_count;
+  uint32_t padding[3];
+};
+
 struct CameraInfo {
   float view[16];
   float projection[16];
   float position[4];
+  float inverse_view_projection[16]; // Positions from the depth buffer
+  float previous_view_projection[16]; // Temporal reprojection
+  uint32_t frame_index;
+  uint32_t padding[3];
 };
 
-constexpr int MAX_TEXTURE_COUNT = 20;
 static BindingMatrix DEFAULT_BINDINGS = {
-    {Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
-             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
-             0,                                         //
-             MAX_TEXTURE_COUNT}},                       // Textures
+    {}, // Texture heap, shared
     {Binding{VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, //
              VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
              sizeof(CameraInfo),                                        //
              1},
      Binding{VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT, //
-             VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
-             sizeof(LightSource),                                       //
-             MAX_LIGHTS},                  // Camera info (view, projection)
+             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,                         //
+             0,                                                         //
+             1},                                                        // Lights
      Binding{VK_SHADER_STAGE_FRAGMENT_BIT, //
              VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
              0,                                         //
@@ -51,6 +78,8 @@ struct MaterialSpec {
   Path vert_shader;
   Path frag_shader;
   BindingMatrix bindings;
+  // Sets bound from outside the material, the texture heap
+  std::vector<SharedDescriptorSet> shared_sets;
   VkPrimitiveTopology topology_type = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   int vertex_stride = -1;
   std::vector<VkFormat> input_attributes = DEFAULT_INPUT_LAYOUT;
@@ -58,6 +87,11 @@ struct MaterialSpec {
   int color_attachment_count;
   bool depth_test_enabled;
   bool blend_test_enabled;
+  // More than one needs the multiViewport feature
+  int viewport_count = 1;
+  // Values of the specialization constants with constant_id 0, 1, ... in both
+  // shader stages
+  std::vector<int32_t> specialization_constants;
 
   VkPushConstantRange push_constants_description{
       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, //
@@ -89,10 +123,12 @@ public:
 
   Material(MaterialSpec spec);
 
-  // Initialization
+  // Initialization. The descriptor sets are allocated once per frame in
+  // flight, the pipeline is looked up in and added to the pipeline cache
   void build(VkDevice &device, VkDescriptorPool &descriptor_pool,
              VkRenderPass &render_pass, const VkExtent2D &window_dims,
-             Deallocator &deallocation_queue);
+             Deallocator &deallocation_queue, uint32_t frame_count = 1,
+             VkPipelineCache pipeline_cache = VK_NULL_HANDLE);
 
   // Descriptor binding
   void bind_descriptor_buffer(int set_idx, int binding_idx,
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <rend/Rendering/PipelineCacheFile.h>
+#include <rend/Rendering/Vulkan/vk_check.h>
+#include <rend/Rendering/Vulkan/vk_helper_types.h>
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief VkPipelineCache persisted between launches. Starts from the file
+ * written by the last run on the same device and driver so pipelines aren't
+ * compiled from SPIR-V again, and writes the cache back on save
+ *
+ */
+class PipelineCache {
+public:
+  VkPipelineCache cache = VK_NULL_HANDLE;
+
+  // An empty path neither loads nor saves
+  void init(VkDevice device, VkPhysicalDevice physical_device,
+            const Path &path) {
+    this->device = device;
+    this->path = path;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    device_info.vendor_id = properties.vendorID;
+    device_info.device_id = properties.deviceID;
+    device_info.driver_version = properties.driverVersion;
+    memcpy(device_info.cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    std::vector<uint8_t> initial_data;
+    loaded = !path.empty() &&
+             rend::read_pipeline_cache_file(path, device_info, initial_data);
+
+    VkPipelineCacheCreateInfo cache_info = {};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.pNext = nullptr;
+    cache_info.flags = 0;
+    cache_info.initialDataSize = initial_data.size();
+    cache_info.pInitialData = initial_data.data();
+    if (vkCreatePipelineCache(device, &cache_info, nullptr, &cache) !=
+        VK_SUCCESS) {
+      // Start empty if the driver refuses the data anyway
+      loaded = false;
+      cache_info.initialDataSize = 0;
+      cache_info.pInitialData = nullptr;
+      VK_CHECK(vkCreatePipelineCache(device, &cache_info, nullptr, &cache),
+               "Failed to create pipeline cache");
+    }
+  }
+
+  // Whether the cache started from a file written by an earlier run
+  bool was_loaded() const { return loaded; }
+
+  // Includes the pipelines created since init
+  void save() {
+    if (path.empty() || cache == VK_NULL_HANDLE) {
+      return;
+    }
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &size, nullptr),
+             "Failed to get pipeline cache data");
+    std::vector<uint8_t> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &size, data.data()),
+             "Failed to get pipeline cache data");
+    data.resize(size);
+    if (!rend::write_pipeline_cache_file(path, device_info, data)) {
+      std::cerr << "Failed to save the pipeline cache to " << path
+                << std::endl;
+    }
+  }
+
+  void destroy() {
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+  }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  Path path;
+  rend::PipelineCacheDevice device_info{};
+  bool loaded = false;
+};
@@ -75,6 +75,10 @@ struct RenderPassSpec {
   VkExtent2D extent;
   SubpassDependency prev_stage_dependency;
   SubpassDependency next_stage_dependency;
+  // Keeps the depth written by the previous passes instead of clearing it.
+  // The depth attachment has to be in its attachment layout when the pass
+  // begins
+  bool load_depth = false;
 };
 
 struct RenderPass {
@@ -131,14 +135,16 @@ struct RenderPass {
           Attachment::create(depth_attachment_spec, device, allocator);
       attachment_descriptions[color_attachment_specs.size()] =
           vk_struct_init::get_attachment_description(
-              depth_attachment_spec.format,     //
-              VK_SAMPLE_COUNT_1_BIT,            //
-              VK_ATTACHMENT_LOAD_OP_CLEAR,      //
+              depth_attachment_spec.format, //
+              VK_SAMPLE_COUNT_1_BIT,        //
+              pass_spec.load_depth ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                   : VK_ATTACHMENT_LOAD_OP_CLEAR,
               VK_ATTACHMENT_STORE_OP_STORE,     //
               VK_ATTACHMENT_LOAD_OP_LOAD,       //
               VK_ATTACHMENT_STORE_OP_DONT_CARE, //
-              VK_IMAGE_LAYOUT_UNDEFINED,        //
-              depth_attachment_spec.layout      //
+              pass_spec.load_depth ? depth_attachment_spec.layout
+                                   : VK_IMAGE_LAYOUT_UNDEFINED,
+              depth_attachment_spec.layout //
           );
       attachment_views[color_attachment_specs.size()] =
           pass.depth_attachment.image_allocation.view;
@@ -41,7 +41,10 @@ public:
                       VertexInfoDescription vertex_info_description,
                       VkPrimitiveTopology topology, VkPipeline &new_pipeline,
                       int color_attachment_count, bool depth_test_enabled,
-                      bool blend_test_enabled) {
+                      bool blend_test_enabled, int viewport_count = 1,
+                      const std::vector<int32_t> &specialization_constants =
+                          {},
+                      VkPipelineCache pipeline_cache = VK_NULL_HANDLE) {
     _vertex_info_description = vertex_info_description;
     _depth_stencil_create_info = vk_struct_init::get_depth_stencil_create_info(
         depth_test_enabled, depth_test_enabled, VK_COMPARE_OP_LESS_OR_EQUAL);
@@ -66,12 +69,29 @@ public:
     _viewport_state.sType =
         VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     _viewport_state.pViewports = nullptr;
-    _viewport_state.viewportCount = 1;
-    _viewport_state.scissorCount = 1;
+    _viewport_state.viewportCount = viewport_count;
+    _viewport_state.scissorCount = viewport_count;
+
+    std::vector<VkSpecializationMapEntry> specialization_entries(
+        specialization_constants.size());
+    for (uint32_t i = 0; i < specialization_entries.size(); i++) {
+      specialization_entries[i] = {
+          i, static_cast<uint32_t>(i * sizeof(int32_t)), sizeof(int32_t)};
+    }
+    VkSpecializationInfo specialization_info{};
+    specialization_info.mapEntryCount = specialization_entries.size();
+    specialization_info.pMapEntries = specialization_entries.data();
+    specialization_info.dataSize =
+        specialization_constants.size() * sizeof(int32_t);
+    specialization_info.pData = specialization_constants.data();
+    const VkSpecializationInfo *specialization =
+        specialization_constants.empty() ? nullptr : &specialization_info;
 
     _shader_stages.clear();
-    _shader_stages.push_back(shader.get_vertex_shader_stage_info());
-    _shader_stages.push_back(shader.get_fragment_shader_stage_info());
+    _shader_stages.push_back(
+        shader.get_vertex_shader_stage_info(specialization));
+    _shader_stages.push_back(
+        shader.get_fragment_shader_stage_info(specialization));
 
     VkGraphicsPipelineCreateInfo pipelineInfo = {};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -91,7 +111,7 @@ public:
     pipelineInfo.pViewportState = &_viewport_state;
     pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
+    if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo,
                                   nullptr, &new_pipeline) != VK_SUCCESS) {
       std::cerr << "failed to create pipeline" << std::endl;
       new_pipeline = VK_NULL_HANDLE;
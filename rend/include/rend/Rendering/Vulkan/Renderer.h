@@ -13,9 +13,21 @@
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
 
+#include <rend/Light.h>
+#include <rend/Physics/AABB.h>
+#include <rend/Rendering/Culling.h>
+#include <rend/Rendering/DebugDraw.h>
+#include <rend/Rendering/LightClusters.h>
+#include <rend/Rendering/ScreenTileMask.h>
+#include <rend/Rendering/ShadowAtlas.h>
 #include <rend/Rendering/Vulkan/Mesh.h>
+#include <rend/Rendering/Vulkan/PipelineCache.h>
 #include <rend/Rendering/Vulkan/RenderPass.h>
 #include <rend/Rendering/Vulkan/Renderable.h>
+#include <rend/Rendering/Vulkan/SamplerCache.h>
+#include <rend/Rendering/Vulkan/SecondaryCommandPools.h>
+#include <rend/Rendering/Vulkan/TextureHeap.h>
+#include <rend/Rendering/Vulkan/UploadRing.h>
 #include <rend/Rendering/Vulkan/vk_helper_types.h>
 #include <rend/Rendering/Vulkan/vk_struct_init.h>
 #include <rend/Transform.h>
@@ -23,13 +35,37 @@
 
 #include <rend/EntityRegistry.h>
 
+// Can be changed at configure time with -DREND_SHADOW_ATLAS_BUDGET_MB=N
+#ifndef REND_SHADOW_ATLAS_BUDGET_MB
+#define REND_SHADOW_ATLAS_BUDGET_MB 128
+#endif
+
 namespace rend {
 class Renderer {
-  static constexpr int MAX_DEBUG_VERTICES = 100000;
-  static constexpr int SHADOW_ATLAS_LIGHTS_PER_ROW = 8;
-  static constexpr int SHADOW_MAP_RESOLUTION = 1024;
-  static constexpr int SHADOW_ATLAS_RESOLUTION =
-      SHADOW_ATLAS_LIGHTS_PER_ROW * SHADOW_MAP_RESOLUTION;
+  static constexpr uint32_t MAX_DEBUG_INSTANCES = 16384; // Per frame
+  // Fewer draw batches per secondary command buffer cost more to execute
+  // than they save in recording
+  static constexpr uint32_t G_BUFFER_MIN_RECORD_BATCH = 64;
+  // Grows when a frame needs more. The ring has a region per frame in flight
+  static constexpr size_t INITIAL_UPLOAD_FRAME_SIZE = 4 * 1024 * 1024;
+  // D32 atlas, largest power of two that fits the budget. The budget is
+  // shared with the static caster atlas of the same size
+  static constexpr int SHADOW_ATLAS_RESOLUTION = get_shadow_atlas_resolution(
+      size_t{REND_SHADOW_ATLAS_BUDGET_MB} * 1024 * 1024 / 2, sizeof(float));
+  static constexpr int MAX_SHADOW_MAP_RESOLUTION = 1024;
+  static constexpr int MIN_SHADOW_MAP_RESOLUTION = 128;
+  // Lights whose bounding sphere covers this fraction of the screen height get
+  // the full resolution, the tile is halved every time the coverage halves
+  static constexpr float SHADOW_FULL_RESOLUTION_SCREEN_SIZE = 0.5f;
+  // Lights drawn together by the layered shadow pass. 16 is the minimum
+  // maxViewports of devices with multiViewport
+  static constexpr int MAX_SHADOW_VIEWPORTS = 16;
+  // Casters that haven't moved for this many frames are drawn into the
+  // static atlas
+  static constexpr int SHADOW_STATIC_FRAMES = 60;
+  // Tiles re-rendered per frame because of moved casters, full resolution
+  // tiles and tiles whose light changed don't count towards it
+  static constexpr int SHADOW_UPDATES_PER_FRAME = 4;
 
   VkExtent2D _window_dims{1280, 1024};
   SDL_Window *_window;
@@ -40,6 +76,10 @@ class Renderer {
   VkQueue _graphics_queue;
   uint32_t _queue_family;
   VkDeviceSize min_ubo_alignment;
+  VkDeviceSize min_ssbo_alignment;
+  // Shadow casters of several lights are drawn in one call, the vertex shader
+  // picks the atlas tile with gl_ViewportIndex
+  bool _layered_shadows = false;
 
   VkAllocationCallbacks *_allocation_callbacks;
 
@@ -52,7 +92,7 @@ class Renderer {
   VkSwapchainKHR _swapchain;
   uint32_t _swapchain_img_idx; // Current swapchain image index
 
-  // CMD buffer
+  // One time submits
   VkCommandPool _command_pool;
   VkCommandBuffer _command_buffer;
 
@@ -60,24 +100,170 @@ class Renderer {
 
   VkDescriptorPool _descriptor_pool;
 
-  // Sync primitives
-  VkSemaphore _swapchain_semaphore; // Signaled when the next swapchain image
-                                    // index is aquired
-  VkSemaphore _render_complete_semaphore; // Signaled when rendering is done
-  VkFence _command_complete_fence; // Fence for waiting on the command queue
+  // Resources of a frame in flight, reused once its fence is signaled
+  struct FrameData {
+    VkCommandPool command_pool;
+    VkCommandBuffer command_buffer;
+    VkSemaphore swapchain_semaphore; // Signaled when the next swapchain image
+                                     // index is aquired
+    VkFence command_complete_fence; // Signaled when the GPU is done
+  };
+  std::vector<FrameData> _frames;
+  // Per swapchain image, signaled when rendering to it is done. Presentation
+  // has no fence, so the semaphore waited on is only reused with the image
+  std::vector<VkSemaphore> _render_complete_semaphores;
+  // Fence of the frame that last rendered to each swapchain image
+  std::vector<VkFence> _image_fences;
+  // Materials whose descriptor sets are switched every frame
+  std::vector<Material *> _frame_materials;
+  // Shadow and G-buffer draws are recorded into secondary command buffers
+  // from the job system
+  SecondaryCommandPools _secondary_pools;
+
+  // Every resident texture, bound as set 0 of the G-buffer, screenspace and
+  // shading materials. Draws index it with the handle of their texture
+  TextureHeap _texture_heap;
+  SamplerCache _sampler_cache;
+
+  PipelineCache _pipeline_cache;
+
+  // Fullscreen draw recorded once per frame in flight and executed again
+  // every frame. Recorded again only when the descriptor sets of the frame
+  // were written or the dynamic offsets moved
+  struct PrerecordedPass {
+    std::vector<VkCommandBuffer> command_buffers; // Per frame in flight
+    std::vector<std::vector<uint32_t>> dynamic_offsets;
+    std::vector<uint64_t> update_counts; // Of the descriptor sets
+  };
+  VkCommandPool _prerecorded_command_pool;
+  PrerecordedPass _prerecorded_shading;
+  PrerecordedPass _prerecorded_screenspace;
+  PrerecordedPass _prerecorded_composite;
 
   // VMA allocator
   VmaAllocator _allocator;
   Deallocator _deallocation_queue;
 
-  BufferAllocation _camera_buffer;
-  BufferAllocation _light_buffer;
+  // Camera, lights, instances, light clusters and debug instances of the
+  // frame. Descriptors are written once, the offsets change every frame
+  UploadRing _upload_ring;
+  uint32_t _camera_offset = 0;
+  uint32_t _light_offset = 0;
+  uint32_t _instance_offset = 0;
+  uint32_t _light_cluster_offset = 0;
+  uint32_t _debug_instance_offset = 0;
+  struct RingBinding {
+    DescriptorSetAllocator *ds_allocator;
+    int set;
+    int binding;
+    uint32_t *offset;
+  };
+  std::vector<RingBinding> _ring_bindings;
+
+  // Enabled Light components of the current frame in the light buffer order,
+  // light indices everywhere in the renderer index these
+  std::vector<Light *> _lights;
+  std::vector<LightSource> _light_sources;
+
+  // Renderables of the current frame, the passes only draw the visible ones
+  struct DrawItem {
+    Mesh *mesh;
+    int texture_idx; // Handle in the texture heap
+    int bitmask;
+    Eigen::Matrix4f model;
+    rend::ECS::EID eid;
+    bool dynamic; // Moved within the last SHADOW_STATIC_FRAMES
+  };
+  std::vector<DrawItem> _draw_items;
+  CullingBounds _draw_bounds;
+  std::vector<uint32_t> _camera_visible;            // Indices into _draw_items
+  std::vector<std::vector<uint32_t>> _light_visible; // Per light
+  // Keyed by the mesh itself, a new mesh can reuse the address of a released
+  // one
+  std::unordered_map<Mesh::Ptr, AABB> _mesh_bounds;
+  // Per entity, Transform version seen by the renderer and the frame it
+  // last changed in
+  std::vector<uint64_t> _transform_versions;
+  std::vector<int> _last_moved_frames;
+
+  // Visible instances of one mesh, drawn with a single instanced call
+  struct DrawBatch {
+    Mesh *mesh;
+    uint32_t first_instance; // Index into _instances
+    uint32_t instance_count;
+  };
+  // Lights [first_light, first_light + light_count) drawn together, one
+  // light per group without layered shadows
+  struct ShadowGroup {
+    int first_light;
+    int light_count;
+    std::vector<DrawBatch> batches;
+  };
+  // Visible item and the light it is drawn for
+  struct DrawRef {
+    uint32_t item_idx;
+    int light_index;
+  };
+  std::vector<InstanceData> _instances; // Of all the views
+  std::vector<DrawRef> _draw_refs;
+  std::vector<DrawBatch> _camera_batches;
+  std::vector<ShadowGroup> _static_shadow_groups;  // Static casters
+  std::vector<ShadowGroup> _dynamic_shadow_groups; // Dynamic casters
+
+  DebugDrawRecorder _debug_draw; // Merged into the instance ring each frame
+
+  ShadowAtlasAllocator _shadow_atlas{SHADOW_ATLAS_RESOLUTION,
+                                     MIN_SHADOW_MAP_RESOLUTION};
+  std::vector<ShadowAtlasAllocator::Request> _shadow_requests;
+  // Requested light index and size of the last packing, the atlas is only
+  // repacked when they change so that cached tiles keep their place
+  std::vector<std::pair<int, uint32_t>> _packed_shadow_requests;
+  std::vector<ShadowAtlasRect> _shadow_rects; // Per light, in texels
+
+  // What the tile of a light was last rendered with. Signatures are order
+  // independent hashes of the casters inside the light frustum
+  struct ShadowCacheEntry {
+    ShadowAtlasRect rect;
+    Eigen::Matrix4f view_projection;
+    uint64_t static_signature = 0;
+    uint64_t dynamic_signature = 0;
+    bool valid = false;
+  };
+  std::vector<ShadowCacheEntry> _shadow_cache; // Per light
+  // Lights whose static layer is redrawn this frame, a subset of the lights
+  // whose tile is updated
+  std::vector<bool> _static_shadow_updates;
+  std::vector<bool> _shadow_updates;
+  int _shadow_update_cursor = 0; // Round robin over the budgeted lights
+  bool _shadow_atlases_initialized = false;
+
+  // Lights reaching each froxel, the shading pass only iterates those
+  LightClusters _light_clusters;
+
+  // Levels of the min depth pyramid, level 0 has the reflection resolution
+  static constexpr int HIZ_LEVELS = 6;
+  // Reflections are traced at half resolution and only on the tiles of this
+  // many trace pixels covered by visible reflective renderables
+  static constexpr uint32_t REFLECTION_TILE_SIZE = 16;
+  ScreenTileMask _reflection_tiles;
+  std::vector<ScreenTileMask::Span> _reflection_spans;
+  Eigen::Matrix4f _previous_view_projection = Eigen::Matrix4f::Identity();
+  bool _reflection_history_valid = false;
 
 public:
   RenderPass deferred_pass;
   RenderPass shadow_pass;
+  // Static casters only, tiles are copied into the shadow pass atlas before
+  // the dynamic casters are drawn over them
+  RenderPass static_shadow_pass;
   RenderPass shading_pass;
   RenderPass screenspace_effects_pass;
+  // Level i is the min of 2x2 texels of level i - 1, level 0 of the depth
+  std::vector<RenderPass> hiz_passes;
+  RenderPass reflection_trace_pass;
+  // Accumulated reflections, every frame writes one and reads the other
+  RenderPass reflection_history_passes[2];
+  // Edge aware upsample of the accumulated reflections
   RenderPass screenspace_smoothing_pass;
 
   struct {
@@ -95,21 +281,42 @@ public:
 
     Material material;
 
-    BufferAllocation buffer_allocation;
-    // Position/Color
-    float debug_buffer[MAX_DEBUG_VERTICES * sizeof(float) * 6];
-    int debug_verts_to_draw = 0;
+    // Unit primitives, drawn instanced
+    BufferAllocation debug_vertex_buffer;
+    DebugVertexRange debug_vertex_ranges[DEBUG_PRIMITIVE_COUNT]{};
+    // In the upload ring
+    DebugInstanceRange debug_instance_ranges[DEBUG_PRIMITIVE_COUNT]{};
     Material debug_material;
 
   } composite_pass;
 
   std::unique_ptr<Camera> camera;
-  std::vector<LightSource> lights;
-
-  std::unordered_map<Texture *, int> texture_to_index;
 
   bool debug_mode = false;
   bool show_gui = false;
+  // Set before init. Frames recorded while the GPU still executes earlier
+  // ones, each has its own command buffer, sync primitives, upload ring
+  // region and descriptor sets
+  uint32_t frames_in_flight = 2;
+  // Set before init. Octahedral RG16 normals, RGBA8 albedo, no position
+  // attachment and an R11G11B10 shading target instead of RGBA32F everywhere
+  bool compact_gbuffer = false;
+  // Set before init. Hi-Z traced reflections at half resolution instead of
+  // the full resolution linear march of the screenspace effects pass
+  bool hiz_reflections = true;
+  // Set before init. Pipelines compiled by earlier runs are loaded from the
+  // file at init and the cache is written back on cleanup, empty disables it
+  Path pipeline_cache_path = "pipeline_cache.bin";
+
+  // Filled by init
+  struct StartupTimings {
+    float total_ms;
+    float pipelines_ms; // Passes and their pipelines
+    bool pipeline_cache_loaded;
+  } startup_timings{};
+
+  // Debug primitives of the last frame that didn't fit MAX_DEBUG_INSTANCES
+  uint32_t dropped_debug_primitives = 0;
 
   Renderer();
 
@@ -118,13 +325,16 @@ public:
   // Initializes physical and logical devices + VBA
   void init_vulkan();
 
+  // Loads the pipelines of earlier runs, see pipeline_cache_path
+  void init_pipeline_cache();
+
   // Allocates swapchain, it's image buffers and image views into the buffers
   void init_swapchain();
 
   // Allocates the depth image and it't view
   void init_z_buffer();
 
-  // Initializes the command pool to be submitted to the graphics queue
+  // Initializes the command pools of the frames and the one time submits
   void init_cmd_buffer();
 
   // Defines the renderpass with all the subpasses and their attachments
@@ -138,6 +348,9 @@ public:
 
   void init_descriptor_pool();
 
+  // Bindless texture table and the samplers of the textures
+  void init_texture_heap();
+
   void init_debug_renderable();
 
   // Starts submission command buffer recording
@@ -151,25 +364,118 @@ public:
   // Check if renderables need to be allocated
   void check_renderables();
 
-  void bind_textures();
+  // Collects the enabled lights and updates the matrices of the moved ones
+  void gather_lights();
+
+  // Copies the lights into the light buffer if they changed, grows the
+  // buffer if needed
+  void upload_lights();
+
+  // Packs the atlas tiles of the lights that can cast visible shadows
+  void allocate_shadow_tiles();
+
+  // Fills the visible lists of the camera and the lights
+  void cull_renderables();
+
+  // Picks the shadow tiles to re-render this frame
+  void schedule_shadow_updates();
+
+  // Groups the visible lists by mesh, and by texture if split_textures is
+  // set, and fills the instance data
+  void build_draw_batches();
+  void build_draw_batches(std::vector<DrawRef> &refs,
+                          std::vector<DrawBatch> &batches,
+                          bool split_textures = false);
+  // Lights without an update or casters of the other kind get no instances
+  void build_shadow_groups(std::vector<ShadowGroup> &groups,
+                           const std::vector<bool> &updates, bool dynamic);
+
+  // Copies the instance data of the frame, grows the buffer if needed
+  void upload_instances();
+
+  // Bins the enabled lights into the froxels of the camera frustum
+  void build_light_clusters();
+  // Copies the clusters of the frame, grows the buffer if needed
+  void upload_light_clusters();
+  void upload_camera(const Eigen::Matrix4f &view,
+                     const Eigen::Matrix4f &projection,
+                     const Eigen::Matrix4f &view_projection);
+  // Grows the ring before the uploads if the frame doesn't fit
+  void reserve_upload_ring();
+  void init_ring_bindings();
+  void init_frame_materials();
+  void bind_upload_ring();
+  void set_ring_offsets();
+
+  // Fills the spans of the screen the reflections are traced on
+  void find_reflective_tiles(const Eigen::Matrix4f &view_projection);
+
   void transfer_texture_to_gpu(Texture::Ptr texture);
 
   void begin_render_pass(VkRenderPass &render_pass, VkFramebuffer &framebuffer,
                          VkCommandBuffer &command_buffer,
                          const VkExtent2D &extent, float depth_clear_value,
                          float *color_clear_values,
-                         int color_clear_values_count, float alpha_clear_value);
+                         int color_clear_values_count, float alpha_clear_value,
+                         VkSubpassContents contents =
+                             VK_SUBPASS_CONTENTS_INLINE);
   void end_render_pass(VkCommandBuffer &command_buffer);
 
+  FrameData &get_current_frame();
+  // Waits until the GPU is done with the previous use of the current frame,
+  // then acquires the swapchain image and starts recording
   void begin_command_buffer(VkCommandBuffer &command_buffer);
   void submit_command_buffer(VkCommandBuffer &command_buffer);
 
+  /**
+   * @brief Records [0, count) in batches of at least min_batch_size into
+   * secondary command buffers continuing the subpass of the pass. Batches
+   * are recorded in parallel on the job system by record(command_buffer,
+   * begin, end), their buffers are appended to secondaries in order
+   *
+   */
+  template <typename Function>
+  void record_secondary(RenderPass &pass, uint32_t count,
+                        uint32_t min_batch_size, const Function &record,
+                        std::vector<VkCommandBuffer> &secondaries);
+
   void render_shadow_maps(VkCommandBuffer &command_buffer);
+  // Groups of lights are recorded in parallel into the subpass of the pass
+  void record_shadow_groups(RenderPass &pass,
+                            const std::vector<ShadowGroup> &groups,
+                            std::vector<VkCommandBuffer> &secondaries);
+  // Groups [begin, end), thread safe
+  void draw_shadow_groups(VkCommandBuffer command_buffer,
+                          const std::vector<ShadowGroup> &groups,
+                          uint32_t begin, uint32_t end);
   void render_g_buffer(VkCommandBuffer &command_buffer);
+  // Binds the normal, position, albedo and depth textures of the G-buffer to
+  // consecutive bindings
+  void bind_g_buffer(DescriptorSetAllocator &ds_allocator, int set,
+                     int first_binding);
+  // Inputs of the fullscreen passes that don't change between frames,
+  // written once to the sets of every frame
+  void bind_fullscreen_inputs();
+  // Secondary command buffer drawing the fullscreen triangle of the material
+  // for the current frame, recorded again if it is out of date
+  VkCommandBuffer get_prerecorded_pass(PrerecordedPass &prerecorded,
+                                       Material &material,
+                                       VkRenderPass render_pass,
+                                       VkFramebuffer framebuffer,
+                                       VkExtent2D extent);
   void render_screenspace_effects(VkCommandBuffer &command_buffer);
   void render_composite(VkCommandBuffer &command_buffer);
   void render_shading(VkCommandBuffer &command_buffer);
+  void render_hiz(VkCommandBuffer &command_buffer);
+  // Traces the reflective tiles and accumulates them into the history
+  void render_reflections(VkCommandBuffer &command_buffer);
   void render_screenspace_smoothing(VkCommandBuffer &command_buffer);
+  // Clears and draws a fullscreen triangle into the single color attachment
+  // of the pass, scissored to the spans when given
+  void render_fullscreen_pass(
+      VkCommandBuffer &command_buffer, RenderPass &pass,
+      const std::vector<ScreenTileMask::Span> *spans = nullptr);
+  void upload_debug_instances();
   void render_debug(VkCommandBuffer &command_buffer);
   void render_gui(VkCommandBuffer &command_buffer);
 
@@ -188,18 +494,31 @@ public:
 
   void init_shading_pass();
 
-  // Debugging primitive drawing
+  void init_reflection_passes();
+
+  // Pass with one color attachment drawn by a fullscreen triangle, set 0 of
+  // the material holds the camera and set 1 the given bindings
+  void init_fullscreen_pass(RenderPass &pass, VkFormat format,
+                            VkExtent2D extent, VkFilter filter_mode,
+                            const char *frag_shader,
+                            std::vector<Binding> bindings,
+                            std::vector<int32_t> specialization_constants);
+
+  // Debugging primitive drawing. Can be called from any thread between
+  // frames and return right away unless debug mode is on
   void draw_debug_line(const Eigen::Vector3f &start, const Eigen::Vector3f &end,
                        const Eigen::Vector3f &color);
 
   void draw_debug_quad(const Eigen::Matrix<float, 4, 3> &quad_verts,
                        const Eigen::Vector3f &color);
 
-  void draw_debug_box(const Eigen::Matrix<float, 8, 4> &box_verts,
+  // Box with the local bounds min/max placed by model
+  void draw_debug_box(const Eigen::Vector3f &min, const Eigen::Vector3f &max,
+                      const Eigen::Matrix4f &model,
                       const Eigen::Vector3f &color);
 
   void draw_debug_sphere(const Eigen::Vector3f &position, float radius,
-                         int resolution, const Eigen::Vector3f &color);
+                         const Eigen::Vector3f &color);
 };
 Renderer &get_renderer();
 } // namespace rend
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+
+#include <rend/Rendering/Vulkan/vk_check.h>
+#include <rend/Rendering/Vulkan/vk_struct_init.h>
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Samplers shared between textures. Textures only differ in filter
+ * and address mode, every combination is created once and destroyed with
+ * the cache
+ *
+ */
+class SamplerCache {
+public:
+  void init(VkDevice device) { this->device = device; }
+
+  VkSampler get(VkFilter filter, VkSamplerAddressMode address_mode) {
+    uint64_t key = (static_cast<uint64_t>(filter) << 32) |
+                   static_cast<uint32_t>(address_mode);
+    auto iterator = samplers.find(key);
+    if (iterator != samplers.end()) {
+      return iterator->second;
+    }
+    VkSamplerCreateInfo sampler_info =
+        vk_struct_init::get_sampler_create_info(filter, address_mode);
+    VkSampler sampler;
+    VK_CHECK(vkCreateSampler(device, &sampler_info, nullptr, &sampler),
+             "Failed to create sampler");
+    samplers.insert({key, sampler});
+    return sampler;
+  }
+
+  void destroy() {
+    for (auto &[key, sampler] : samplers) {
+      vkDestroySampler(device, sampler, nullptr);
+    }
+    samplers.clear();
+  }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  std::unordered_map<uint64_t, VkSampler> samplers;
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <rend/Rendering/Vulkan/vk_check.h>
+#include <rend/Rendering/Vulkan/vk_struct_init.h>
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Command pools for recording secondary command buffers from the job
+ * system. Every frame in flight has a pool per thread, a thread claims its
+ * pool with an atomic increment the first time it records in a frame so
+ * pools are never shared between threads. Buffers are kept and reused once
+ * the pools of the frame are reset
+ *
+ */
+class SecondaryCommandPools {
+public:
+  void init(VkDevice device, uint32_t queue_family, uint32_t thread_count,
+            uint32_t frame_count) {
+    this->device = device;
+    // Pools are reset as a whole, buffers are recorded once per frame
+    VkCommandPoolCreateInfo pool_info =
+        vk_struct_init::get_command_pool_create_info(
+            queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    frames.resize(frame_count);
+    for (std::vector<ThreadPool> &pools : frames) {
+      pools.resize(thread_count);
+      for (ThreadPool &pool : pools) {
+        VK_CHECK(vkCreateCommandPool(device, &pool_info, nullptr, &pool.pool),
+                 "Failed to create command pool");
+      }
+    }
+  }
+
+  // The GPU must be done with the previous use of the frame
+  void begin_frame(uint32_t frame_idx) {
+    current_frame = frame_idx;
+    for (ThreadPool &pool : frames[frame_idx]) {
+      if (pool.used > 0) {
+        VK_CHECK(vkResetCommandPool(device, pool.pool, 0),
+                 "Failed to reset command pool");
+        pool.used = 0;
+      }
+    }
+    // Threads claim their pools again
+    claimed_pools.store(0, std::memory_order_relaxed);
+    generation = next_generation().fetch_add(1) + 1;
+  }
+
+  /**
+   * @brief Begins a secondary command buffer continuing the subpass of the
+   * given render pass. Can be called from any thread, the buffer must be
+   * ended on the same thread
+   *
+   */
+  VkCommandBuffer begin(VkRenderPass render_pass, VkFramebuffer framebuffer) {
+    ThreadPool &pool = get_thread_pool();
+    if (pool.used == pool.buffers.size()) {
+      VkCommandBufferAllocateInfo buffer_info =
+          vk_struct_init::get_command_buffer_allocate_info(
+              pool.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+      pool.buffers.push_back(VK_NULL_HANDLE);
+      VK_CHECK(vkAllocateCommandBuffers(device, &buffer_info,
+                                        &pool.buffers.back()),
+               "Failed to allocate command buffer");
+    }
+    VkCommandBuffer command_buffer = pool.buffers[pool.used++];
+
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.pNext = nullptr;
+    inheritance_info.renderPass = render_pass;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = nullptr;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                       VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance_info;
+    VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info),
+             "Failed to begin command buffer");
+    return command_buffer;
+  }
+
+  void destroy() {
+    for (std::vector<ThreadPool> &pools : frames) {
+      for (ThreadPool &pool : pools) {
+        vkDestroyCommandPool(device, pool.pool, nullptr);
+      }
+    }
+    frames.clear();
+  }
+
+private:
+  struct ThreadPool {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> buffers;
+    uint32_t used = 0; // Buffers begun since the last reset
+  };
+
+  struct ThreadSlot {
+    uint64_t generation = 0;
+    uint32_t pool_idx = 0;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  std::vector<std::vector<ThreadPool>> frames; // Per frame and thread
+  uint32_t current_frame = 0;
+  std::atomic<uint32_t> claimed_pools{0};
+  std::atomic<uint64_t> generation{0};
+
+  static std::atomic<uint64_t> &next_generation() {
+    static std::atomic<uint64_t> counter{0};
+    return counter;
+  }
+
+  ThreadPool &get_thread_pool() {
+    thread_local ThreadSlot slot{};
+    uint64_t current_generation = generation.load(std::memory_order_relaxed);
+    if (slot.generation != current_generation) {
+      slot.generation = current_generation;
+      slot.pool_idx = claimed_pools.fetch_add(1, std::memory_order_acq_rel);
+    }
+    if (slot.pool_idx >= frames[current_frame].size()) {
+      throw std::runtime_error("Out of secondary command pools");
+    }
+    return frames[current_frame][slot.pool_idx];
+  }
+};
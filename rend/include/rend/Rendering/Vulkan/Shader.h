@@ -21,7 +21,8 @@ class Shader {
   // Generic shader module creation
   VkPipelineShaderStageCreateInfo
   get_shader_stage_info(VkShaderStageFlagBits stage,
-                        VkShaderModule shaderModule);
+                        VkShaderModule shaderModule,
+                        const VkSpecializationInfo *specialization_info);
 
 public:
   Shader(Path vertex_path, Path fragment_path) {
@@ -41,7 +42,9 @@ public:
 
   void build_shader_modules(VkDevice &_device);
 
-  VkPipelineShaderStageCreateInfo get_vertex_shader_stage_info();
+  VkPipelineShaderStageCreateInfo get_vertex_shader_stage_info(
+      const VkSpecializationInfo *specialization_info = nullptr);
 
-  VkPipelineShaderStageCreateInfo get_fragment_shader_stage_info();
+  VkPipelineShaderStageCreateInfo get_fragment_shader_stage_info(
+      const VkSpecializationInfo *specialization_info = nullptr);
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstring>
+#include <rend/Rendering/Vulkan/SamplerCache.h>
 #include <rend/Rendering/Vulkan/vk_helper_types.h>
 #include <rend/Rendering/Vulkan/vk_struct_init.h>
 #include <rend/macros.h>
@@ -26,7 +27,8 @@ struct Texture {
   PixelBuffer pixel_buffer;
 
   ImageAllocation image_allocation;
-  VkSampler sampler;
+  VkSampler sampler;   // Owned by the sampler cache
+  int32_t handle = -1; // Index in the texture heap, -1 until resident
 
   VkFilter filter = VK_FILTER_LINEAR;
   VkSamplerAddressMode address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -36,6 +38,7 @@ struct Texture {
   Texture(PixelBuffer &pixel_buffer);
 
   void allocate_image(VkDevice &device, VmaAllocator &allocator,
+                      SamplerCache &sampler_cache,
                       Deallocator &deallocator_queue);
 
   bool image_allocated() { return image_allocation.buffer_allocated; }
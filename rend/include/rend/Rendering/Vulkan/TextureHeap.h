@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+
+#include <rend/Rendering/Vulkan/DescriptorSet.h>
+#include <rend/Rendering/Vulkan/Texture.h>
+#include <rend/Rendering/Vulkan/vk_check.h>
+#include <rend/Rendering/Vulkan/vk_struct_init.h>
+#include <vulkan/vulkan.h>
+
+constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+
+/**
+ * @brief Bindless table of every resident texture. A single set with one
+ * runtime-sized sampler array, partially bound and updated after bind, so
+ * textures are added while frames using the set are in flight. The handle
+ * of a texture is its index in the array and never changes
+ *
+ */
+class TextureHeap {
+public:
+  VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+  VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+
+  void init(VkDevice device, uint32_t capacity) {
+    this->device = device;
+    this->capacity = capacity;
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = capacity;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.pImmutableSamplers = nullptr;
+
+    // Slots past the last handle are never written
+    VkDescriptorBindingFlagsEXT binding_flags =
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info = {};
+    flags_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    flags_info.pNext = nullptr;
+    flags_info.bindingCount = 1;
+    flags_info.pBindingFlags = &binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &flags_info;
+    layout_info.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_info, nullptr,
+                                         &layout),
+             "Failed to create descriptor set layout");
+
+    VkDescriptorPoolSize pool_size = {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, capacity};
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool),
+             "Failed to create descriptor pool");
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.pNext = nullptr;
+    alloc_info.descriptorPool = pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+    VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set),
+             "Failed to allocate descriptor sets");
+  }
+
+  /**
+   * @brief Writes the texture to the next free slot and stores the slot as
+   * its handle. Textures that already have a handle keep it. The image must
+   * be allocated and in its shader read layout before the next submit
+   *
+   * @return Handle of the texture
+   */
+  int32_t add(Texture &texture) {
+    if (texture.handle >= 0) {
+      return texture.handle;
+    }
+    if (!texture.image_allocated()) {
+      throw std::runtime_error("Added texture was not allocated");
+    }
+    if (count == capacity) {
+      throw std::runtime_error("Texture heap is full");
+    }
+
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageLayout = texture.layout;
+    image_info.imageView = texture.image_allocation.view;
+    image_info.sampler = texture.sampler;
+    VkWriteDescriptorSet write = vk_struct_init::get_descriptor_write_info(
+        0, descriptor_set, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+        nullptr, &image_info);
+    write.dstArrayElement = count;
+    // The slot isn't used by the frames in flight yet
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    texture.handle = count++;
+    return texture.handle;
+  }
+
+  // Materials built with it bind the table as the given set
+  SharedDescriptorSet get_shared_set(int set_idx) const {
+    return SharedDescriptorSet{set_idx, layout, descriptor_set};
+  }
+
+  uint32_t get_count() const { return count; }
+
+  void destroy() {
+    // Frees the set with the pool
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, layout, nullptr);
+  }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  uint32_t capacity = 0;
+  uint32_t count = 0; // Next free slot
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstring>
+#include <stdexcept>
+
+#include <rend/Rendering/FrameRing.h>
+#include <rend/Rendering/Vulkan/vk_helper_types.h>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+/**
+ * @brief Persistently mapped buffer for the transient per-frame uniform and
+ * storage data. Uploads are plain memcpys into the current frame region,
+ * the descriptors point at the buffer once and every frame only changes
+ * their dynamic offsets
+ *
+ */
+class UploadRing {
+public:
+  struct Allocation {
+    void *data;
+    uint32_t offset; // Dynamic offset of the allocation
+  };
+
+  BufferAllocation buffer;
+
+  void init(size_t frame_size, uint32_t frame_count, size_t alignment,
+            VmaAllocator allocator) {
+    ring.init(frame_size, frame_count, alignment);
+    // Dynamic storage bindings cover a whole region from their offset, the
+    // padding keeps them inside the buffer for offsets in the last region
+    buffer = BufferAllocation::create(
+        ring.get_frame_size() * (frame_count + 1),
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, allocator,
+        VMA_ALLOCATION_CREATE_MAPPED_BIT);
+  }
+
+  void begin_frame(uint64_t frame_number) { ring.begin_frame(frame_number); }
+
+  Allocation allocate(size_t size) {
+    size_t offset;
+    if (!ring.allocate(size, offset)) {
+      throw std::runtime_error("Upload ring overflow");
+    }
+    return Allocation{static_cast<char *>(buffer.mapped_data) + offset,
+                      static_cast<uint32_t>(offset)};
+  }
+
+  // Packs the datas one after another like BufferAllocation::copy_from
+  uint32_t upload(void *datas[], size_t sizes[], size_t num_datas) {
+    size_t total_size = 0;
+    for (size_t i = 0; i < num_datas; i++) {
+      total_size += sizes[i];
+    }
+    Allocation allocation = allocate(total_size);
+    char *dst = static_cast<char *>(allocation.data);
+    for (size_t i = 0; i < num_datas; i++) {
+      memcpy(dst, datas[i], sizes[i]);
+      dst += sizes[i];
+    }
+    return allocation.offset;
+  }
+
+  // Makes the uploads of the current frame visible to the device
+  void flush() {
+    if (ring.get_used() > 0) {
+      buffer.flush(ring.get_frame_begin(), ring.get_used());
+    }
+  }
+
+  // Range of the dynamic storage bindings
+  size_t get_frame_size() const { return ring.get_frame_size(); }
+
+  size_t get_aligned_size(size_t size) const {
+    return rend::FrameRingAllocator::align_up(size, ring.get_alignment());
+  }
+
+  void destroy() { buffer.destroy(); }
+
+private:
+  rend::FrameRingAllocator ring;
+};
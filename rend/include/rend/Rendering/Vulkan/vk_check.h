@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <vulkan/vulkan.h>
+
+static void VK_CHECK(VkResult err) {
+  if (err == 0) {
+    return;
+  }
+  fprintf(stderr, "[vulkan] Error: VkResult = %d\n", err);
+  if (err < 0) {
+    abort();
+  }
+}
+
+static void VK_CHECK(VkResult err, const char *msg) {
+  if (err == 0) {
+    return;
+  }
+  fprintf(stderr, "[vulkan] Error: VkResult = %d\n %s", err, msg);
+  if (err < 0) {
+    abort();
+  }
+}
@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <functional>
 #include <iostream>
+#include <rend/Rendering/Vulkan/vk_check.h>
 #include <rend/Rendering/Vulkan/vk_struct_init.h>
 #include <vector>
 #include <vk_mem_alloc.h>
@@ -16,12 +17,16 @@ struct BufferAllocation {
   VmaAllocation allocation = VK_NULL_HANDLE;
   size_t size;
   VmaAllocator allocator = VK_NULL_HANDLE;
+  // Only set for buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT, stays
+  // valid until the buffer is destroyed
+  void *mapped_data = nullptr;
 
   bool buffer_allocated = false;
 
   static BufferAllocation create(size_t size, VkBufferUsageFlags buffer_usage,
                                  VmaMemoryUsage alloc_usage,
-                                 VmaAllocator allocator) {
+                                 VmaAllocator allocator,
+                                 VmaAllocationCreateFlags alloc_flags = 0) {
 
     BufferAllocation buffer_allocation;
     buffer_allocation.size = size;
@@ -35,12 +40,16 @@ struct BufferAllocation {
 
     VmaAllocationCreateInfo vmaalloc_info = {};
     vmaalloc_info.usage = alloc_usage;
+    vmaalloc_info.flags = alloc_flags;
 
+    VmaAllocationInfo allocation_info = {};
     if (vmaCreateBuffer(allocator, &buffer_info, &vmaalloc_info,
                         &buffer_allocation.buffer,
-                        &buffer_allocation.allocation, nullptr) != VK_SUCCESS) {
+                        &buffer_allocation.allocation,
+                        &allocation_info) != VK_SUCCESS) {
       throw std::runtime_error("Failed to create buffer");
     }
+    buffer_allocation.mapped_data = allocation_info.pMappedData;
     buffer_allocation.buffer_allocated = true;
     return buffer_allocation;
   }
@@ -66,6 +75,12 @@ struct BufferAllocation {
     vmaUnmapMemory(allocator, allocation);
   }
 
+  // Makes writes through mapped_data visible to the device, no-op on host
+  // coherent memory
+  void flush(size_t offset, size_t size) {
+    vmaFlushAllocation(allocator, allocation, offset, size);
+  }
+
   bool valid() { return buffer != VK_NULL_HANDLE; }
 
   void destroy() { vmaDestroyBuffer(allocator, buffer, allocation); }
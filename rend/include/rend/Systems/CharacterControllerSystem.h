@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <rend/JobSystem.h>
+#include <rend/Physics/CharacterCollision.h>
+#include <rend/Physics/CharacterController.h>
+#include <rend/System.h>
+#include <rend/Systems/PhysicsSystem.h>
+#include <rend/Transform.h>
+
+#include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
+#include <Jolt/Physics/Collision/Shape/RotatedTranslatedShape.h>
+
+namespace rend::systems {
+/**
+ * @brief Moves all the CharacterControllers through the physics world.
+ * Characters collide with each other against a snapshot of their poses
+ * taken before they move. The snapshot bins them into grid cells, the cells
+ * of one parity are split into one batch per worker and the parities run
+ * one after another, so characters that can touch never move at the same
+ * time. Every batch has its own temp allocator so the update doesn't
+ * allocate. Run it after the PhysicsSystem update, it must not overlap with
+ * a physics step. Remove characters with remove_entity before removing
+ * their entities.
+ *
+ */
+struct CharacterControllerSystem : public System {
+  static constexpr size_t TEMP_ALLOCATOR_SIZE = 1024 * 1024; // Per worker
+  // Added to the reach of the characters, covers the predictive contact
+  // distance of Jolt
+  static constexpr float CONTACT_MARGIN = 0.25f;
+
+  ~CharacterControllerSystem() {
+    // Characters outliving the system must not point at its collision
+    for (JPH::CharacterVirtual *character : characters) {
+      character->SetCharacterVsCharacterCollision(nullptr);
+    }
+  }
+
+  // Creates the Jolt characters of all the controllers
+  void init() {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    for (rend::ECS::EntityRegistry::ArchetypeIterator iterator =
+             registry.archetype_iterator<CharacterController, Transform>();
+         iterator.valid(); ++iterator) {
+      rend::ECS::EID eid = *iterator;
+      add_character(eid, registry.get_component<CharacterController>(eid),
+                    registry.get_component<Transform>(eid));
+    }
+  }
+
+  void add_character(rend::ECS::EID eid, CharacterController &controller,
+                     const Transform &transform) {
+    float half_height = 0.5f * controller.height;
+    // Moves the capsule up so that the position is at the feet
+    JPH::RefConst<JPH::Shape> shape =
+        JPH::RotatedTranslatedShapeSettings(
+            JPH::Vec3(0, half_height + controller.radius, 0),
+            JPH::Quat::sIdentity(),
+            new JPH::CapsuleShape(half_height, controller.radius))
+            .Create()
+            .Get();
+
+    JPH::CharacterVirtualSettings settings;
+    settings.mShape = shape;
+    settings.mMass = controller.mass;
+    settings.mMaxStrength = controller.max_strength;
+    settings.mMaxSlopeAngle = controller.max_slope_angle;
+    settings.mUp = JPH::Vec3::sAxisY();
+    // Accept contacts that touch the lower sphere of the capsule as ground
+    settings.mSupportingVolume =
+        JPH::Plane(JPH::Vec3::sAxisY(), -controller.radius);
+
+    controller.character = new JPH::CharacterVirtual(
+        &settings, eigen_to_jolt(transform.position),
+        eigen_to_jolt(transform.rotation), eid,
+        get_jph_physics_interface().jph_physics_system);
+    controller.character->SetCharacterVsCharacterCollision(
+        &character_vs_character);
+    characters.push_back(controller.character);
+  }
+
+  // Unregisters the character of the entity and releases it
+  void remove_entity(rend::ECS::EID eid) {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    if (!registry.is_component_enabled<CharacterController>(eid)) {
+      return;
+    }
+    CharacterController &controller =
+        registry.get_component<CharacterController>(eid);
+    if (controller.character == nullptr) {
+      return;
+    }
+    characters.erase(std::remove(characters.begin(), characters.end(),
+                                 controller.character.GetPtr()),
+                     characters.end());
+    controller.character->SetCharacterVsCharacterCollision(nullptr);
+    controller.character = nullptr;
+  }
+
+  void update(float dt) override {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+
+    // Component lookups go through the registry maps, do them here once
+    controllers.clear();
+    transforms.clear();
+    eids.clear();
+    updated_characters.clear();
+    for (rend::ECS::EntityRegistry::ArchetypeIterator iterator =
+             registry.archetype_iterator<CharacterController, Transform>();
+         iterator.valid(); ++iterator) {
+      rend::ECS::EID eid = *iterator;
+      CharacterController &controller =
+          registry.get_component<CharacterController>(eid);
+      if (controller.character == nullptr) {
+        continue;
+      }
+      controllers.push_back(&controller);
+      transforms.push_back(&registry.get_component<Transform>(eid));
+      eids.push_back(eid);
+      updated_characters.push_back(controller.character);
+    }
+
+    // Velocities first, they bound how far the characters move
+    float max_speed = 0.0f;
+    for (CharacterController *controller : controllers) {
+      max_speed = std::max(max_speed, set_velocity(*controller, dt));
+    }
+    JPH::CharacterVirtual::ExtendedUpdateSettings update_settings;
+    float reach = max_speed * dt + update_settings.mWalkStairsStepUp.Length() +
+                  update_settings.mStickToFloorStepDown.Length() +
+                  update_settings.mWalkStairsStepDownExtra.Length() +
+                  update_settings.mWalkStairsStepForwardTest + CONTACT_MARGIN;
+    character_vs_character.build(updated_characters, reach);
+
+    rend::JobSystem &jobs = rend::get_job_system();
+    uint32_t worker_count = jobs.get_max_concurrency();
+    while (temp_allocators.size() < worker_count) {
+      temp_allocators.emplace_back(
+          std::make_unique<JPH::TempAllocatorImpl>(TEMP_ALLOCATOR_SIZE));
+    }
+
+    const std::vector<rend::physics::CharacterSnapshotCollision::Entry>
+        &entries = character_vs_character.get_entries();
+    for (uint32_t parity = 0;
+         parity < rend::physics::CharacterSnapshotCollision::PARITY_COUNT;
+         parity++) {
+      parity_cells.clear();
+      for (const rend::physics::CharacterSnapshotCollision::Cell &cell :
+           character_vs_character.get_cells()) {
+        if (cell.get_parity() == parity) {
+          parity_cells.push_back(&cell);
+        }
+      }
+
+      // The characters of a cell can touch, they move one after another
+      uint32_t count = parity_cells.size();
+      uint32_t batch_size =
+          std::max<uint32_t>(1, (count + worker_count - 1) / worker_count);
+      jobs.parallel_for(
+          count, batch_size,
+          [&](uint32_t begin, uint32_t end, uint32_t batch) {
+            JPH::TempAllocator &temp_allocator = *temp_allocators[batch];
+            for (uint32_t i = begin; i < end; i++) {
+              const rend::physics::CharacterSnapshotCollision::Cell &cell =
+                  *parity_cells[i];
+              for (uint32_t j = cell.first; j < cell.first + cell.count; j++) {
+                uint32_t index = entries[j].index;
+                move_character(*controllers[index], *transforms[index], dt,
+                               update_settings, temp_allocator);
+              }
+            }
+          });
+    }
+
+    // The registry isn't thread safe, mark the moved transforms afterwards
+    for (rend::ECS::EID eid : eids) {
+      registry.mark_changed<Transform>(eid);
+    }
+  }
+
+private:
+  // Rebuilt before the characters move, they only read this copy of each
+  // other's poses
+  rend::physics::CharacterSnapshotCollision character_vs_character;
+  std::vector<JPH::CharacterVirtual *> characters; // Using the collision
+
+  // Reused between updates
+  std::vector<CharacterController *> controllers;
+  std::vector<Transform *> transforms;
+  std::vector<rend::ECS::EID> eids;
+  std::vector<JPH::CharacterVirtual *> updated_characters;
+  std::vector<const rend::physics::CharacterSnapshotCollision::Cell *>
+      parity_cells;
+  std::vector<std::unique_ptr<JPH::TempAllocatorImpl>> temp_allocators;
+
+  // Sets the velocity of the character from the input, returns its speed
+  static float set_velocity(CharacterController &controller, float dt) {
+    JPH::PhysicsSystem *physics_system =
+        get_jph_physics_interface().jph_physics_system;
+    JPH::CharacterVirtual &character = *controller.character;
+    JPH::Vec3 up = character.GetUp();
+    JPH::Vec3 gravity = physics_system->GetGravity();
+
+    // Keep the vertical velocity unless standing on the ground, in which
+    // case move with the ground
+    JPH::Vec3 current_vertical = character.GetLinearVelocity().Dot(up) * up;
+    JPH::Vec3 ground_velocity = character.GetGroundVelocity();
+    JPH::Vec3 velocity;
+    bool on_ground = character.GetGroundState() ==
+                     JPH::CharacterVirtual::EGroundState::OnGround;
+    if (on_ground && (current_vertical - ground_velocity).Dot(up) < 0.1f) {
+      velocity = ground_velocity;
+      if (controller.jump) {
+        velocity += controller.jump_speed * up;
+      }
+    } else {
+      velocity = current_vertical;
+    }
+    controller.jump = false;
+    velocity += gravity * dt + eigen_to_jolt(controller.desired_velocity);
+    character.SetLinearVelocity(velocity);
+    return velocity.Length();
+  }
+
+  static void
+  move_character(CharacterController &controller, Transform &transform,
+                 float dt,
+                 const JPH::CharacterVirtual::ExtendedUpdateSettings
+                     &update_settings,
+                 JPH::TempAllocator &temp_allocator) {
+    JPH::PhysicsSystem *physics_system =
+        get_jph_physics_interface().jph_physics_system;
+    JPH::CharacterVirtual &character = *controller.character;
+    JPH::Vec3 gravity = physics_system->GetGravity();
+    character.ExtendedUpdate(
+        dt, gravity, update_settings,
+        physics_system->GetDefaultBroadPhaseLayerFilter(JPH::Layers::MOVING),
+        physics_system->GetDefaultLayerFilter(JPH::Layers::MOVING), {}, {},
+        temp_allocator);
+
+    controller.velocity = jolt_to_eigen(character.GetLinearVelocity());
+    controller.on_ground = character.GetGroundState() ==
+                           JPH::CharacterVirtual::EGroundState::OnGround;
+    transform.position = jolt_to_eigen(JPH::Vec3(character.GetPosition()));
+    transform.rotation = jolt_to_eigen(character.GetRotation());
+  }
+};
+} // namespace rend::systems
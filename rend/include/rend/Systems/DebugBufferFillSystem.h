@@ -1,60 +1,50 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <rend/JobSystem.h>
 #include <rend/Physics/AABB.h>
 #include <rend/Physics/Rigidbody.h>
+#include <rend/Rendering/Vulkan/Renderer.h>
 #include <rend/System.h>
 #include <rend/Transform.h>
 
 namespace rend::systems {
-constexpr int DEBUG_SPHERE_RESOLUTION = 20;
 /**
- * @brief Fills the Renderer debug buffer with AABBs of all entities
+ * @brief Fills the Renderer debug buffer with AABBs of all entities. Reads
+ * the physics state without being part of the simulation and does nothing
+ * unless debug mode is on. Entities are recorded in parallel jobs
  *
  */
 struct DebugBufferFillSystem : public System {
+  std::vector<rend::ECS::EID> eids; // Reused between updates
+
   void update(float dt) override {
     Renderer &renderer = rend::get_renderer();
+    if (!renderer.debug_mode) {
+      return;
+    }
     rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
 
+    eids.clear();
     for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
              registry.archetype_iterator<Transform>();
          rb_iterator.valid(); ++rb_iterator) {
-      rend::ECS::EID eid = *rb_iterator;
-      Transform &transform = registry.get_component<Transform>(eid);
-      if (registry.is_component_enabled<Rigidbody>(eid)) {
-        Rigidbody &rigidbody = registry.get_component<Rigidbody>(eid);
-
-        if (rigidbody.primitive_type == Rigidbody::PrimitiveType::BOX &&
-            registry.is_component_enabled<AABB>(eid)) {
-          AABB &aabb = registry.get_component<AABB>(eid);
-          Eigen::Matrix<float, 8, 4> aabb_vertices =
-              get_global_aabb_vertices(aabb);
-          Eigen::Matrix<float, 8, 4> model_transform_vertices =
-              (transform.get_model_matrix() *
-               get_local_aabb_vertices(aabb).transpose())
-                  .transpose();
-
-          renderer.draw_debug_box(aabb_vertices, Eigen::Vector3f(1, 0, 0));
-          renderer.draw_debug_box(model_transform_vertices,
-                                  Eigen::Vector3f(0, 1, 0));
-          continue;
-        }
-
-        if (rigidbody.primitive_type == Rigidbody::PrimitiveType::SPHERE) {
-          renderer.draw_debug_sphere(
-              transform.position,
-              rigidbody.dimensions[0] * 1.04, // Extends the sphere a bit
-              DEBUG_SPHERE_RESOLUTION, Eigen::Vector3f(1, 1, 1));
-          continue;
-        }
-      } else {
-        renderer.draw_debug_sphere(transform.position, 1.0, 5,
-                                   Eigen::Vector3f(0, 0, 1));
-      }
+      eids.push_back(*rb_iterator);
     }
 
-    for (LightSource &light : renderer.lights) {
+    JobSystem &job_system = get_job_system();
+    job_system.parallel_for(
+        eids.size(), job_system.get_batch_size(eids.size(), 64),
+        [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t i = begin; i < end; i++) {
+            draw_entity(renderer, registry, eids[i]);
+          }
+        });
+
+    for (rend::ECS::EntityRegistry::ArchetypeIterator light_iterator =
+             registry.archetype_iterator<Light>();
+         light_iterator.valid(); ++light_iterator) {
+      Light &light = registry.get_component<Light>(*light_iterator);
       if (!light.enabled()) {
         continue;
       }
@@ -85,5 +75,37 @@ struct DebugBufferFillSystem : public System {
                                Eigen::Vector3f(1, 0, 0));
     }
   }
+
+private:
+  static void draw_entity(Renderer &renderer,
+                          rend::ECS::EntityRegistry &registry,
+                          rend::ECS::EID eid) {
+    Transform &transform = registry.get_component<Transform>(eid);
+    if (!registry.is_component_enabled<Rigidbody>(eid)) {
+      renderer.draw_debug_sphere(transform.position, 1.0,
+                                 Eigen::Vector3f(0, 0, 1));
+      return;
+    }
+    Rigidbody &rigidbody = registry.get_component<Rigidbody>(eid);
+
+    if (rigidbody.primitive_type == Rigidbody::PrimitiveType::BOX &&
+        registry.is_component_enabled<AABB>(eid)) {
+      AABB &aabb = registry.get_component<AABB>(eid);
+      renderer.draw_debug_box(aabb.min_global, aabb.max_global,
+                              Eigen::Matrix4f::Identity(),
+                              Eigen::Vector3f(1, 0, 0));
+      renderer.draw_debug_box(aabb.min_local, aabb.max_local,
+                              transform.get_model_matrix(),
+                              Eigen::Vector3f(0, 1, 0));
+      return;
+    }
+
+    if (rigidbody.primitive_type == Rigidbody::PrimitiveType::SPHERE) {
+      renderer.draw_debug_sphere(
+          transform.position,
+          rigidbody.dimensions[0] * 1.04, // Extends the sphere a bit
+          Eigen::Vector3f(1, 1, 1));
+    }
+  }
 };
 } // namespace rend::systems
\ No newline at end of file
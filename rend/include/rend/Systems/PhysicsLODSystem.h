@@ -0,0 +1,269 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <rend/Physics/PhysicsQueries.h>
+#include <rend/Physics/Rigidbody.h>
+#include <rend/System.h>
+#include <rend/Systems/PhysicsSystem.h>
+#include <rend/Transform.h>
+
+namespace rend::systems {
+/**
+ * @brief Lowers the simulation cost of bodies that are far from all the
+ * observers. Bodies past reduced_distance become kinematic and have their
+ * velocity integrated every few frames, bodies past frozen_distance are
+ * deactivated. Both are promoted back to full simulation when an observer
+ * comes close, when they are hit or when they are about to hit a dynamic
+ * body. Reduced bodies about to hit a static body lose the part of their
+ * velocity that goes into it instead, so bodies resting on or sliding along
+ * the ground stay reduced. Run it after the PhysicsSystem update.
+ *
+ */
+struct PhysicsLODSystem : public System {
+  std::vector<const Transform *> observers; // Usually the active cameras
+  int promotion_cooldown = 60; // Frames a promoted body stays at full rate
+  // Promotion thresholds are scaled by this so bodies on the edge of a
+  // threshold don't switch levels every frame
+  float hysteresis = 0.9f;
+
+  explicit PhysicsLODSystem(PhysicsSystem &physics_system)
+      : physics_system(physics_system) {}
+
+  void update(float dt) override {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    JPH::PhysicsSystemInterface &physics_interface =
+        get_jph_physics_interface();
+    JPH::BodyInterface &body_interface =
+        physics_interface.jph_physics_system->GetBodyInterface();
+    frame++;
+
+    // Demoted bodies that were hit go back to full simulation
+    for (const rend::physics::ContactEvent &event :
+         physics_system.contact_events) {
+      if (event.type != rend::physics::ContactEvent::Type::ADDED) {
+        continue;
+      }
+      promote_on_contact(event.eid1);
+      promote_on_contact(event.eid2);
+    }
+
+    JPH::Vec3 gravity = physics_interface.jph_physics_system->GetGravity();
+    reduced_bodies.clear();
+    sphere_queries.clear();
+    box_queries.clear();
+
+    for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
+             registry.archetype_iterator<Rigidbody, Transform>();
+         rb_iterator.valid(); ++rb_iterator) {
+      rend::ECS::EID eid = *rb_iterator;
+      Rigidbody &rb = registry.get_component<Rigidbody>(eid);
+      if (rb.static_body || !rb.lod.enabled) {
+        continue;
+      }
+      if (rb.lod_cooldown > 0) {
+        rb.lod_cooldown--;
+        continue;
+      }
+
+      // Sleeping bodies cost nothing, leave them to Jolt
+      if (rb.lod_level == Rigidbody::LODLevel::FULL &&
+          !body_interface.IsActive(rb.body_id)) {
+        continue;
+      }
+
+      Transform &transform = registry.get_component<Transform>(eid);
+      Rigidbody::LODLevel level =
+          get_target_level(rb, get_observer_distance(transform.position));
+      if (level != rb.lod_level) {
+        set_level(rb, level);
+      }
+
+      int interval = std::max(1, rb.lod.update_interval);
+      if (rb.lod_level != Rigidbody::LODLevel::REDUCED ||
+          (frame + eid) % interval != 0) {
+        continue;
+      }
+
+      // Integrate the skipped frames at once and check that the body won't
+      // run into anything until the next update
+      float interval_time = dt * interval;
+      JPH::Vec3 velocity = body_interface.GetLinearVelocity(rb.body_id) +
+                           gravity * interval_time;
+      float travel = velocity.Length() * interval_time;
+      if (travel < std::numeric_limits<float>::epsilon()) {
+        continue;
+      }
+
+      // Cast the body's own shape so that the surfaces it rests on or
+      // slides along are hit with their normal
+      ReducedBody reduced{eid, jolt_to_eigen(velocity), false, 0};
+      Eigen::Vector3f origin =
+          jolt_to_eigen(body_interface.GetCenterOfMassPosition(rb.body_id));
+      Eigen::Vector3f direction = jolt_to_eigen(velocity.Normalized());
+      if (rb.primitive_type == Rigidbody::PrimitiveType::BOX) {
+        rend::physics::BoxCastQuery query;
+        query.rotation = jolt_to_eigen(body_interface.GetRotation(rb.body_id));
+        query.origin = origin;
+        query.half_extents = rb.dimensions;
+        query.direction = direction;
+        query.max_distance = travel;
+        query.ignore_eid = eid;
+        // Other reduced bodies don't react to the hit either
+        query.skip_kinematic = true;
+        reduced.box = true;
+        reduced.query_index = box_queries.size();
+        box_queries.push_back(query);
+      } else {
+        rend::physics::SphereCastQuery query;
+        query.origin = origin;
+        query.direction = direction;
+        query.radius = rb.dimensions[0];
+        query.max_distance = travel;
+        query.ignore_eid = eid;
+        query.skip_kinematic = true;
+        reduced.query_index = sphere_queries.size();
+        sphere_queries.push_back(query);
+      }
+      reduced_bodies.push_back(reduced);
+    }
+
+    physics_interface.cast(sphere_queries, sphere_hits);
+    physics_interface.cast(box_queries, box_hits);
+    for (const ReducedBody &reduced : reduced_bodies) {
+      Rigidbody &rb = registry.get_component<Rigidbody>(reduced.eid);
+      const rend::physics::QueryHit &hit =
+          reduced.box ? box_hits[reduced.query_index]
+                      : sphere_hits[reduced.query_index];
+      float max_distance =
+          reduced.box ? box_queries[reduced.query_index].max_distance
+                      : sphere_queries[reduced.query_index].max_distance;
+      Eigen::Vector3f velocity = reduced.velocity;
+      if (hit.hit) {
+        if (!is_static(hit.eid)) {
+          promote(rb);
+          continue;
+        }
+        // Reach the static body by the next update, past that only the
+        // velocity along its surface is kept
+        float approach = std::min(0.0f, velocity.dot(hit.normal));
+        velocity -= (1.0f - hit.distance / max_distance) * approach *
+                    hit.normal;
+      }
+      body_interface.SetLinearVelocity(rb.body_id, eigen_to_jolt(velocity));
+    }
+  }
+
+private:
+  PhysicsSystem &physics_system;
+  uint32_t frame = 0;
+
+  // Reduced body integrated this update and the query looking ahead of it
+  struct ReducedBody {
+    rend::ECS::EID eid;
+    Eigen::Vector3f velocity;
+    bool box; // Query is in box_queries, sphere_queries otherwise
+    uint32_t query_index;
+  };
+
+  // Reused between updates
+  std::vector<ReducedBody> reduced_bodies;
+  std::vector<rend::physics::SphereCastQuery> sphere_queries;
+  std::vector<rend::physics::BoxCastQuery> box_queries;
+  std::vector<rend::physics::QueryHit> sphere_hits;
+  std::vector<rend::physics::QueryHit> box_hits;
+
+  float get_observer_distance(const Eigen::Vector3f &position) const {
+    if (observers.empty()) {
+      return 0.0f; // Nothing to compare to, simulate everything
+    }
+    float squared_distance = std::numeric_limits<float>::max();
+    for (const Transform *observer : observers) {
+      squared_distance = std::min(
+          squared_distance, (position - observer->position).squaredNorm());
+    }
+    return std::sqrt(squared_distance);
+  }
+
+  Rigidbody::LODLevel get_target_level(const Rigidbody &rb,
+                                       float distance) const {
+    float reduced_distance = rb.lod.reduced_distance;
+    float frozen_distance = rb.lod.frozen_distance;
+    if (rb.lod_level == Rigidbody::LODLevel::FROZEN) {
+      frozen_distance *= hysteresis;
+    }
+    if (rb.lod_level != Rigidbody::LODLevel::FULL) {
+      reduced_distance *= hysteresis;
+    }
+
+    if (distance >= frozen_distance) {
+      return Rigidbody::LODLevel::FROZEN;
+    }
+    if (distance >= reduced_distance) {
+      return Rigidbody::LODLevel::REDUCED;
+    }
+    return Rigidbody::LODLevel::FULL;
+  }
+
+  static bool is_static(rend::ECS::EID eid) {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    return eid < rend::ECS::MAX_ENTITIES && registry.is_entity_enabled(eid) &&
+           registry.is_component_enabled<Rigidbody>(eid) &&
+           registry.get_component<Rigidbody>(eid).static_body;
+  }
+
+  void set_level(Rigidbody &rb, Rigidbody::LODLevel level) {
+    JPH::BodyInterface &body_interface =
+        get_jph_physics_interface().jph_physics_system->GetBodyInterface();
+
+    // Back to a dynamic body first
+    if (rb.lod_level == Rigidbody::LODLevel::REDUCED) {
+      body_interface.SetMotionType(rb.body_id, JPH::EMotionType::Dynamic,
+                                   JPH::EActivation::Activate);
+    } else if (rb.lod_level == Rigidbody::LODLevel::FROZEN &&
+               !body_interface.IsActive(rb.body_id)) {
+      // Bodies woken up by a collision already have their new velocity
+      body_interface.ActivateBody(rb.body_id);
+      body_interface.SetLinearAndAngularVelocity(
+          rb.body_id, eigen_to_jolt(rb.frozen_linear_velocity),
+          eigen_to_jolt(rb.frozen_angular_velocity));
+    }
+
+    if (level == Rigidbody::LODLevel::REDUCED) {
+      JPH::Vec3 velocity = body_interface.GetLinearVelocity(rb.body_id);
+      body_interface.SetMotionType(rb.body_id, JPH::EMotionType::Kinematic,
+                                   JPH::EActivation::Activate);
+      body_interface.SetLinearVelocity(rb.body_id, velocity);
+    } else if (level == Rigidbody::LODLevel::FROZEN) {
+      rb.frozen_linear_velocity =
+          jolt_to_eigen(body_interface.GetLinearVelocity(rb.body_id));
+      rb.frozen_angular_velocity =
+          jolt_to_eigen(body_interface.GetAngularVelocity(rb.body_id));
+      body_interface.DeactivateBody(rb.body_id);
+    }
+    rb.lod_level = level;
+  }
+
+  void promote(Rigidbody &rb) {
+    if (rb.lod_level != Rigidbody::LODLevel::FULL) {
+      set_level(rb, Rigidbody::LODLevel::FULL);
+    }
+    rb.lod_cooldown = promotion_cooldown;
+  }
+
+  void promote_on_contact(rend::ECS::EID eid) {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    if (eid >= rend::ECS::MAX_ENTITIES || !registry.is_entity_enabled(eid) ||
+        !registry.is_component_enabled<Rigidbody>(eid)) {
+      return;
+    }
+    Rigidbody &rb = registry.get_component<Rigidbody>(eid);
+    if (rb.lod_level != Rigidbody::LODLevel::FULL) {
+      promote(rb);
+    }
+  }
+};
+} // namespace rend::systems
@@ -1,7 +1,19 @@
 #pragma once
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 #include <rend/EntityRegistry.h>
+#include <rend/JobSystem.h>
+#include <rend/Physics/ContactEvents.h>
+#include <rend/Physics/PhysicsQueries.h>
+#include <rend/Physics/PhysicsSnapshot.h>
+#include <rend/Physics/AABB.h>
+#include <rend/Physics/Rigidbody.h>
 #include <rend/System.h>
-#include <rend/components.h>
+#include <rend/Transform.h>
 
 #include <Jolt/Jolt.h>
 
@@ -11,14 +23,35 @@
 
 #include <Jolt/Physics/Body/BodyActivationListener.h>
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
+#include <Jolt/Physics/Body/BodyFilter.h>
+#include <Jolt/Physics/Body/BodyLock.h>
+#include <Jolt/Physics/Collision/CastResult.h>
+#include <Jolt/Physics/Collision/CollisionCollectorImpl.h>
+#include <Jolt/Physics/Collision/NarrowPhaseQuery.h>
+#include <Jolt/Physics/Collision/RayCast.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <Jolt/Physics/Collision/Shape/SphereShape.h>
+#include <Jolt/Physics/Collision/ShapeCast.h>
 #include <Jolt/Physics/PhysicsSettings.h>
 #include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/StateRecorder.h>
 #include <Jolt/RegisterTypes.h>
 
 enum BodyType { STATIC, DYNAMIC };
 
+// Simulation limits, can be raised at configure time
+#ifndef REND_PHYSICS_MAX_BODIES
+#define REND_PHYSICS_MAX_BODIES 10240
+#endif
+
+#ifndef REND_PHYSICS_MAX_BODY_PAIRS
+#define REND_PHYSICS_MAX_BODY_PAIRS 65536
+#endif
+
+#ifndef REND_PHYSICS_MAX_CONTACT_CONSTRAINTS
+#define REND_PHYSICS_MAX_CONTACT_CONSTRAINTS 20480
+#endif
+
 namespace JPH {
 namespace Layers {
 static constexpr ObjectLayer NON_MOVING = 0;
@@ -40,28 +73,32 @@ static constexpr BroadPhaseLayer MOVING(1);
 static constexpr uint NUM_LAYERS(2);
 }; // namespace BroadPhaseLayers
 
-Vec3 eigen_to_jolt(const Eigen::Vector3f &vec) {
+inline Vec3 eigen_to_jolt(const Eigen::Vector3f &vec) {
   return Vec3{vec.x(), vec.y(), vec.z()};
 }
 
-Eigen::Vector3f jolt_to_eigen(const Vec3 &vec) {
+inline Eigen::Vector3f jolt_to_eigen(const Vec3 &vec) {
   return Eigen::Vector3f{vec.GetX(), vec.GetY(), vec.GetZ()};
 }
 
-Quat eigen_to_jolt(const Eigen::Quaternionf &quat) {
+inline Quat eigen_to_jolt(const Eigen::Quaternionf &quat) {
   return Quat{quat.x(), quat.y(), quat.z(), quat.w()};
 }
 
-Eigen::Quaternionf jolt_to_eigen(const Quat &quat) {
+inline Eigen::Quaternionf jolt_to_eigen(const Quat &quat) {
   return Eigen::Quaternionf{quat.GetW(), quat.GetX(), quat.GetY(), quat.GetZ()};
 }
 
 struct PhysicsSystemInterface {
 
-  static constexpr uint MAX_BODIES = 10240;
+  static constexpr uint MAX_BODIES = REND_PHYSICS_MAX_BODIES;
   static constexpr uint MAX_BODY_MUTEXES = 0;
-  static constexpr uint MAX_BODY_PAIRS = 65536;
-  static constexpr uint MAX_CONTACT_CONSTRAINTS = 20480;
+  static constexpr uint MAX_BODY_PAIRS = REND_PHYSICS_MAX_BODY_PAIRS;
+  static constexpr uint MAX_CONTACT_CONSTRAINTS =
+      REND_PHYSICS_MAX_CONTACT_CONSTRAINTS;
+  // Scratch memory of a single update, grows with the body count
+  static constexpr size_t TEMP_ALLOCATOR_SIZE =
+      std::max<size_t>(32 * 1024 * 1024, MAX_BODIES * 2048);
 
   /// Class that determines if two object layers can collide
   class ObjectLayerPairFilterImpl : public ObjectLayerPairFilter {
@@ -148,14 +185,39 @@ struct PhysicsSystemInterface {
   ObjectLayerPairFilterImpl
       object_vs_object_impl; // Class that filters object vs object layers
 
-  JobSystem *job_system; // The job system that runs physics jobs
+  JobSystem *job_system; // The job system that runs physics jobs, owned by
+                         // rend::get_job_system()
 
   float fixed_time_step = 1 / 100.0f; // The time step we're simulating
   float step_time_elapsed = 0.0f;     // Time since last update
 
   TempAllocatorImpl *temp_allocator;
 
+  // Unit shapes that are scaled per query so that casts don't create shapes
+  RefConst<Shape> unit_sphere_shape;
+  RefConst<Shape> unit_box_shape;
+
   std::vector<Body *> registered_bodies;
+
+  rend::physics::ContactEventStream contact_event_stream;
+
+  /// Skips the bodies of a single entity during queries, and optionally all
+  /// the kinematic ones
+  class IgnoreEntityFilter : public BodyFilter {
+  public:
+    explicit IgnoreEntityFilter(rend::ECS::EID eid, bool skip_kinematic)
+        : eid(eid), skip_kinematic(skip_kinematic) {}
+
+    virtual bool ShouldCollideLocked(const Body &inBody) const override {
+      return inBody.GetUserData() != eid &&
+             !(skip_kinematic && inBody.IsKinematic());
+    }
+
+  private:
+    uint64 eid;
+    bool skip_kinematic;
+  };
+
   PhysicsSystemInterface() {
     RegisterDefaultAllocator();
     Factory::sInstance = new Factory();
@@ -167,21 +229,24 @@ struct PhysicsSystemInterface {
     // example but it is a typical value you can use. If you don't want to
     // pre-allocate you can also use TempAllocatorMalloc to fall back to
     // malloc / free.
-    temp_allocator = new TempAllocatorImpl(32 * 1024 * 1024);
+    temp_allocator = new TempAllocatorImpl(TEMP_ALLOCATOR_SIZE);
 
     jph_physics_system = new PhysicsSystem{};
-    job_system =
-        new JobSystemThreadPool(cMaxPhysicsJobs, cMaxPhysicsBarriers, 4);
+    job_system = rend::get_job_system().thread_pool;
     jph_physics_system->Init(MAX_BODIES, MAX_BODY_MUTEXES, MAX_BODY_PAIRS,
                              MAX_CONTACT_CONSTRAINTS, broad_phase_impl,
                              object_vs_broad_impl, object_vs_object_impl);
     jph_physics_system->SetPhysicsSettings(PhysicsSettings{});
+    jph_physics_system->SetContactListener(&contact_event_stream);
+
+    unit_sphere_shape = new SphereShape(1.0f);
+    unit_box_shape = new BoxShape(Vec3::sReplicate(1.0f), 0.0f);
   }
 
   PhysicsSystemInterface(const PhysicsSystemInterface &) = delete;
 
-  void add_body(const Transform &transform, Rigidbody &rigidbody, float mass,
-                bool static_body) {
+  void add_body(rend::ECS::EID eid, const Transform &transform,
+                Rigidbody &rigidbody, float mass, bool static_body) {
     BodyInterface &body_interface = jph_physics_system->GetBodyInterface();
 
     ShapeSettings::ShapeResult body_shape_result;
@@ -203,8 +268,15 @@ struct PhysicsSystemInterface {
     body_physics_settings.mOverrideMassProperties =
         EOverrideMassProperties::CalculateInertia;
     body_physics_settings.mMassPropertiesOverride.mMass = mass;
+    body_physics_settings.mUserData = eid; // Maps query hits back to the ECS
+    // Lets the LOD system switch dynamic bodies to kinematic
+    body_physics_settings.mAllowDynamicOrKinematic = !static_body;
 
     Body *p_body = body_interface.CreateBody(body_physics_settings);
+    if (p_body == nullptr) {
+      throw std::runtime_error("Physics: Body limit reached (MAX_BODIES = " +
+                               std::to_string(MAX_BODIES) + ")");
+    }
     rigidbody.body_id = p_body->GetID();
     body_interface.AddBody(p_body->GetID(), EActivation::Activate);
 
@@ -247,14 +319,193 @@ struct PhysicsSystemInterface {
     return jolt_to_eigen(body_interface.GetRotation(body_id));
   }
 
-  ~PhysicsSystemInterface() {
+  bool is_body_active(BodyID body_id) {
+    BodyInterface &body_interface = jph_physics_system->GetBodyInterface();
+    return body_interface.IsActive(body_id);
+  }
+
+  // Moves a body and puts it to sleep, velocities are cleared the same way
+  // Jolt does when a body falls asleep
+  void set_body_sleeping(BodyID body_id, const Eigen::Vector3f &position,
+                         const Eigen::Quaternionf &rotation) {
+    BodyInterface &body_interface = jph_physics_system->GetBodyInterface();
+    body_interface.SetPositionAndRotation(body_id, eigen_to_jolt(position),
+                                          eigen_to_jolt(rotation),
+                                          EActivation::DontActivate);
+    body_interface.SetLinearAndAngularVelocity(body_id, Vec3::sZero(),
+                                               Vec3::sZero());
+    body_interface.DeactivateBody(body_id);
+  }
+
+  // Records the simulation state of the bodies filter accepts, contacts and
+  // constraints
+  void save_state(rend::physics::SnapshotRecorder &recorder,
+                  const StateRecorderFilter &filter) const {
+    recorder.clear();
+    jph_physics_system->SaveState(recorder, EStateRecorderState::All, &filter);
+  }
+
+  bool restore_state(rend::physics::SnapshotRecorder &recorder,
+                     const StateRecorderFilter &filter) {
+    recorder.rewind();
+    return jph_physics_system->RestoreState(recorder, &filter) &&
+           !recorder.IsFailed();
+  }
+
+  rend::ECS::EID get_body_eid(const Body &body) const {
+    return static_cast<rend::ECS::EID>(body.GetUserData());
+  }
+
+  // Batched queries. Every query writes its closest hit to hits[i]. Batches
+  // are spread over the job system, nothing is allocated per query. Must not
+  // be called while the physics system is updating.
+
+  void cast_rays(const rend::physics::RayQuery *queries, size_t count,
+                 rend::physics::QueryHit *hits) {
+    const NarrowPhaseQuery &narrow_phase =
+        jph_physics_system->GetNarrowPhaseQuery();
+    rend::JobSystem &jobs = rend::get_job_system();
+    jobs.parallel_for(
+        count, jobs.get_batch_size(count),
+        [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t i = begin; i < end; i++) {
+            const rend::physics::RayQuery &query = queries[i];
+            Vec3 direction =
+                eigen_to_jolt(query.direction) * query.max_distance;
+            RRayCast ray{eigen_to_jolt(query.origin), direction};
+            RayCastResult result;
+            IgnoreEntityFilter body_filter{query.ignore_eid,
+                                           query.skip_kinematic};
+
+            rend::physics::QueryHit &hit = hits[i];
+            hit = rend::physics::QueryHit{};
+            if (!narrow_phase.CastRay(ray, result, {}, {}, body_filter)) {
+              continue;
+            }
+
+            BodyLockRead lock(jph_physics_system->GetBodyLockInterface(),
+                              result.mBodyID);
+            if (!lock.Succeeded()) {
+              continue;
+            }
+            const Body &body = lock.GetBody();
+            Vec3 point = ray.GetPointOnRay(result.mFraction);
+            hit.hit = true;
+            hit.eid = get_body_eid(body);
+            hit.distance = result.mFraction * query.max_distance;
+            hit.point = jolt_to_eigen(point);
+            hit.normal = jolt_to_eigen(
+                body.GetWorldSpaceSurfaceNormal(result.mSubShapeID2, point));
+          }
+        });
+  }
+
+  void cast_spheres(const rend::physics::SphereCastQuery *queries,
+                    size_t count, rend::physics::QueryHit *hits) {
+    rend::JobSystem &jobs = rend::get_job_system();
+    jobs.parallel_for(count, jobs.get_batch_size(count),
+                      [&](uint32_t begin, uint32_t end, uint32_t) {
+                        for (uint32_t i = begin; i < end; i++) {
+                          const rend::physics::SphereCastQuery &query =
+                              queries[i];
+                          RShapeCast shape_cast{
+                              unit_sphere_shape,
+                              Vec3::sReplicate(query.radius),
+                              RMat44::sTranslation(
+                                  eigen_to_jolt(query.origin)),
+                              eigen_to_jolt(query.direction) *
+                                  query.max_distance};
+                          cast_shape(shape_cast, query.max_distance,
+                                     query.ignore_eid, query.skip_kinematic,
+                                     hits[i]);
+                        }
+                      });
+  }
+
+  void cast_boxes(const rend::physics::BoxCastQuery *queries, size_t count,
+                  rend::physics::QueryHit *hits) {
+    rend::JobSystem &jobs = rend::get_job_system();
+    jobs.parallel_for(
+        count, jobs.get_batch_size(count),
+        [&](uint32_t begin, uint32_t end, uint32_t) {
+          for (uint32_t i = begin; i < end; i++) {
+            const rend::physics::BoxCastQuery &query = queries[i];
+            RShapeCast shape_cast{
+                unit_box_shape, eigen_to_jolt(query.half_extents),
+                RMat44::sRotationTranslation(eigen_to_jolt(query.rotation),
+                                             eigen_to_jolt(query.origin)),
+                eigen_to_jolt(query.direction) * query.max_distance};
+            cast_shape(shape_cast, query.max_distance, query.ignore_eid,
+                       query.skip_kinematic, hits[i]);
+          }
+        });
+  }
+
+  // Vector versions, hits are resized to match the queries
+  template <typename Query>
+  void cast(const std::vector<Query> &queries,
+            std::vector<rend::physics::QueryHit> &hits) {
+    hits.resize(queries.size());
+    if constexpr (std::is_same_v<Query, rend::physics::RayQuery>) {
+      cast_rays(queries.data(), queries.size(), hits.data());
+    } else if constexpr (std::is_same_v<Query,
+                                        rend::physics::SphereCastQuery>) {
+      cast_spheres(queries.data(), queries.size(), hits.data());
+    } else {
+      static_assert(std::is_same_v<Query, rend::physics::BoxCastQuery>,
+                    "Unsupported query type");
+      cast_boxes(queries.data(), queries.size(), hits.data());
+    }
+  }
+
+  void cast_shape(const RShapeCast &shape_cast, float max_distance,
+                  rend::ECS::EID ignore_eid, bool skip_kinematic,
+                  rend::physics::QueryHit &hit) {
+    const NarrowPhaseQuery &narrow_phase =
+        jph_physics_system->GetNarrowPhaseQuery();
+    ClosestHitCollisionCollector<CastShapeCollector> collector;
+    IgnoreEntityFilter body_filter{ignore_eid, skip_kinematic};
+    narrow_phase.CastShape(shape_cast, ShapeCastSettings{}, RVec3::sZero(),
+                           collector, {}, {}, body_filter);
+
+    hit = rend::physics::QueryHit{};
+    if (!collector.HadHit()) {
+      return;
+    }
+
+    const ShapeCastResult &result = collector.mHit;
+    hit.hit = true;
+    hit.eid = static_cast<rend::ECS::EID>(
+        jph_physics_system->GetBodyInterface().GetUserData(result.mBodyID2));
+    hit.distance = result.mFraction * max_distance;
+    hit.point = jolt_to_eigen(result.mContactPointOn2);
+    hit.normal = jolt_to_eigen(-result.mPenetrationAxis.NormalizedOr(
+        -shape_cast.mDirection.NormalizedOr(Vec3::sAxisY())));
+  }
+
+  // Collects the contact events recorded since the last call
+  void drain_contact_events(std::vector<rend::physics::ContactEvent> &events) {
+    contact_event_stream.drain(jph_physics_system->GetBodyLockInterfaceNoLock(),
+                               events);
+  }
+
+  // Removes all the bodies so that a new scene can be simulated
+  void clear() {
     BodyInterface &body_interface = jph_physics_system->GetBodyInterface();
     for (Body *body : registered_bodies) {
       BodyID body_id = body->GetID();
       body_interface.RemoveBody(body_id);
       body_interface.DestroyBody(body_id);
     }
-    delete job_system;
+    registered_bodies.clear();
+    step_time_elapsed = 0.0f;
+
+    std::vector<rend::physics::ContactEvent> discarded_events;
+    drain_contact_events(discarded_events);
+  }
+
+  ~PhysicsSystemInterface() {
+    clear();
     delete temp_allocator;
     delete jph_physics_system;
     UnregisterTypes();
@@ -263,13 +514,17 @@ struct PhysicsSystemInterface {
 };
 } // namespace JPH
 
-JPH::PhysicsSystemInterface &get_jph_physics_interface() {
+inline JPH::PhysicsSystemInterface &get_jph_physics_interface() {
   static JPH::PhysicsSystemInterface interface {};
   return interface;
 }
 
 namespace rend::systems {
 struct PhysicsSystem : public System {
+  // Contacts of the last update, refreshed by sync_transforms
+  std::vector<rend::physics::ContactEvent> contact_events;
+  uint32_t dropped_contact_events = 0; // Didn't fit into the event rings
+
   // Go through all the bodies and add them to the JPH physics system
   void init() {
     rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
@@ -282,50 +537,156 @@ struct PhysicsSystem : public System {
       rend::ECS::EID eid = *rb_iterator;
       Rigidbody &rb = registry.get_component<Rigidbody>(eid);
       Transform &transform = registry.get_component<Transform>(eid);
-      physics_interface.add_body(transform, rb, rb.mass, rb.static_body);
+      physics_interface.add_body(eid, transform, rb, rb.mass, rb.static_body);
+      // sync_transforms only updates the bounds of bodies that moved,
+      // static ones never do
+      if (registry.is_component_enabled<AABB>(eid)) {
+        update_global_aabb(registry.get_component<AABB>(eid), transform);
+      }
     }
+    // Bodies were added one by one, rebuild the broadphase trees once
+    physics_interface.jph_physics_system->OptimizeBroadPhase();
   }
 
-  virtual void update(float dt) {
+  // Saves the simulation and the components it drives into snapshot. Only
+  // the bodies that are active or were changed since the previous save into
+  // snapshot are recorded, the snapshot's buffers are reused so rolling saves
+  // don't allocate
+  void save_state(rend::physics::PhysicsSnapshot &snapshot) {
     rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
-    // Update JPH physics system
     JPH::PhysicsSystemInterface &physics_interface =
         get_jph_physics_interface();
-    JPH::BodyInterface &body_manager =
-        physics_interface.jph_physics_system->GetBodyInterface();
-    physics_interface.update(dt);
-    // Update transforms
+
+    snapshot.recorded.reset();
     for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
              registry.archetype_iterator<Rigidbody, Transform>();
          rb_iterator.valid(); ++rb_iterator) {
-
       rend::ECS::EID eid = *rb_iterator;
       Rigidbody &rb = registry.get_component<Rigidbody>(eid);
-      Transform &transform = registry.get_component<Transform>(eid);
+      if (rb.static_body) {
+        continue;
+      }
+      // Bodies asleep and untouched since the previous save are still in the
+      // state the snapshot has for them
+      rend::physics::PhysicsSnapshot::SavedBody &saved = snapshot.bodies[eid];
+      if (snapshot.saved.test(eid) && saved.rigidbody.body_id == rb.body_id &&
+          registry.get_change_version<Transform>(eid) <=
+              snapshot.change_version &&
+          !physics_interface.is_body_active(rb.body_id)) {
+        continue;
+      }
+      saved.transform = registry.get_component<Transform>(eid);
+      saved.rigidbody = rb;
+      snapshot.saved.set(eid);
+      snapshot.recorded.set(eid);
+    }
 
-      if (registry.is_component_enabled<AABB>(eid)) {
-        AABB &aabb = registry.get_component<AABB>(eid);
-        { // Update global frame AABBs
-          Eigen::Matrix<float, 8, 4> vertices =
-              (transform.get_model_matrix() *
-               get_local_aabb_vertices(aabb).transpose())
-                  .transpose();
-          std::pair<Eigen::Vector3f, Eigen::Vector3f> span =
-              compute_span(vertices.block<8, 3>(0, 0));
-          aabb.min_global = span.first;
-          aabb.max_global = span.second;
+    physics_interface.save_state(
+        snapshot.recorder,
+        rend::physics::RecordedBodiesFilter{snapshot.recorded});
+    snapshot.step_time_elapsed = physics_interface.step_time_elapsed;
+    snapshot.change_version = registry.change_version;
+    snapshot.valid = true;
+  }
+
+  // Rolls the simulation back to snapshot. Entities must not have been added
+  // or removed since the snapshot was taken
+  bool restore_state(rend::physics::PhysicsSnapshot &snapshot) {
+    if (!snapshot.valid) {
+      return false;
+    }
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    JPH::PhysicsSystemInterface &physics_interface =
+        get_jph_physics_interface();
+
+    if (!physics_interface.restore_state(
+            snapshot.recorder,
+            rend::physics::RecordedBodiesFilter{snapshot.recorded})) {
+      return false;
+    }
+    physics_interface.step_time_elapsed = snapshot.step_time_elapsed;
+
+    for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
+             registry.archetype_iterator<Rigidbody, Transform>();
+         rb_iterator.valid(); ++rb_iterator) {
+      rend::ECS::EID eid = *rb_iterator;
+      if (!snapshot.saved.test(eid)) {
+        continue;
+      }
+      const rend::physics::PhysicsSnapshot::SavedBody &saved =
+          snapshot.bodies[eid];
+      if (!snapshot.recorded.test(eid)) {
+        // Was asleep when saved, only bodies that moved or woke up since
+        // have to be put back
+        if (registry.get_change_version<Transform>(eid) <=
+                snapshot.change_version &&
+            !physics_interface.is_body_active(saved.rigidbody.body_id)) {
+          continue;
         }
+        physics_interface.set_body_sleeping(
+            saved.rigidbody.body_id,
+            saved.transform.position -
+                saved.transform.rotation * saved.rigidbody.com_offset,
+            saved.transform.rotation);
       }
 
-      Renderer &renderer = get_renderer();
+      Transform &transform = registry.get_component<Transform>(eid);
+      transform = saved.transform;
+      registry.get_component<Rigidbody>(eid) = saved.rigidbody;
+      registry.mark_changed<Transform>(eid);
+      if (registry.is_component_enabled<AABB>(eid)) {
+        update_global_aabb(registry.get_component<AABB>(eid), transform);
+      }
+    }
+    return true;
+  }
+
+  // Advances the simulation by dt in fixed steps
+  void step(float dt) { get_jph_physics_interface().update(dt); }
+
+  // Copies the simulated bodies and their contacts back into the ECS
+  void sync_transforms() {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    JPH::PhysicsSystemInterface &physics_interface =
+        get_jph_physics_interface();
+
+    contact_events.clear();
+    physics_interface.drain_contact_events(contact_events);
+    dropped_contact_events =
+        physics_interface.contact_event_stream.take_dropped_count();
+
+    for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
+             registry.archetype_iterator<Rigidbody, Transform>();
+         rb_iterator.valid(); ++rb_iterator) {
+
+      rend::ECS::EID eid = *rb_iterator;
+      Rigidbody &rb = registry.get_component<Rigidbody>(eid);
+      Transform &transform = registry.get_component<Transform>(eid);
 
-      transform.position = physics_interface.get_body_position(rb.body_id) +
-                           transform.rotation * rb.com_offset;
-      transform.rotation = physics_interface.get_body_orientation(rb.body_id);
+      Eigen::Quaternionf rotation =
+          physics_interface.get_body_orientation(rb.body_id);
+      Eigen::Vector3f position =
+          physics_interface.get_body_position(rb.body_id) +
+          transform.rotation * rb.com_offset;
+      // Sleeping and static bodies don't move, keep their change version so
+      // cached results of other systems stay valid
+      if (position == transform.position &&
+          rotation.coeffs() == transform.rotation.coeffs()) {
+        continue;
+      }
+      transform.position = position;
+      transform.rotation = rotation;
+      registry.mark_changed<Transform>(eid);
 
-      renderer.draw_debug_sphere(transform.position, 1.0f, 8,
-                                 Eigen::Vector3f{1.0f, 0.0f, 0.0f});
+      if (registry.is_component_enabled<AABB>(eid)) {
+        update_global_aabb(registry.get_component<AABB>(eid), transform);
+      }
     }
   }
+
+  virtual void update(float dt) {
+    step(dt);
+    sync_transforms();
+  }
 };
 } // namespace rend::systems
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include <rend/Physics/AABB.h>
+#include <rend/Physics/AABBTree.h>
+#include <rend/Physics/Rigidbody.h>
+#include <rend/System.h>
+#include <rend/Transform.h>
+
+namespace rend::systems {
+/**
+ * @brief Keeps the global AABBs of all entities in a static and a dynamic
+ * AABBTree so that spatial queries don't have to go through every entity.
+ * Entities with a static Rigidbody go into the static tree, everything else
+ * into the dynamic one. Global bounds of entities without a Rigidbody are
+ * computed here, the PhysicsSystem updates the rest, so run it after the
+ * physics update. Only entities whose Transform or AABB changed since the
+ * last update are refitted, mark the AABB changed after editing its local
+ * bounds.
+ *
+ */
+struct SpatialIndexSystem : public System {
+  rend::physics::AABBTree static_tree;
+  rend::physics::AABBTree dynamic_tree;
+
+  SpatialIndexSystem()
+      : proxies(rend::ECS::MAX_ENTITIES, rend::physics::AABBTree::NULL_NODE),
+        is_static(rend::ECS::MAX_ENTITIES, false),
+        last_seen(rend::ECS::MAX_ENTITIES, 0),
+        versions(rend::ECS::MAX_ENTITIES, 0) {}
+
+  void update(float dt) override {
+    rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+    frame++;
+
+    for (rend::ECS::EntityRegistry::ArchetypeIterator iterator =
+             registry.archetype_iterator<AABB, Transform>();
+         iterator.valid(); ++iterator) {
+      rend::ECS::EID eid = *iterator;
+      last_seen[eid] = frame;
+      bool static_entity = registry.is_component_enabled<Rigidbody>(eid) &&
+                           registry.get_component<Rigidbody>(eid).static_body;
+      bool was_indexed = proxies[eid] != rend::physics::AABBTree::NULL_NODE;
+      uint64_t version =
+          std::max(registry.get_change_version<Transform>(eid),
+                   registry.get_change_version<AABB>(eid));
+      if (was_indexed && is_static[eid] == static_entity &&
+          versions[eid] == version) {
+        continue; // Unchanged since the last update
+      }
+      versions[eid] = version;
+
+      AABB &aabb = registry.get_component<AABB>(eid);
+      if (!registry.is_component_enabled<Rigidbody>(eid)) {
+        update_global_aabb(aabb, registry.get_component<Transform>(eid));
+      }
+
+      rend::physics::Bounds bounds{aabb.min_global, aabb.max_global};
+      if (was_indexed && is_static[eid] != static_entity) {
+        remove(eid); // Moved between the trees, still in indexed
+      }
+      if (proxies[eid] == rend::physics::AABBTree::NULL_NODE) {
+        proxies[eid] = get_tree(static_entity).insert(eid, bounds);
+        is_static[eid] = static_entity;
+        if (!was_indexed) {
+          indexed.push_back(eid);
+        }
+        continue;
+      }
+      get_tree(static_entity).update(proxies[eid], bounds);
+    }
+
+    // Drop the entities that lost their AABB or were removed
+    indexed.erase(std::remove_if(indexed.begin(), indexed.end(),
+                                 [&](rend::ECS::EID eid) {
+                                   if (last_seen[eid] == frame) {
+                                     return false;
+                                   }
+                                   remove(eid);
+                                   return true;
+                                 }),
+                  indexed.end());
+
+    static_tree.rebuild_if_degraded();
+    dynamic_tree.rebuild_if_degraded();
+  }
+
+  void query_box(const rend::physics::Bounds &bounds,
+                 std::vector<rend::ECS::EID> &result) const {
+    static_tree.query_box(bounds, result);
+    dynamic_tree.query_box(bounds, result);
+  }
+
+  void query_frustum(const rend::physics::Frustum &frustum,
+                     std::vector<rend::ECS::EID> &result) const {
+    static_tree.query_frustum(frustum, result);
+    dynamic_tree.query_frustum(frustum, result);
+  }
+
+  // Hits of both trees, sorted by distance
+  void query_ray(const Eigen::Vector3f &origin,
+                 const Eigen::Vector3f &direction, float max_distance,
+                 std::vector<rend::physics::AABBTree::Hit> &result) const {
+    size_t first = result.size();
+    static_tree.query_ray(origin, direction, max_distance, result);
+    size_t middle = result.size();
+    dynamic_tree.query_ray(origin, direction, max_distance, result);
+    std::inplace_merge(result.begin() + first, result.begin() + middle,
+                       result.end(), closer);
+  }
+
+  void query_nearest(const Eigen::Vector3f &point, size_t k,
+                     std::vector<rend::physics::AABBTree::Hit> &result) const {
+    size_t first = result.size();
+    static_tree.query_nearest(point, k, result);
+    size_t middle = result.size();
+    dynamic_tree.query_nearest(point, k, result);
+    std::inplace_merge(result.begin() + first, result.begin() + middle,
+                       result.end(), closer);
+    result.resize(std::min(result.size(), first + k));
+  }
+
+private:
+  std::vector<int> proxies; // Per entity, NULL_NODE if not indexed
+  std::vector<bool> is_static;
+  std::vector<uint32_t> last_seen;
+  // Per entity, change version of its Transform or AABB when it was indexed
+  std::vector<uint64_t> versions;
+  std::vector<rend::ECS::EID> indexed; // Every indexed entity once
+  uint32_t frame = 0;
+
+  static bool closer(const rend::physics::AABBTree::Hit &a,
+                     const rend::physics::AABBTree::Hit &b) {
+    return a.distance < b.distance;
+  }
+
+  rend::physics::AABBTree &get_tree(bool static_entity) {
+    return static_entity ? static_tree : dynamic_tree;
+  }
+
+  void remove(rend::ECS::EID eid) {
+    get_tree(is_static[eid]).remove(proxies[eid]);
+    proxies[eid] = rend::physics::AABBTree::NULL_NODE;
+  }
+};
+} // namespace rend::systems
@@ -1,26 +1,4 @@
 #pragma once
-#include <iostream>
-#include <vulkan/vulkan.h>
-
-static void VK_CHECK(VkResult err) {
-  if (err == 0) {
-    return;
-  }
-  fprintf(stderr, "[vulkan] Error: VkResult = %d\n", err);
-  if (err < 0) {
-    abort();
-  }
-}
-
-static void VK_CHECK(VkResult err, const char *msg) {
-  if (err == 0) {
-    return;
-  }
-  fprintf(stderr, "[vulkan] Error: VkResult = %d\n %s", err, msg);
-  if (err < 0) {
-    abort();
-  }
-}
 
 #define CLAMP(x, low, high)                                                    \
   (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
@@ -32,4 +10,6 @@ static void VK_CHECK(VkResult err, const char *msg) {
   template bool EntityRegistry::is_component_enabled<T>(EID id);               \
   template T &EntityRegistry::add_component<T>(EID id);                        \
   template void EntityRegistry::remove_component<T>(EID id);                   \
-  template T &EntityRegistry::get_component<T>(EID id);
+  template T &EntityRegistry::get_component<T>(EID id);                        \
+  template void EntityRegistry::mark_changed<T>(EID id);                       \
+  template uint64_t EntityRegistry::get_change_version<T>(EID id);
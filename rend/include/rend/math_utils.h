@@ -42,18 +42,18 @@ inline Eigen::Matrix4f get_projection_matrix(float fov, float aspect,
 
 inline Eigen::Matrix4f get_view_matrix(Eigen::Vector3f position,
                                        Eigen::Vector3f forward) {
-  Eigen::Matrix4f model = Eigen::Matrix4f::Identity();
   Eigen::Vector3f forward_normalized = forward.normalized();
   Eigen::Vector3f right =
       Eigen::Vector3f::UnitY().cross(forward_normalized).normalized();
   Eigen::Vector3f up = forward_normalized.cross(right).normalized();
 
-  model.block<3, 1>(0, 0) = right;
-  model.block<3, 1>(0, 1) = -up;
-  model.block<3, 1>(0, 2) = -forward_normalized;
-  model.block<3, 1>(0, 3) = position;
-
-  return model.inverse();
+  // Inverse of the camera's rigid transform, the rotation is transposed
+  Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+  view.block<1, 3>(0, 0) = right.transpose();
+  view.block<1, 3>(1, 0) = -up.transpose();
+  view.block<1, 3>(2, 0) = -forward_normalized.transpose();
+  view.block<3, 1>(0, 3) = -view.block<3, 3>(0, 0) * position;
+  return view;
 }
 
 inline float rand_float(float min, float max) {
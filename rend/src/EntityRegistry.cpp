@@ -1,34 +1,11 @@
-#include <rend/EntityRegistry.h>
+#include <rend/EntityRegistryImpl.h>
+#include <rend/Physics/AABB.h>
+#include <rend/Physics/CharacterController.h>
+#include <rend/Physics/Rigidbody.h>
+#include <rend/Transform.h>
 
 namespace rend::ECS {
 
-template <typename T> void EntityRegistry::register_component() {
-  if (registered_component_count >= MAX_COMPONENTS) {
-    throw std::runtime_error("ECS: Too many components registered");
-  }
-
-  size_t hash = typeid(T).hash_code();
-  const auto &index_iterator = component_indices.find(hash);
-  if (index_iterator != component_indices.end()) {
-    std::cerr << "ECS: Component already registered" << std::endl;
-    return;
-  }
-  int component_index = registered_component_count++;
-  component_indices.insert({hash, component_index});
-  typename ComponentPool<T>::Ptr pool = std::make_shared<ComponentPool<T>>();
-  component_pools[component_index] =
-      std::make_any<typename ComponentPool<T>::Ptr>(pool);
-}
-
-template <typename T> int EntityRegistry::get_component_index() {
-  const auto &index_iterator = component_indices.find(typeid(T).hash_code());
-  if (index_iterator == component_indices.end()) {
-    throw std::runtime_error(std::string("ECS: Component not registered: ") +
-                             typeid(T).name());
-  }
-  return index_iterator->second;
-}
-
 bool EntityRegistry::is_entity_enabled(EID id) {
   return component_rows[MAX_COMPONENTS].mask.test(id);
 }
@@ -37,73 +14,19 @@ bool EntityRegistry::is_component_enabled(EID id, int component_index) {
   return component_rows[component_index].mask.test(id);
 }
 
-template <typename T> bool EntityRegistry::is_component_registered() {
-  return component_indices.find(typeid(T).hash_code()) !=
-         component_indices.end();
-}
-
-template <typename T> bool EntityRegistry::is_component_enabled(EID id) {
-  int component_index = get_component_index<T>();
-  if (id >= MAX_ENTITIES) {
-    throw std::runtime_error("ECS: Entity ID out of range");
-  }
-  if (!is_entity_enabled(id)) {
-    throw std::runtime_error("ECS: Entity not registered");
-  }
-
-  return is_component_enabled(id, component_index);
-}
-
-template <typename T> T &EntityRegistry::add_component(EID id) {
-  if (id >= MAX_ENTITIES) {
-    throw std::runtime_error("ECS: Entity ID out of range");
-  }
-
-  int component_index = get_component_index<T>();
-  if (is_component_enabled(id, component_index)) {
-    throw std::runtime_error(
-        "ECS: Component already registered for entity EID " +
-        std::to_string(id));
-  }
-
-  if (!std::any_cast<typename ComponentPool<T>::Ptr>(
-          component_pools[component_index])) {
-    throw std::runtime_error(
-        "ECS: Component pool not initialized for component " +
-        std::string{typeid(T).name()});
-  }
-
-  typename ComponentPool<T>::Ptr pool =
-      std::any_cast<typename ComponentPool<T>::Ptr>(
-          component_pools[component_index]);
-  pool->components[id] = T{}; // Default construct component
-  component_rows[component_index].mask.flip(id);
-  return pool->components[id];
-}
-
-template <typename T> void EntityRegistry::remove_component(EID id) {
-  int component_index = get_component_index<T>();
-
-  if (is_component_enabled(id, component_index)) {
-    std::cerr << "ECS: Component not registered for entity EID" << id
-              << std::endl;
-  }
-
-  component_rows[component_index].mask.flip(id);
-}
-
 EID EntityRegistry::register_entity() {
   if (registered_entities.size() >= MAX_ENTITIES) {
     throw std::runtime_error("ECS: Too many entities registered");
   }
   EID new_id = get_available_id();
+  first_available_id = new_id + 1;
   registered_entities.insert(new_id);
   component_rows[MAX_COMPONENTS].mask.flip(new_id);
   return new_id;
 }
 
 EID EntityRegistry::get_available_id() {
-  for (int id = 0; id < MAX_ENTITIES; id++) {
+  for (int id = first_available_id; id < MAX_ENTITIES; id++) {
     if (!is_entity_enabled(id)) {
       return id;
     }
@@ -117,27 +40,12 @@ void EntityRegistry::remove_entity(EID id) {
   }
 
   for (int component_id = 0; component_id < MAX_COMPONENTS; component_id++) {
-    if (is_component_enabled(id, component_id)) {
-      component_pools[component_id].reset();
-      component_rows[component_id].mask.reset(id);
-    }
+    // Pools are shared by all entities, only the entity's row is cleared
+    component_rows[component_id].mask.reset(id);
   }
   component_rows[MAX_COMPONENTS].mask.reset(id);
   registered_entities.erase(id);
-}
-
-template <typename T> T &EntityRegistry::get_component(EID id) {
-  int component_index = get_component_index<T>();
-
-  if (!is_component_enabled(id, component_index)) {
-    throw std::runtime_error("ECS: Component not registered for entity EID " +
-                             std::to_string(id));
-  }
-  typename ComponentPool<T>::Ptr pool =
-      std::any_cast<typename ComponentPool<T>::Ptr>(
-          component_pools[component_index]);
-
-  return pool->components[id];
+  first_available_id = std::min(first_available_id, id);
 }
 
 EntityRegistry &get_entity_registry() {
@@ -156,8 +64,7 @@ EntityRegistry::ArchetypeIterator::ArchetypeIterator(
     std::function<bool(EID)> predicate) {
   this->predicate = predicate;
   registered_iterator = get_entity_registry().registered_entities.begin();
-  current_id = *registered_iterator;
-  registered_iterator++;
+  find_next(); // The first entity has to match the predicate as well
 }
 
 void EntityRegistry::ArchetypeIterator::find_next() {
@@ -188,9 +95,10 @@ bool EntityRegistry::ArchetypeIterator::valid() {
   return current_id != rend::ECS::MAX_ENTITIES;
 }
 
+// Renderer components are registered by the renderer library
 REGISTER_COMPONENT(Transform);
-REGISTER_COMPONENT(Renderable);
 REGISTER_COMPONENT(AABB);
 REGISTER_COMPONENT(Rigidbody);
+REGISTER_COMPONENT(CharacterController);
 
 } // namespace rend::ECS
@@ -0,0 +1,6 @@
+#include <rend/EntityRegistryImpl.h>
+#include <rend/Light.h>
+
+namespace rend::ECS {
+REGISTER_COMPONENT(Light);
+} // namespace rend::ECS
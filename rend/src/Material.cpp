@@ -6,8 +6,10 @@ Material::Material(MaterialSpec spec) : spec(spec) {}
 
 void Material::build(VkDevice &device, VkDescriptorPool &descriptor_pool,
                      VkRenderPass &render_pass, const VkExtent2D &window_dims,
-                     Deallocator &deallocation_queue) {
-  ds_allocator.init(spec.bindings, device, descriptor_pool);
+                     Deallocator &deallocation_queue, uint32_t frame_count,
+                     VkPipelineCache pipeline_cache) {
+  ds_allocator.init(spec.bindings, device, descriptor_pool, frame_count,
+                    spec.shared_sets);
   deallocation_queue.push([&]() { ds_allocator.destroy(descriptor_pool); });
 
   if (spec.vert_shader.native().size() != 0 &&
@@ -24,7 +26,8 @@ void Material::build(VkDevice &device, VkDescriptorPool &descriptor_pool,
       device, render_pass, shader, pipeline_layout,
       get_vertex_info_description(spec.input_attributes, spec.vertex_stride),
       spec.topology_type, pipeline, spec.color_attachment_count,
-      spec.depth_test_enabled, spec.blend_test_enabled);
+      spec.depth_test_enabled, spec.blend_test_enabled, spec.viewport_count,
+      spec.specialization_constants, pipeline_cache);
 
   deallocation_queue.push([=] {
     vkDestroyPipeline(device, pipeline, nullptr);
@@ -1,3 +1,4 @@
+#include <rend/Physics/AABB.h>
 #include <rend/Rendering/Vulkan/Mesh.h>
 
 Mesh::Mesh(Path path) {
@@ -62,3 +63,27 @@ void Mesh::generate_allocation_buffer(VmaAllocator &allocator,
   buffer_allocation.copy_from(_vertices.data(),
                               _vertices.size() * sizeof(float));
 }
+
+AABB::AABB(const Mesh &mesh) {
+  min_local.setZero();
+  max_local.setZero();
+  min_global.setZero();
+  max_global.setZero();
+  if (mesh.vertex_count() > 0) {
+    min_local = mesh.get_vertex_pos(0);
+    max_local = mesh.get_vertex_pos(0);
+
+    // Model space coords
+    for (int v_idx = 0; v_idx < mesh.vertex_count(); v_idx++) {
+      Eigen::Vector3f vertex_pos = mesh.get_vertex_pos(v_idx);
+      for (int i = 0; i < 3; i++) {
+        if (vertex_pos(i) < min_local(i)) {
+          min_local(i) = vertex_pos(i);
+        }
+        if (vertex_pos(i) > max_local(i)) {
+          max_local(i) = vertex_pos(i);
+        }
+      }
+    }
+  }
+}
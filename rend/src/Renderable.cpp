@@ -0,0 +1,6 @@
+#include <rend/EntityRegistryImpl.h>
+#include <rend/Rendering/Vulkan/Renderable.h>
+
+namespace rend::ECS {
+REGISTER_COMPONENT(Renderable);
+} // namespace rend::ECS
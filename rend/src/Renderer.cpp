@@ -1,7 +1,13 @@
 #include <rend/Rendering/Vulkan/Renderer.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <tuple>
 
 #include <imgui.h>
 #include <rend/GUI.h>
+#include <rend/JobSystem.h>
+#include <rend/TimeUtils.h>
 
 #include <backends/imgui_impl_sdl2.h>
 #include <backends/imgui_impl_vulkan.h>
@@ -11,15 +17,16 @@ namespace rend {
 Renderer::Renderer() {
   camera = std::make_unique<Camera>(
       90.f, _window_dims.width / _window_dims.height, 0.1f, 200.0f);
-  lights.resize(MAX_LIGHTS);
 }
 
 void Renderer::cleanup() {
   if (!_initialized)
     return;
 
-  // Wait for the command queue to complete if still running
-  vkWaitForFences(_device, 1, &_command_complete_fence, VK_TRUE, 1000000000);
+  // Wait for the frames in flight to complete
+  vkDeviceWaitIdle(_device);
+  // Includes the pipelines compiled during this run
+  _pipeline_cache.save();
   ImGui_ImplVulkan_Shutdown();
   ImGui_ImplSDL2_Shutdown();
   ImGui::DestroyContext();
@@ -27,6 +34,10 @@ void Renderer::cleanup() {
 }
 
 void Renderer::init() {
+  if (frames_in_flight == 0) {
+    throw std::runtime_error("At least one frame in flight is required");
+  }
+  rend::time::TimePoint init_start = rend::time::now();
   _window = SDL_CreateWindow("rend", SDL_WINDOWPOS_CENTERED,
                              SDL_WINDOWPOS_CENTERED, _window_dims.width,
                              _window_dims.height, SDL_WINDOW_VULKAN);
@@ -39,6 +50,7 @@ void Renderer::init() {
   }
 
   init_vulkan();
+  init_pipeline_cache();
   init_swapchain();
   init_z_buffer();
   init_cmd_buffer();
@@ -46,12 +58,20 @@ void Renderer::init() {
   init_framebuffers();
   init_sync_primitives();
   init_descriptor_pool();
+  init_texture_heap();
   init_debug_renderable();
+  rend::time::TimePoint pipelines_start = rend::time::now();
   init_shadow_pass();
   init_deferred_pass();
   init_screenspace_pass();
   init_shading_pass();
+  init_reflection_passes();
   init_materials();
+  rend::time::TimePoint pipelines_end = rend::time::now();
+  init_ring_bindings();
+  init_frame_materials();
+  bind_upload_ring();
+  bind_fullscreen_inputs();
 
   // Setup Dear ImGui context
   IMGUI_CHECKVERSION();
@@ -70,10 +90,13 @@ void Renderer::init() {
   init_info.DescriptorPool = _descriptor_pool;
   init_info.Subpass = 0;
   init_info.MinImageCount = 2;
-  init_info.ImageCount = 2;
+  // Vertex buffers of a frame are reused after ImageCount frames
+  init_info.ImageCount = std::max<uint32_t>(composite_pass.images.size(),
+                                            frames_in_flight);
   init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
   init_info.Allocator = _allocation_callbacks;
   init_info.CheckVkResultFn = VK_CHECK;
+  init_info.PipelineCache = _pipeline_cache.cache;
 
   ImGui_ImplVulkan_Init(&init_info, composite_pass.render_pass);
 
@@ -81,11 +104,37 @@ void Renderer::init() {
   ImGui_ImplVulkan_CreateFontsTexture(_command_buffer);
   end_one_time_submit();
   ImGui_ImplVulkan_DestroyFontUploadObjects();
+  // Cleanup is skipped otherwise and the pipeline cache is never saved
+  _initialized = true;
+
+  rend::time::TimePoint init_end = rend::time::now();
+  startup_timings.total_ms =
+      rend::time::time_difference<rend::time::Microseconds>(init_start,
+                                                            init_end) *
+      0.001f;
+  startup_timings.pipelines_ms =
+      rend::time::time_difference<rend::time::Microseconds>(pipelines_start,
+                                                            pipelines_end) *
+      0.001f;
+  startup_timings.pipeline_cache_loaded = _pipeline_cache.was_loaded();
+  std::cout << "Renderer initialized in " << startup_timings.total_ms
+            << " ms, passes and pipelines " << startup_timings.pipelines_ms
+            << " ms, pipeline cache "
+            << (startup_timings.pipeline_cache_loaded ? "loaded" : "cold")
+            << std::endl;
+}
+
+void Renderer::init_pipeline_cache() {
+  _pipeline_cache.init(_device, _physical_device, pipeline_cache_path);
+  _deallocation_queue.push([&] { _pipeline_cache.destroy(); });
 }
 
 void Renderer::init_vulkan() {
   vkb::InstanceBuilder builder;
+  // Features2 queries and descriptor indexing need 1.1, it also makes
+  // VK_KHR_maintenance3 core, which descriptor indexing depends on
   vkb::Result<vkb::Instance> inst_ret = builder.set_app_name("rend")
+                                            .require_api_version(1, 1, 0)
                                             .request_validation_layers()
                                             .use_default_debug_messenger()
                                             .build();
@@ -105,10 +154,69 @@ void Renderer::init_vulkan() {
   SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
 
   vkb::PhysicalDeviceSelector selector{vkb_inst};
-  vkb::PhysicalDevice vkb_physical_device =
-      selector.set_minimum_version(1, 1).set_surface(_surface).select().value();
+  // Bindless texture heap
+  selector.set_minimum_version(1, 1)
+      .set_surface(_surface)
+      .add_required_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+  vkb::PhysicalDevice vkb_physical_device = selector.select().value();
+
+  // Layered shadows need gl_ViewportIndex in the vertex shader
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(vkb_physical_device.physical_device,
+                              &supported_features);
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(vkb_physical_device.physical_device,
+                                       nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> extensions(extension_count);
+  vkEnumerateDeviceExtensionProperties(vkb_physical_device.physical_device,
+                                       nullptr, &extension_count,
+                                       extensions.data());
+  bool viewport_index_supported = false;
+  for (const VkExtensionProperties &extension : extensions) {
+    if (strcmp(extension.extensionName,
+               VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME) == 0) {
+      viewport_index_supported = true;
+    }
+  }
+  _layered_shadows = supported_features.multiViewport &&
+                     viewport_index_supported;
+  if (_layered_shadows) {
+    VkPhysicalDeviceFeatures required_features{};
+    required_features.multiViewport = VK_TRUE;
+    vkb_physical_device =
+        selector.set_required_features(required_features)
+            .add_required_extension(
+                VK_EXT_SHADER_VIEWPORT_INDEX_LAYER_EXTENSION_NAME)
+            .select()
+            .value();
+  }
+
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features{};
+  indexing_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &indexing_features;
+  vkGetPhysicalDeviceFeatures2(vkb_physical_device.physical_device, &features);
+  if (!indexing_features.runtimeDescriptorArray ||
+      !indexing_features.descriptorBindingPartiallyBound ||
+      !indexing_features.descriptorBindingSampledImageUpdateAfterBind ||
+      !indexing_features.shaderSampledImageArrayNonUniformIndexing) {
+    throw std::runtime_error("Descriptor indexing features not supported");
+  }
+  // Only the features the texture heap uses
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT required_indexing_features{};
+  required_indexing_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  required_indexing_features.runtimeDescriptorArray = VK_TRUE;
+  required_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+  required_indexing_features.descriptorBindingSampledImageUpdateAfterBind =
+      VK_TRUE;
+  required_indexing_features.shaderSampledImageArrayNonUniformIndexing =
+      VK_TRUE;
 
   vkb::DeviceBuilder deviceBuilder{vkb_physical_device};
+  deviceBuilder.add_pNext(&required_indexing_features);
 
   vkb::Device vkb_device = deviceBuilder.build().value();
 
@@ -120,6 +228,8 @@ void Renderer::init_vulkan() {
 
   min_ubo_alignment = vkb_device.physical_device.properties.limits
                           .minUniformBufferOffsetAlignment;
+  min_ssbo_alignment = vkb_device.physical_device.properties.limits
+                           .minStorageBufferOffsetAlignment;
 
   // Setup vertex buffer allocator
   VmaAllocatorCreateInfo allocatorInfo = {};
@@ -136,20 +246,11 @@ void Renderer::init_vulkan() {
     vkDestroyInstance(_instance, nullptr);
   });
 
-  // Allocate buffers for the camera and model info and texture
-  // This can be generalized to any number of buffers and descriptor sets
-  // but will do for now
-  _camera_buffer = BufferAllocation::create(
-      sizeof(CameraInfo), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VMA_MEMORY_USAGE_CPU_TO_GPU, _allocator);
-  _light_buffer = BufferAllocation::create(
-      sizeof(LightSource) * MAX_LIGHTS, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VMA_MEMORY_USAGE_CPU_TO_GPU, _allocator);
-
-  _deallocation_queue.push([&] {
-    _camera_buffer.destroy();
-    _light_buffer.destroy();
-  });
+  // Per-frame uniform and storage data
+  _upload_ring.init(INITIAL_UPLOAD_FRAME_SIZE, frames_in_flight,
+                    std::max(min_ubo_alignment, min_ssbo_alignment),
+                    _allocator);
+  _deallocation_queue.push([&] { _upload_ring.destroy(); });
 }
 
 void Renderer::init_materials() {
@@ -165,7 +266,7 @@ void Renderer::init_materials() {
         Path{ASSET_DIRECTORY} / "shaders/bin/composite_frag.spv";
     mat_spec.bindings = {
         {Binding{VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT, //
-                 VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
+                 VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,                 //
                  sizeof(CameraInfo),                                        //
                  1}},                                                       //
         {                                                                   //
@@ -204,9 +305,9 @@ void Renderer::init_materials() {
 
     mat_spec.input_attributes = {};
     composite_pass.material = Material{mat_spec}; // Color
-    composite_pass.material.build(_device, _descriptor_pool,
-                                  composite_pass.render_pass, _window_dims,
-                                  _deallocation_queue);
+    composite_pass.material.build(
+        _device, _descriptor_pool, composite_pass.render_pass, _window_dims,
+        _deallocation_queue, frames_in_flight, _pipeline_cache.cache);
   }
 
   { // Debug
@@ -218,15 +319,16 @@ void Renderer::init_materials() {
     mat_spec.frag_shader = Path{ASSET_DIRECTORY} / "shaders/bin/debug_frag.spv";
     mat_spec.bindings = {
         {{VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, sizeof(CameraInfo), 1}}};
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, sizeof(CameraInfo), 1},
+         {VK_SHADER_STAGE_VERTEX_BIT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          0, 1}}}; // Instances
     mat_spec.topology_type = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
     mat_spec.input_attributes =
-        std::vector<VkFormat>{VK_FORMAT_R32G32B32_SFLOAT,  // Position
-                              VK_FORMAT_R32G32B32_SFLOAT}; // Color
+        std::vector<VkFormat>{VK_FORMAT_R32G32B32_SFLOAT}; // Position
     composite_pass.debug_material = Material{mat_spec};
-    composite_pass.debug_material.build(_device, _descriptor_pool,
-                                        composite_pass.render_pass,
-                                        _window_dims, _deallocation_queue);
+    composite_pass.debug_material.build(
+        _device, _descriptor_pool, composite_pass.render_pass, _window_dims,
+        _deallocation_queue, frames_in_flight, _pipeline_cache.cache);
   }
 }
 
@@ -286,8 +388,51 @@ void Renderer::init_cmd_buffer() {
       vkAllocateCommandBuffers(_device, &cmd_buffer_info, &_command_buffer),
       "Failed to allocate command buffer");
 
-  _deallocation_queue.push(
-      [=] { vkDestroyCommandPool(_device, _command_pool, nullptr); });
+  _frames.resize(frames_in_flight);
+  for (FrameData &frame : _frames) {
+    VK_CHECK(vkCreateCommandPool(_device, &cmd_pool_info, nullptr,
+                                 &frame.command_pool),
+             "Failed to create command pool");
+    cmd_buffer_info.commandPool = frame.command_pool;
+    VK_CHECK(vkAllocateCommandBuffers(_device, &cmd_buffer_info,
+                                      &frame.command_buffer),
+             "Failed to allocate command buffer");
+  }
+
+  // Workers + the thread waiting on the jobs, which may run some of them
+  uint32_t thread_count =
+      std::max(std::thread::hardware_concurrency(),
+               get_job_system().get_max_concurrency()) +
+      1;
+  _secondary_pools.init(_device, _queue_family, thread_count,
+                        frames_in_flight);
+
+  VK_CHECK(vkCreateCommandPool(_device, &cmd_pool_info, nullptr,
+                               &_prerecorded_command_pool),
+           "Failed to create command pool");
+  for (PrerecordedPass *prerecorded :
+       {&_prerecorded_shading, &_prerecorded_screenspace,
+        &_prerecorded_composite}) {
+    prerecorded->command_buffers.resize(frames_in_flight);
+    prerecorded->dynamic_offsets.resize(frames_in_flight);
+    // Nothing recorded yet
+    prerecorded->update_counts.assign(frames_in_flight, UINT64_MAX);
+    cmd_buffer_info = vk_struct_init::get_command_buffer_allocate_info(
+        _prerecorded_command_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        frames_in_flight);
+    VK_CHECK(vkAllocateCommandBuffers(_device, &cmd_buffer_info,
+                                      prerecorded->command_buffers.data()),
+             "Failed to allocate command buffer");
+  }
+
+  _deallocation_queue.push([=] {
+    vkDestroyCommandPool(_device, _command_pool, nullptr);
+    for (FrameData &frame : _frames) {
+      vkDestroyCommandPool(_device, frame.command_pool, nullptr);
+    }
+    _secondary_pools.destroy();
+    vkDestroyCommandPool(_device, _prerecorded_command_pool, nullptr);
+  });
 }
 
 void Renderer::init_deferred_pass() {
@@ -302,8 +447,15 @@ void Renderer::init_deferred_pass() {
   color_attachment.usage =
       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
+  // Normal, albedo and world position, see gbuffer.glsl
   std::vector<AttachmentSpec> color_attachments = {
       color_attachment, color_attachment, color_attachment};
+  if (compact_gbuffer) {
+    // Octahedral normal, the position is rebuilt from the depth
+    color_attachments.pop_back();
+    color_attachments[0].format = VK_FORMAT_R16G16_SFLOAT;
+    color_attachments[1].format = VK_FORMAT_R8G8B8A8_SRGB;
+  }
 
   AttachmentSpec depth_attachment;
   depth_attachment.active = true;
@@ -319,28 +471,31 @@ void Renderer::init_deferred_pass() {
   MaterialSpec mat_spec{};
   mat_spec.depth_test_enabled = true;
   mat_spec.blend_test_enabled = false;
-  mat_spec.color_attachment_count = 3;
+  mat_spec.color_attachment_count = color_attachments.size();
+  mat_spec.specialization_constants = {compact_gbuffer};
   mat_spec.vert_shader =
       Path{ASSET_DIRECTORY} / "shaders/bin/deferred_vert.spv";
   mat_spec.frag_shader =
       Path{ASSET_DIRECTORY} / "shaders/bin/deferred_frag.spv";
   mat_spec.bindings = {
-      {Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
-               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
-               0,                                         //
-               MAX_TEXTURE_COUNT}},                       // Textures
+      {}, // Texture heap
       {Binding{VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, //
-               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
+               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,                 //
                sizeof(CameraInfo),                                        //
                1},
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT, //
-               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
-               sizeof(LightSource),                                       //
-               MAX_LIGHTS},                  // Camera info (view, projection)
+               VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,                         //
+               0,                                                         //
+               1},                                                        // Lights
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT, //
                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
                0,                                         //
-               1}}};                                      // Shadow map
+               1},                                        // Shadow map
+       Binding{VK_SHADER_STAGE_VERTEX_BIT,                //
+               VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, //
+               0,                                         //
+               1}}};                                      // Instances
+  mat_spec.shared_sets = {_texture_heap.get_shared_set(0)};
 
   mat_spec.input_attributes = {VK_FORMAT_R32G32B32_SFLOAT, // Position
                                VK_FORMAT_R32G32B32_SFLOAT, // Normal
@@ -364,7 +519,8 @@ void Renderer::init_deferred_pass() {
 
   deferred_pass.material.build(_device, _descriptor_pool,
                                deferred_pass.render_pass, pass_spec.extent,
-                               _deallocation_queue);
+                               _deallocation_queue, frames_in_flight,
+                               _pipeline_cache.cache);
 
   _deallocation_queue.push([=] { deferred_pass.destroy(); });
 }
@@ -390,17 +546,15 @@ void Renderer::init_screenspace_pass() {
   mat_spec.depth_test_enabled = false;
   mat_spec.blend_test_enabled = false;
   mat_spec.color_attachment_count = 2;
+  mat_spec.specialization_constants = {compact_gbuffer, !hiz_reflections};
   mat_spec.vert_shader =
       Path{ASSET_DIRECTORY} / "shaders/bin/screenspace_vert.spv";
   mat_spec.frag_shader =
       Path{ASSET_DIRECTORY} / "shaders/bin/screenspace_frag.spv";
   mat_spec.bindings = {
-      {Binding{VK_SHADER_STAGE_FRAGMENT_BIT,                              //
-               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,                 //
-               0,                                                         //
-               MAX_TEXTURE_COUNT}},                                       //
+      {}, // Texture heap
       {Binding{VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT, //
-               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
+               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,                 //
                sizeof(CameraInfo),                                        //
                1},                                                        //
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT,                              //
@@ -423,6 +577,7 @@ void Renderer::init_screenspace_pass() {
                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,                 //
                0,                                                         //
                1}}};                                                      //
+  mat_spec.shared_sets = {_texture_heap.get_shared_set(0)};
 
   mat_spec.input_attributes = {};
 
@@ -445,7 +600,8 @@ void Renderer::init_screenspace_pass() {
 
   screenspace_effects_pass.material.build(
       _device, _descriptor_pool, screenspace_effects_pass.render_pass,
-      pass_spec.extent, _deallocation_queue);
+      pass_spec.extent, _deallocation_queue, frames_in_flight,
+      _pipeline_cache.cache);
 
   _deallocation_queue.push([=] { screenspace_effects_pass.destroy(); });
 }
@@ -455,6 +611,17 @@ void Renderer::init_shading_pass() {
   AttachmentSpec color_attachment;
   color_attachment.active = true;
   color_attachment.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  if (compact_gbuffer) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(
+        _physical_device, VK_FORMAT_B10G11R11_UFLOAT_PACK32, &properties);
+    // Not a mandatory color attachment format
+    color_attachment.format =
+        properties.optimalTilingFeatures &
+                VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT
+            ? VK_FORMAT_B10G11R11_UFLOAT_PACK32
+            : VK_FORMAT_R16G16B16A16_SFLOAT;
+  }
   color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
   color_attachment.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
   color_attachment.extent = _window_dims;
@@ -471,21 +638,19 @@ void Renderer::init_shading_pass() {
   mat_spec.depth_test_enabled = false;
   mat_spec.blend_test_enabled = false;
   mat_spec.color_attachment_count = color_attachments.size();
+  mat_spec.specialization_constants = {compact_gbuffer};
   mat_spec.vert_shader = Path{ASSET_DIRECTORY} / "shaders/bin/shading_vert.spv";
   mat_spec.frag_shader = Path{ASSET_DIRECTORY} / "shaders/bin/shading_frag.spv";
   mat_spec.bindings = {
-      {Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
-               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
-               0,                                         //
-               MAX_TEXTURE_COUNT}},                       // Textures
+      {}, // Texture heap
       {Binding{VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT, //
-               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
+               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,                 //
                sizeof(CameraInfo),                                        //
                1},                                                        //
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT,                              //
-               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
-               sizeof(LightSource),                                       //
-               MAX_LIGHTS},                                               //
+               VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,                 //
+               0,                                                         //
+               1},                                                        // Lights
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT,                              //
                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, // Shadow
                0,                                         //
@@ -501,12 +666,17 @@ void Renderer::init_shading_pass() {
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
                0,                                         //
-               1},                                        // Position
+               1},                                        // Albedo
        Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
                0,                                         //
-               1}}                                        // Depth
+               1},                                        // Depth
+       Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
+               VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, //
+               0,                                         //
+               1}}                                        // Light clusters
   };
+  mat_spec.shared_sets = {_texture_heap.get_shared_set(0)};
 
   mat_spec.input_attributes = {};
 
@@ -527,11 +697,112 @@ void Renderer::init_shading_pass() {
                             pass_spec, _device, _allocator);
 
   pass.material.build(_device, _descriptor_pool, pass.render_pass,
-                      pass_spec.extent, _deallocation_queue);
+                      pass_spec.extent, _deallocation_queue, frames_in_flight,
+                      _pipeline_cache.cache);
 
   _deallocation_queue.push([&] { pass.destroy(); });
 }
 
+void Renderer::init_fullscreen_pass(
+    RenderPass &pass, VkFormat format, VkExtent2D extent, VkFilter filter_mode,
+    const char *frag_shader, std::vector<Binding> bindings,
+    std::vector<int32_t> specialization_constants) {
+  AttachmentSpec color_attachment;
+  color_attachment.active = true;
+  color_attachment.format = format;
+  color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color_attachment.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+  color_attachment.extent = extent;
+  color_attachment.filter_mode = filter_mode;
+  color_attachment.address_mode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  color_attachment.usage =
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+  AttachmentSpec depth_attachment{};
+
+  MaterialSpec mat_spec{};
+  mat_spec.depth_test_enabled = false;
+  mat_spec.blend_test_enabled = false;
+  mat_spec.color_attachment_count = 1;
+  mat_spec.specialization_constants = specialization_constants;
+  mat_spec.vert_shader = Path{ASSET_DIRECTORY} / "shaders/bin/shading_vert.spv";
+  mat_spec.frag_shader = Path{ASSET_DIRECTORY} / "shaders/bin" / frag_shader;
+  mat_spec.bindings = {
+      {Binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
+               VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, //
+               sizeof(CameraInfo),                        //
+               1}},                                       // Camera
+      bindings};
+
+  mat_spec.input_attributes = {};
+
+  RenderPassSpec pass_spec;
+  pass_spec.extent = extent;
+  pass_spec.prev_stage_dependency = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, //
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,         //
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,          //
+      VK_ACCESS_SHADER_WRITE_BIT};
+  pass_spec.next_stage_dependency = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, //
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,         //
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,          //
+      VK_ACCESS_SHADER_WRITE_BIT};
+
+  pass = RenderPass::create({color_attachment}, depth_attachment, mat_spec,
+                            pass_spec, _device, _allocator);
+
+  pass.material.build(_device, _descriptor_pool, pass.render_pass,
+                      pass_spec.extent, _deallocation_queue, frames_in_flight,
+                      _pipeline_cache.cache);
+
+  _deallocation_queue.push([&pass] { pass.destroy(); });
+}
+
+void Renderer::init_reflection_passes() {
+  if (!hiz_reflections) {
+    return;
+  }
+  Binding texture_binding{VK_SHADER_STAGE_FRAGMENT_BIT,              //
+                          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, //
+                          0,                                         //
+                          1};
+
+  // Never resized after this, the materials keep pointers into the passes
+  hiz_passes.resize(HIZ_LEVELS);
+  VkExtent2D extent = _window_dims;
+  for (int level = 0; level < HIZ_LEVELS; level++) {
+    extent = {std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u)};
+    init_fullscreen_pass(hiz_passes[level], VK_FORMAT_R32_SFLOAT, extent,
+                         VK_FILTER_NEAREST, "hiz_frag.spv",
+                         {texture_binding}, {});
+  }
+
+  VkExtent2D trace_extent = hiz_passes[0].spec.extent;
+  Binding hiz_binding = texture_binding;
+  hiz_binding.descriptor_count = HIZ_LEVELS;
+  init_fullscreen_pass(reflection_trace_pass, VK_FORMAT_R16G16B16A16_SFLOAT,
+                       trace_extent, VK_FILTER_LINEAR,
+                       "reflection_trace_frag.spv",
+                       {texture_binding, texture_binding, texture_binding,
+                        texture_binding, texture_binding, hiz_binding},
+                       {compact_gbuffer});
+  for (RenderPass &pass : reflection_history_passes) {
+    init_fullscreen_pass(pass, VK_FORMAT_R16G16B16A16_SFLOAT, trace_extent,
+                         VK_FILTER_LINEAR, "reflection_temporal_frag.spv",
+                         {texture_binding, texture_binding, texture_binding},
+                         {});
+  }
+  init_fullscreen_pass(screenspace_smoothing_pass,
+                       VK_FORMAT_R16G16B16A16_SFLOAT, _window_dims,
+                       VK_FILTER_LINEAR, "screenspace_smoothing_frag.spv",
+                       {texture_binding, texture_binding, texture_binding},
+                       {});
+
+  _reflection_tiles.resize(trace_extent.width, trace_extent.height,
+                           REFLECTION_TILE_SIZE);
+}
+
 void Renderer::init_renderpass() {
   VkAttachmentDescription color_attachment =
       vk_struct_init::get_attachment_description(
@@ -667,25 +938,35 @@ void Renderer::init_sync_primitives() {
   fence_info.pNext = nullptr;
   fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  VK_CHECK(vkCreateSemaphore(_device, &semaphore_info, nullptr,
-                             &_swapchain_semaphore),
-           "Failed to create present semaphore");
+  for (FrameData &frame : _frames) {
+    VK_CHECK(vkCreateSemaphore(_device, &semaphore_info, nullptr,
+                               &frame.swapchain_semaphore),
+             "Failed to create present semaphore");
 
-  VK_CHECK(vkCreateSemaphore(_device, &semaphore_info, nullptr,
-                             &_render_complete_semaphore),
-           "Failed to create render semaphore");
+    VK_CHECK(vkCreateFence(_device, &fence_info, nullptr,
+                           &frame.command_complete_fence),
+             "Failed to create render fence");
+  }
 
-  VK_CHECK(
-      vkCreateFence(_device, &fence_info, nullptr, &_command_complete_fence),
-      "Failed to create render fence");
+  _render_complete_semaphores.resize(composite_pass.images.size());
+  for (VkSemaphore &semaphore : _render_complete_semaphores) {
+    VK_CHECK(
+        vkCreateSemaphore(_device, &semaphore_info, nullptr, &semaphore),
+        "Failed to create render semaphore");
+  }
+  _image_fences.assign(composite_pass.images.size(), VK_NULL_HANDLE);
 
   VK_CHECK(vkCreateFence(_device, &fence_info, nullptr, &_submit_fence),
            "Failed to create submit fence");
 
   _deallocation_queue.push([=] {
-    vkDestroySemaphore(_device, _swapchain_semaphore, nullptr);
-    vkDestroySemaphore(_device, _render_complete_semaphore, nullptr);
-    vkDestroyFence(_device, _command_complete_fence, nullptr);
+    for (FrameData &frame : _frames) {
+      vkDestroySemaphore(_device, frame.swapchain_semaphore, nullptr);
+      vkDestroyFence(_device, frame.command_complete_fence, nullptr);
+    }
+    for (VkSemaphore semaphore : _render_complete_semaphores) {
+      vkDestroySemaphore(_device, semaphore, nullptr);
+    }
     vkDestroyFence(_device, _submit_fence, nullptr);
   });
 }
@@ -693,16 +974,27 @@ void Renderer::init_sync_primitives() {
 void Renderer::init_descriptor_pool() {
   VkDescriptorPoolCreateInfo pool_info = {};
 
+  // Materials allocate their sets once per frame in flight
   VkDescriptorPoolSize scene = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 500};
   VkDescriptorPoolSize material = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                   200};
+                                   200 * frames_in_flight};
+
+  VkDescriptorPoolSize instances = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    32 * frames_in_flight};
+
+  // Per-frame data in the upload ring
+  VkDescriptorPoolSize frame_uniforms = {
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 32 * frames_in_flight};
+  VkDescriptorPoolSize frame_storage = {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 32 * frames_in_flight};
 
-  VkDescriptorPoolSize pool_sizes[2] = {scene, material};
+  VkDescriptorPoolSize pool_sizes[5] = {scene, material, instances,
+                                        frame_uniforms, frame_storage};
 
   pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
   pool_info.pNext = nullptr;
   pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-  pool_info.maxSets = 20;
+  pool_info.maxSets = 64 * frames_in_flight;
   pool_info.poolSizeCount = sizeof(pool_sizes) / sizeof(VkDescriptorPoolSize);
   pool_info.pPoolSizes = pool_sizes;
   VK_CHECK(
@@ -713,12 +1005,47 @@ void Renderer::init_descriptor_pool() {
       [=] { vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr); });
 }
 
+void Renderer::init_texture_heap() {
+  VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_properties{};
+  indexing_properties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &indexing_properties;
+  vkGetPhysicalDeviceProperties2(_physical_device, &properties);
+
+  // The limits also count the samplers in the other sets of the materials
+  constexpr uint32_t MATERIAL_SAMPLERS = 32;
+  uint32_t limit = std::min(
+      {indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+       indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+       indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+       indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages});
+  if (limit <= MATERIAL_SAMPLERS) {
+    throw std::runtime_error("Descriptor indexing limits too low");
+  }
+
+  _sampler_cache.init(_device);
+  _texture_heap.init(_device, std::min(MAX_BINDLESS_TEXTURES,
+                                       limit - MATERIAL_SAMPLERS));
+  _deallocation_queue.push([&] {
+    _texture_heap.destroy();
+    _sampler_cache.destroy();
+  });
+}
+
 void Renderer::init_debug_renderable() {
-  composite_pass.buffer_allocation = BufferAllocation::create(
-      3 * sizeof(float) * MAX_DEBUG_VERTICES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VMA_MEMORY_USAGE_CPU_TO_GPU, _allocator);
+  std::vector<Eigen::Vector3f> vertices;
+  build_debug_primitive_vertices(vertices, composite_pass.debug_vertex_ranges);
+  composite_pass.debug_vertex_buffer = BufferAllocation::create(
+      sizeof(Eigen::Vector3f) * vertices.size(),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU,
+      _allocator);
+  composite_pass.debug_vertex_buffer.copy_from(
+      vertices.data(), sizeof(Eigen::Vector3f) * vertices.size());
 
-  _deallocation_queue.push([&] { composite_pass.buffer_allocation.destroy(); });
+  _deallocation_queue.push(
+      [&] { composite_pass.debug_vertex_buffer.destroy(); });
 }
 
 void Renderer::draw_debug_line(const Eigen::Vector3f &start,
@@ -727,20 +1054,7 @@ void Renderer::draw_debug_line(const Eigen::Vector3f &start,
   if (!debug_mode) {
     return;
   }
-  if (MAX_DEBUG_VERTICES <= composite_pass.debug_verts_to_draw * 2) {
-    throw std::runtime_error("Debug buffer overflow");
-  }
-  // TODO: Replace with vert incices
-  int start_offset = composite_pass.debug_verts_to_draw * 6;
-  memcpy(composite_pass.debug_buffer + start_offset, start.data(),
-         sizeof(float) * 3);
-  memcpy(composite_pass.debug_buffer + start_offset + 3, color.data(),
-         sizeof(float) * 3);
-  memcpy(composite_pass.debug_buffer + start_offset + 6, end.data(),
-         sizeof(float) * 3);
-  memcpy(composite_pass.debug_buffer + start_offset + 9, color.data(),
-         sizeof(float) * 3);
-  composite_pass.debug_verts_to_draw += 2;
+  _debug_draw.line(start, end, color);
 }
 
 void Renderer::draw_debug_quad(const Eigen::Matrix<float, 4, 3> &quad_verts,
@@ -749,79 +1063,26 @@ void Renderer::draw_debug_quad(const Eigen::Matrix<float, 4, 3> &quad_verts,
     return;
   }
   for (int i = 0; i < 4; i++) {
-    draw_debug_line(quad_verts.row(i), quad_verts.row((i + 1) % 4), color);
+    _debug_draw.line(quad_verts.row(i), quad_verts.row((i + 1) % 4), color);
   }
 }
 
-void Renderer::draw_debug_box(const Eigen::Matrix<float, 8, 4> &box_verts,
+void Renderer::draw_debug_box(const Eigen::Vector3f &min,
+                              const Eigen::Vector3f &max,
+                              const Eigen::Matrix4f &model,
                               const Eigen::Vector3f &color) {
   if (!debug_mode) {
     return;
   }
-  /*
-  Vertex order is :
-  0-3 top clockwise
-  4-7 bottom clockwise
-  */
-  for (int edge = 0; edge < 4; edge++) {
-    int b1 = edge % 4;
-    int b2 = (edge + 1) % 4;
-
-    int t1 = 4 + edge % 4;
-    int t2 = 4 + (edge + 1) % 4;
-    /*
-
-              Top strip
-              t1 ---- t2/|
-    Side strip|        | |
-              |        | |
-              b1 ---- b2/
-              Bottom strip
-    */
-    draw_debug_line(box_verts.row(b1).head<3>(), box_verts.row(b2).head<3>(),
-                    color);
-    draw_debug_line(box_verts.row(t1).head<3>(), box_verts.row(t2).head<3>(),
-                    color);
-    draw_debug_line(box_verts.row(t1).head<3>(), box_verts.row(b1).head<3>(),
-                    color);
-  }
+  _debug_draw.box(min, max, model, color);
 }
 
 void Renderer::draw_debug_sphere(const Eigen::Vector3f &position, float radius,
-                                 int resolution, const Eigen::Vector3f &color) {
+                                 const Eigen::Vector3f &color) {
   if (!debug_mode) {
     return;
   }
-  Eigen::MatrixXf sphere_verts(resolution, 3);
-  for (int i = 0; i < resolution; i++) {
-    float theta = i * 2 * M_PI / resolution;
-    sphere_verts.row(i) =
-        Eigen::Vector3f{radius * cos(theta), radius * sin(theta),
-                        0}; // No rotation around Y axis
-  }
-
-  for (int i = 0; i < resolution; i++) {
-    Eigen::Matrix3f rotation =
-        Eigen::AngleAxisf(i * 2 * M_PI / resolution, Eigen::Vector3f::UnitY())
-            .toRotationMatrix();
-
-    Eigen::MatrixXf rotated_verts = rotation * sphere_verts.transpose();
-    for (int i = 0; i < resolution; i++) {
-      draw_debug_line(position + rotated_verts.col(i),
-                      position + rotated_verts.col((i + 1) % resolution),
-                      color);
-    }
-  }
-
-  // Horizontal ring
-  Eigen::Matrix3f rotation =
-      Eigen::AngleAxisf(M_PI_2, Eigen::Vector3f::UnitX()).toRotationMatrix();
-
-  Eigen::MatrixXf rotated_verts = rotation * sphere_verts.transpose();
-  for (int i = 0; i < resolution; i++) {
-    draw_debug_line(position + rotated_verts.col(i),
-                    position + rotated_verts.col((i + 1) % resolution), color);
-  }
+  _debug_draw.sphere(position, radius, color);
 }
 
 void Renderer::begin_one_time_submit() {
@@ -857,21 +1118,41 @@ void Renderer::end_one_time_submit() {
   vkResetCommandPool(_device, _command_pool, 0);
 }
 
+Renderer::FrameData &Renderer::get_current_frame() {
+  return _frames[_frame_number % _frames.size()];
+}
+
 void Renderer::begin_command_buffer(VkCommandBuffer &command_buffer) {
-  // Wait for the command queue to complete
-  VK_CHECK(vkWaitForFences(_device, 1, &_command_complete_fence, VK_TRUE,
+  FrameData &frame = get_current_frame();
+  // Wait for the GPU to finish the last frame that used these resources
+  VK_CHECK(vkWaitForFences(_device, 1, &frame.command_complete_fence, VK_TRUE,
                            1000000000),
            "Render fence error");
 
   // Get next swapchain index
   VK_CHECK(vkAcquireNextImageKHR(_device, _swapchain, 1000000000,
-                                 _swapchain_semaphore, nullptr,
+                                 frame.swapchain_semaphore, nullptr,
                                  &_swapchain_img_idx),
            "Failed to acquire swapchain image");
 
+  // The image can be acquired before the frame rendering to it is done when
+  // there are more frames in flight than swapchain images
+  VkFence &image_fence = _image_fences[_swapchain_img_idx];
+  if (image_fence != VK_NULL_HANDLE &&
+      image_fence != frame.command_complete_fence) {
+    VK_CHECK(vkWaitForFences(_device, 1, &image_fence, VK_TRUE, 1000000000),
+             "Render fence error");
+  }
+  image_fence = frame.command_complete_fence;
+
+  for (Material *material : _frame_materials) {
+    material->ds_allocator.begin_frame(_frame_number % _frames.size());
+  }
+  _secondary_pools.begin_frame(_frame_number % _frames.size());
+
   // Fill command buffer
-  VK_CHECK(vkResetCommandBuffer(command_buffer, 0),
-           "Failed to reset command buffer");
+  VK_CHECK(vkResetCommandPool(_device, frame.command_pool, 0),
+           "Failed to reset command pool");
 
   VkCommandBufferBeginInfo cmd_buffer_info = {};
   cmd_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -885,7 +1166,8 @@ void Renderer::begin_render_pass(
     VkRenderPass &render_pass, VkFramebuffer &framebuffer,
     VkCommandBuffer &command_buffer, const VkExtent2D &extent,
     float depth_clear_value, float *color_clear_values,
-    int color_clear_values_count, float alpha_clear_value) {
+    int color_clear_values_count, float alpha_clear_value,
+    VkSubpassContents contents) {
   std::vector<VkClearValue> clear_values;
   if (color_clear_values_count >= 0) {
     for (int i = 0; i < color_clear_values_count; i++) {
@@ -913,7 +1195,7 @@ void Renderer::begin_render_pass(
   rp_info.renderArea.extent = extent;
   rp_info.framebuffer = framebuffer;
 
-  vkCmdBeginRenderPass(command_buffer, &rp_info, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(command_buffer, &rp_info, contents);
 }
 
 void Renderer::end_render_pass(VkCommandBuffer &command_buffer) {
@@ -921,7 +1203,8 @@ void Renderer::end_render_pass(VkCommandBuffer &command_buffer) {
 }
 
 void Renderer::submit_command_buffer(VkCommandBuffer &command_buffer) {
-  VK_CHECK(vkEndCommandBuffer(_command_buffer), "Failed to end command buffer");
+  FrameData &frame = get_current_frame();
+  VK_CHECK(vkEndCommandBuffer(command_buffer), "Failed to end command buffer");
 
   // Submit command to the render queue
   VkSubmitInfo submit = {};
@@ -931,7 +1214,7 @@ void Renderer::submit_command_buffer(VkCommandBuffer &command_buffer) {
   submit.pWaitSemaphores = nullptr;
   submit.pWaitDstStageMask = nullptr;
   submit.commandBufferCount = 1;
-  submit.pCommandBuffers = &_command_buffer;
+  submit.pCommandBuffers = &command_buffer;
   submit.signalSemaphoreCount = 0;
   submit.pSignalSemaphores = nullptr;
 
@@ -942,22 +1225,32 @@ void Renderer::submit_command_buffer(VkCommandBuffer &command_buffer) {
   // semaphore wait will occur.
   submit.pWaitDstStageMask = &wait_stage;
 
+  VkSemaphore &render_complete_semaphore =
+      _render_complete_semaphores[_swapchain_img_idx];
+
   submit.waitSemaphoreCount = 1;
-  submit.pWaitSemaphores = &_swapchain_semaphore; // Wait for swap chain image
+  submit.pWaitSemaphores =
+      &frame.swapchain_semaphore; // Wait for swap chain image
 
   submit.signalSemaphoreCount = 1;
   submit.pSignalSemaphores =
-      &_render_complete_semaphore; // Signal render complete
+      &render_complete_semaphore; // Signal render complete
 
   submit.commandBufferCount = 1;
-  submit.pCommandBuffers = &_command_buffer;
+  submit.pCommandBuffers = &command_buffer;
 
   vkResetFences(_device, 1,
-                &_command_complete_fence); // Can be safely reset because we
-                                           // already waited on it
-  VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit, _command_complete_fence),
+                &frame.command_complete_fence); // Can be safely reset because
+                                                // we already waited on it
+  VK_CHECK(vkQueueSubmit(_graphics_queue, 1, &submit,
+                         frame.command_complete_fence),
            "Failed to submit to queue");
 
+  // Descriptor writes until the next frame can't touch the submitted sets
+  for (Material *material : _frame_materials) {
+    material->ds_allocator.end_frame();
+  }
+
   // Present image from the swapchain when pipeline is finished
   VkPresentInfoKHR present_info = {};
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -966,7 +1259,7 @@ void Renderer::submit_command_buffer(VkCommandBuffer &command_buffer) {
   present_info.pSwapchains = &_swapchain;
   present_info.swapchainCount = 1;
 
-  present_info.pWaitSemaphores = &_render_complete_semaphore;
+  present_info.pWaitSemaphores = &render_complete_semaphore;
   present_info.waitSemaphoreCount = 1;
 
   present_info.pImageIndices = &_swapchain_img_idx;
@@ -1055,26 +1348,34 @@ void Renderer::init_shadow_pass() {
       VkExtent2D{SHADOW_ATLAS_RESOLUTION, SHADOW_ATLAS_RESOLUTION};
   depth_attachment.filter_mode = VK_FILTER_LINEAR;
   depth_attachment.address_mode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-  depth_attachment.usage =
-      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  depth_attachment.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                          VK_IMAGE_USAGE_SAMPLED_BIT |
+                          VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
   MaterialSpec mat_spec{};
   mat_spec.depth_test_enabled = true;
   mat_spec.blend_test_enabled = false;
   mat_spec.color_attachment_count = 1;
   mat_spec.vert_shader =
-      Path{ASSET_DIRECTORY} / "shaders/bin/shadow_map_vert.spv",
+      Path{ASSET_DIRECTORY} / (_layered_shadows
+                                   ? "shaders/bin/shadow_map_layered_vert.spv"
+                                   : "shaders/bin/shadow_map_vert.spv");
+  mat_spec.viewport_count = _layered_shadows ? MAX_SHADOW_VIEWPORTS : 1;
   mat_spec.frag_shader =
       Path{ASSET_DIRECTORY} / "shaders/bin/shadow_map_frag.spv",
   mat_spec.bindings = {
       {{Binding{VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, //
-                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
+                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,                 //
                 sizeof(CameraInfo),                                        //
                 1},
         Binding{VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT, //
-                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,                         //
-                sizeof(LightSource),                                       //
-                MAX_LIGHTS}}}};
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,                 //
+                0,                                                         //
+                1}, // Lights
+        Binding{VK_SHADER_STAGE_VERTEX_BIT,                //
+                VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, //
+                0,                                         //
+                1}}}};                                     // Instances
   mat_spec.input_attributes =
       std::vector<VkFormat>{VK_FORMAT_R32G32B32_SFLOAT}; // Color
 
@@ -1097,14 +1398,28 @@ void Renderer::init_shadow_pass() {
       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,        //
       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, //
       VK_ACCESS_SHADER_READ_BIT};
+  // Only the updated tiles are redrawn, the rest is kept from earlier frames
+  pass_spec.load_depth = true;
 
   shadow_pass = RenderPass::create(color_attachments, depth_attachment,
                                    mat_spec, pass_spec, _device, _allocator);
 
   shadow_pass.material.build(_device, _descriptor_pool, shadow_pass.render_pass,
-                             pass_spec.extent, _deallocation_queue);
+                             pass_spec.extent, _deallocation_queue,
+                             frames_in_flight, _pipeline_cache.cache);
+
+  // Same attachment formats, draws with the shadow pass pipeline. Copied
+  // from instead of sampled
+  depth_attachment.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                           VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  static_shadow_pass = RenderPass::create(color_attachments, depth_attachment,
+                                          mat_spec, pass_spec, _device,
+                                          _allocator);
 
-  _deallocation_queue.push([=]() { shadow_pass.destroy(); });
+  _deallocation_queue.push([=]() {
+    shadow_pass.destroy();
+    static_shadow_pass.destroy();
+  });
 }
 
 void Renderer::check_renderables() {
@@ -1128,163 +1443,779 @@ void Renderer::check_renderables() {
     }
 
     if (!renderable.p_texture->image_allocated()) {
-      renderable.p_texture->allocate_image(_device, _allocator,
+      renderable.p_texture->allocate_image(_device, _allocator, _sampler_cache,
                                            _deallocation_queue);
       transfer_texture_to_gpu(renderable.p_texture);
-      if (texture_to_index.find(renderable.p_texture.get()) ==
-          texture_to_index.end()) {
-        texture_to_index.insert(
-            {renderable.p_texture.get(), texture_to_index.size()});
+      // Resident from now on, draws use the handle
+      _texture_heap.add(*renderable.p_texture);
+    }
+  }
+}
+
+void Renderer::gather_lights() {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+
+  _lights.clear();
+  _light_sources.clear();
+  for (rend::ECS::EntityRegistry::ArchetypeIterator light_iterator =
+           registry.archetype_iterator<Light>();
+       light_iterator.valid(); ++light_iterator) {
+    Light &light = registry.get_component<Light>(*light_iterator);
+    if (!light.enabled()) {
+      continue;
+    }
+    light.update_VP();
+
+    LightSource source{};
+    Eigen::Vector3f::Map(source.position) = light.get_position();
+    source.fov = light.get_fov();
+    Eigen::Vector3f::Map(source.color) = light.get_color();
+    source.intensity = light.get_intensity();
+    Eigen::Vector3f::Map(source.direction) = light.get_direction();
+    source.type = light.get_type();
+    Eigen::Matrix4f::Map(source.view_matrix) = light.get_view_mat();
+    Eigen::Matrix4f::Map(source.projection_matrix) =
+        light.get_projection_mat();
+    source.range = light.get_range();
+
+    _lights.push_back(&light);
+    _light_sources.push_back(source);
+  }
+}
+
+void Renderer::upload_lights() {
+  LightBufferHeader header{};
+  header.light_count = _light_sources.size();
+  void *datas[2] = {&header, _light_sources.data()};
+  size_t sizes[2] = {sizeof(LightBufferHeader),
+                     sizeof(LightSource) * _light_sources.size()};
+  _light_offset = _upload_ring.upload(datas, sizes, 2);
+}
+
+void Renderer::allocate_shadow_tiles() {
+  rend::physics::Frustum camera_frustum =
+      rend::physics::Frustum::from_view_projection(camera->projection *
+                                                   camera->get_view_matrix());
+
+  _shadow_requests.clear();
+  for (int light_idx = 0; light_idx < _lights.size(); light_idx++) {
+    Light &light = *_lights[light_idx];
+
+    // Lights only shade inside their frustum, skip the ones whose frustum
+    // bounds are off screen
+    Eigen::Matrix4f inverse_view_projection =
+        (light.get_projection_mat() * light.get_view_mat()).inverse();
+    Eigen::Matrix<float, 4, 8> corners =
+        inverse_view_projection *
+        get_cube_vertices(-Eigen::Vector3f::Ones(), Eigen::Vector3f::Ones())
+            .transpose();
+    Eigen::Matrix<float, 3, 8> corners_world =
+        corners.topRows<3>().array().rowwise() / corners.row(3).array();
+    if (!camera_frustum.intersects_box(corners_world.rowwise().minCoeff(),
+                                       corners_world.rowwise().maxCoeff())) {
+      continue;
+    }
+
+    // Fraction of the screen height covered by the light's bounding sphere,
+    // the whole screen when the camera is inside of it
+    Eigen::Vector3f center;
+    float radius;
+    light.get_bounding_sphere(center, radius);
+    float distance = (center - camera->position).norm();
+    float screen_size = 1.0f;
+    if (distance > radius) {
+      screen_size = std::min(
+          1.0f, radius / distance * std::abs(camera->projection(1, 1)));
+    }
+
+    uint32_t size = MAX_SHADOW_MAP_RESOLUTION;
+    for (float coverage = SHADOW_FULL_RESOLUTION_SCREEN_SIZE;
+         coverage > screen_size && size > MIN_SHADOW_MAP_RESOLUTION;
+         coverage *= 0.5f) {
+      size /= 2;
+    }
+    _shadow_requests.push_back(
+        ShadowAtlasAllocator::Request{light_idx, screen_size, size});
+  }
+
+  // Packing depends on the request order, repacking every frame would move
+  // the cached tiles around whenever the camera moves
+  bool requests_changed =
+      _shadow_rects.size() != _lights.size() ||
+      _packed_shadow_requests.size() != _shadow_requests.size();
+  for (int i = 0; !requests_changed && i < _shadow_requests.size(); i++) {
+    requests_changed = _packed_shadow_requests[i] !=
+                       std::make_pair(_shadow_requests[i].light_index,
+                                      _shadow_requests[i].size);
+  }
+  if (requests_changed) {
+    _packed_shadow_requests.clear();
+    for (const ShadowAtlasAllocator::Request &request : _shadow_requests) {
+      _packed_shadow_requests.emplace_back(request.light_index, request.size);
+    }
+    _shadow_rects.assign(_lights.size(), ShadowAtlasRect{});
+    _shadow_atlas.allocate(_shadow_requests, _shadow_rects);
+  }
+
+  for (int light_idx = 0; light_idx < _lights.size(); light_idx++) {
+    const ShadowAtlasRect &rect = _shadow_rects[light_idx];
+    Eigen::Vector4f::Map(_light_sources[light_idx].shadow_rect) =
+        Eigen::Vector4f{static_cast<float>(rect.x), static_cast<float>(rect.y),
+                        static_cast<float>(rect.size), 0.0f} /
+        SHADOW_ATLAS_RESOLUTION;
+  }
+}
+
+void Renderer::cull_renderables() {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+
+  _draw_items.clear();
+  _draw_bounds.clear();
+  _transform_versions.resize(rend::ECS::MAX_ENTITIES, 0);
+  _last_moved_frames.resize(rend::ECS::MAX_ENTITIES,
+                            -SHADOW_STATIC_FRAMES);
+  for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
+           registry.archetype_iterator<Renderable, Transform>();
+       rb_iterator.valid(); ++rb_iterator) {
+    rend::ECS::EID eid = *rb_iterator;
+    Renderable &renderable = registry.get_component<Renderable>(eid);
+    if (renderable.p_mesh == nullptr) {
+      continue;
+    }
+
+    auto bounds_iterator = _mesh_bounds.find(renderable.p_mesh);
+    if (bounds_iterator == _mesh_bounds.end()) {
+      bounds_iterator =
+          _mesh_bounds.insert({renderable.p_mesh, AABB(*renderable.p_mesh)})
+              .first;
+    }
+    const AABB &bounds = bounds_iterator->second;
+
+    // Entities seen for the first time start out static
+    uint64_t transform_version = registry.get_change_version<Transform>(eid);
+    if (_transform_versions[eid] != transform_version) {
+      if (_transform_versions[eid] != 0) {
+        _last_moved_frames[eid] = _frame_number;
       }
+      _transform_versions[eid] = transform_version;
+    }
+
+    _draw_items.push_back(DrawItem{
+        renderable.p_mesh.get(),
+        renderable.p_texture->handle,
+        renderable.reflective ? 1 : 0, // Reflectance bitmask
+        registry.get_component<Transform>(eid).get_model_matrix(), eid,
+        _frame_number - _last_moved_frames[eid] < SHADOW_STATIC_FRAMES});
+    _draw_bounds.add(bounds.min_local, bounds.max_local,
+                     _draw_items.back().model);
+  }
+
+  // Drop the bounds of meshes no renderable holds anymore
+  for (auto iterator = _mesh_bounds.begin(); iterator != _mesh_bounds.end();) {
+    if (iterator->first.use_count() == 1) {
+      iterator = _mesh_bounds.erase(iterator);
+    } else {
+      ++iterator;
     }
   }
 
-  static bool all_textures_allocated = false;
-  if (!all_textures_allocated) {
-    bind_textures();
-    all_textures_allocated = true;
+  _camera_visible.clear();
+  _draw_bounds.cull(rend::physics::Frustum::from_view_projection(
+                        camera->projection * camera->get_view_matrix()),
+                    _camera_visible);
+
+  _light_visible.resize(_lights.size());
+  for (int light_idx = 0; light_idx < _lights.size(); light_idx++) {
+    _light_visible[light_idx].clear();
+    if (_shadow_rects[light_idx].size == 0) {
+      continue;
+    }
+    _draw_bounds.cull(
+        rend::physics::Frustum::from_view_projection(
+            _lights[light_idx]->get_projection_mat() *
+            _lights[light_idx]->get_view_mat()),
+        _light_visible[light_idx]);
   }
 }
 
-void Renderer::draw() {
-  Eigen::Matrix4f projection = camera->projection;
-  Eigen::Matrix4f view = camera->get_view_matrix();
+// Order independent signatures are sums of the mixed casters
+static uint64_t hash_shadow_caster(uint64_t key, uint64_t value) {
+  uint64_t hash = key * 0x9E3779B97F4A7C15ull ^ value;
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+  return hash ^ (hash >> 31);
+}
 
-  int debug_buffer_size = 0;
+void Renderer::schedule_shadow_updates() {
+  _shadow_cache.resize(_lights.size());
+  _static_shadow_updates.assign(_lights.size(), false);
+  _shadow_updates.assign(_lights.size(), false);
+
+  int budget = SHADOW_UPDATES_PER_FRAME;
+  for (int i = 0; i < _lights.size(); i++) {
+    // Start after the last budgeted light so every light gets its turn
+    int light_idx = (_shadow_update_cursor + i) % _lights.size();
+    Light &light = *_lights[light_idx];
+    ShadowCacheEntry &entry = _shadow_cache[light_idx];
+    const ShadowAtlasRect &rect = _shadow_rects[light_idx];
+    if (rect.size == 0) {
+      entry.valid = false;
+      continue;
+    }
 
-  void *datas[3] = {view.data(), projection.data(), camera->position.data()};
-  size_t sizes[3] = {sizeof(float) * view.size(),
-                     sizeof(float) * projection.size(), sizeof(float) * 3};
+    // Static casters haven't moved, only the set of them matters
+    uint64_t static_signature = 0;
+    uint64_t dynamic_signature = 0;
+    for (uint32_t item_idx : _light_visible[light_idx]) {
+      const DrawItem &item = _draw_items[item_idx];
+      if (item.dynamic) {
+        dynamic_signature +=
+            hash_shadow_caster(item.eid, _transform_versions[item.eid]);
+      } else {
+        static_signature += hash_shadow_caster(
+            item.eid, reinterpret_cast<uintptr_t>(item.mesh));
+      }
+    }
+    Eigen::Matrix4f view_projection =
+        light.get_projection_mat() * light.get_view_mat();
+
+    // Tiles that moved or whose light changed can't show the cached depth
+    bool light_changed = !entry.valid || entry.rect.x != rect.x ||
+                         entry.rect.y != rect.y ||
+                         entry.rect.size != rect.size ||
+                         entry.view_projection != view_projection;
+    bool static_dirty =
+        light_changed || entry.static_signature != static_signature;
+    if (!static_dirty && entry.dynamic_signature == dynamic_signature) {
+      continue;
+    }
 
-  _camera_buffer.copy_from(datas, sizes, 3);
-  _light_buffer.copy_from(lights.data(), sizeof(LightSource) * lights.size());
+    // Moved casters of close lights are shown right away, distant lights
+    // share the budget and show the cached tile until their turn
+    if (!light_changed && rect.size < MAX_SHADOW_MAP_RESOLUTION) {
+      if (budget == 0) {
+        continue;
+      }
+      budget--;
+      _shadow_update_cursor = light_idx + 1;
+    }
+    _static_shadow_updates[light_idx] = static_dirty;
+    _shadow_updates[light_idx] = true;
+    entry = ShadowCacheEntry{rect, view_projection, static_signature,
+                             dynamic_signature, true};
+  }
+}
 
-  check_renderables();
+void Renderer::build_draw_batches() {
+  _instances.clear();
 
-  begin_command_buffer(_command_buffer);
+  _draw_refs.clear();
+  for (uint32_t item_idx : _camera_visible) {
+    _draw_refs.push_back(DrawRef{item_idx, 0});
+  }
+  build_draw_batches(_draw_refs, _camera_batches, true);
 
-  render_shadow_maps(_command_buffer);
-  render_g_buffer(_command_buffer);
-  render_shading(_command_buffer);
-  render_screenspace_effects(_command_buffer);
-  render_composite(_command_buffer);
+  build_shadow_groups(_static_shadow_groups, _static_shadow_updates, false);
+  build_shadow_groups(_dynamic_shadow_groups, _shadow_updates, true);
+}
 
-  submit_command_buffer(_command_buffer);
-  _frame_number++;
+void Renderer::build_shadow_groups(std::vector<ShadowGroup> &groups,
+                                   const std::vector<bool> &updates,
+                                   bool dynamic) {
+  int group_size = _layered_shadows ? MAX_SHADOW_VIEWPORTS : 1;
+  groups.clear();
+  for (int first_light = 0; first_light < _lights.size();
+       first_light += group_size) {
+    int light_count =
+        std::min<int>(group_size, _lights.size() - first_light);
+    _draw_refs.clear();
+    for (int light_idx = first_light; light_idx < first_light + light_count;
+         light_idx++) {
+      if (!updates[light_idx]) {
+        continue;
+      }
+      for (uint32_t item_idx : _light_visible[light_idx]) {
+        if (_draw_items[item_idx].dynamic == dynamic) {
+          _draw_refs.push_back(DrawRef{item_idx, light_idx});
+        }
+      }
+    }
+    if (_draw_refs.empty()) {
+      continue;
+    }
+    groups.push_back(ShadowGroup{first_light, light_count, {}});
+    build_draw_batches(_draw_refs, groups.back().batches);
+  }
 }
 
-void Renderer::bind_textures() {
-  std::vector<VkDescriptorImageInfo> image_infos(MAX_TEXTURE_COUNT);
-  for (auto iterator = texture_to_index.begin();
-       iterator != texture_to_index.end(); iterator++) {
-    Texture *texture = iterator->first;
-    int index = iterator->second;
-    image_infos[index] = VkDescriptorImageInfo{};
-    image_infos[index].imageLayout = texture->layout;
-    image_infos[index].imageView = texture->image_allocation.view;
-    image_infos[index].sampler = texture->sampler;
+void Renderer::build_draw_batches(std::vector<DrawRef> &refs,
+                                  std::vector<DrawBatch> &batches,
+                                  bool split_textures) {
+  // Same meshes next to each other, same textures within a mesh
+  std::sort(refs.begin(), refs.end(), [&](const DrawRef &a, const DrawRef &b) {
+    const DrawItem &item_a = _draw_items[a.item_idx];
+    const DrawItem &item_b = _draw_items[b.item_idx];
+    return std::tie(item_a.mesh, item_a.texture_idx, a.light_index) <
+           std::tie(item_b.mesh, item_b.texture_idx, b.light_index);
+  });
+
+  // The texture and the light are a part of the instance data. The shadow
+  // passes don't sample textures so only the mesh splits their batches, the
+  // G-buffer batches split on the texture too so that the texture index is
+  // uniform within a draw
+  batches.clear();
+  int texture_idx = 0;
+  for (const DrawRef &ref : refs) {
+    const DrawItem &item = _draw_items[ref.item_idx];
+    if (batches.empty() || batches.back().mesh != item.mesh ||
+        (split_textures && texture_idx != item.texture_idx)) {
+      batches.push_back(
+          DrawBatch{item.mesh, static_cast<uint32_t>(_instances.size()), 0});
+    }
+    batches.back().instance_count++;
+    texture_idx = item.texture_idx;
+
+    InstanceData instance;
+    Eigen::Matrix4f::Map(instance.model) = item.model;
+    instance.texture_idx = item.texture_idx;
+    instance.bitmask = item.bitmask;
+    instance.light_index = ref.light_index;
+    _instances.push_back(instance);
   }
+}
+
+void Renderer::upload_instances() {
+  void *datas[1] = {_instances.data()};
+  size_t sizes[1] = {sizeof(InstanceData) * _instances.size()};
+  _instance_offset = _upload_ring.upload(datas, sizes, 1);
+}
 
-  int valid_texture_count = texture_to_index.size();
-  auto dummy_texture = Texture::get_error_texture();
-  for (int i = 0; i < MAX_TEXTURE_COUNT - valid_texture_count; i++) {
-    image_infos[valid_texture_count + i] = VkDescriptorImageInfo{};
-    image_infos[valid_texture_count + i].imageLayout = dummy_texture->layout;
-    image_infos[valid_texture_count + i].imageView =
-        dummy_texture->image_allocation.view;
-    image_infos[valid_texture_count + i].sampler = dummy_texture->sampler;
+void Renderer::build_light_clusters() {
+  _light_clusters.set_projection(camera->projection, camera->near,
+                                 camera->far);
+  _light_clusters.clear();
+
+  Eigen::Matrix4f view = camera->get_view_matrix();
+  for (int light_idx = 0; light_idx < _lights.size(); light_idx++) {
+    Eigen::Vector3f center;
+    float radius;
+    _lights[light_idx]->get_bounding_sphere(center, radius);
+    _light_clusters.add_light(light_idx,
+                              (view * center.homogeneous()).head<3>(), radius);
   }
+  _light_clusters.build();
+}
 
-  deferred_pass.material.ds_allocator.bind_image_infos(0, 0, image_infos);
-  shading_pass.material.ds_allocator.bind_image_infos(0, 0, image_infos);
+void Renderer::upload_light_clusters() {
+  void *datas[3] = {&_light_clusters.header, _light_clusters.ranges.data(),
+                    _light_clusters.light_indices.data()};
+  size_t sizes[3] = {sizeof(LightClusters::Header),
+                     sizeof(uint32_t) * _light_clusters.ranges.size(),
+                     sizeof(uint32_t) * _light_clusters.light_indices.size()};
+  _light_cluster_offset = _upload_ring.upload(datas, sizes, 3);
 }
 
-void Renderer::render_shadow_maps(VkCommandBuffer &command_buffer) {
-  begin_render_pass(
-      shadow_pass.render_pass, shadow_pass.framebuffer, command_buffer,
-      VkExtent2D{SHADOW_ATLAS_RESOLUTION, SHADOW_ATLAS_RESOLUTION}, 1.0f,
-      nullptr, 0, 1.0f);
+void Renderer::upload_camera(const Eigen::Matrix4f &view,
+                             const Eigen::Matrix4f &projection,
+                             const Eigen::Matrix4f &view_projection) {
+  Eigen::Matrix4f inverse_view_projection = view_projection.inverse();
+  Eigen::Vector4f position;
+  position << camera->position, 1.0f;
+  uint32_t frame_index = _frame_number;
+
+  void *datas[6] = {(void *)view.data(),
+                    (void *)projection.data(),
+                    position.data(),
+                    inverse_view_projection.data(),
+                    _previous_view_projection.data(),
+                    &frame_index};
+  size_t sizes[6] = {sizeof(float) * view.size(),
+                     sizeof(float) * projection.size(),
+                     sizeof(float) * position.size(),
+                     sizeof(float) * inverse_view_projection.size(),
+                     sizeof(float) * _previous_view_projection.size(),
+                     sizeof(frame_index)};
+  _camera_offset = _upload_ring.upload(datas, sizes, 6);
+}
 
-  shadow_pass.bind_buffer(0, 0, _camera_buffer);
-  shadow_pass.bind_buffer(0, 1, _light_buffer);
+void Renderer::reserve_upload_ring() {
+  size_t debug_instances = std::min<size_t>(
+      _debug_draw.get_instance_count(), MAX_DEBUG_INSTANCES);
+  size_t required =
+      _upload_ring.get_aligned_size(sizeof(CameraInfo)) +
+      _upload_ring.get_aligned_size(sizeof(LightBufferHeader) +
+                                    sizeof(LightSource) *
+                                        _light_sources.size()) +
+      _upload_ring.get_aligned_size(sizeof(InstanceData) * _instances.size()) +
+      _upload_ring.get_aligned_size(
+          sizeof(LightClusters::Header) +
+          sizeof(uint32_t) * (_light_clusters.ranges.size() +
+                              _light_clusters.light_indices.size())) +
+      _upload_ring.get_aligned_size(sizeof(DebugInstance) * debug_instances);
+  if (required <= _upload_ring.get_frame_size()) {
+    return;
+  }
 
-  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  size_t frame_size = _upload_ring.get_frame_size();
+  while (frame_size < required) {
+    frame_size *= 2;
+  }
+  // Earlier frames may still read the old ring
+  vkDeviceWaitIdle(_device);
+  _upload_ring.destroy();
+  _upload_ring.init(frame_size, frames_in_flight,
+                    std::max(min_ubo_alignment, min_ssbo_alignment),
+                    _allocator);
+  bind_upload_ring();
+}
 
-  VkViewport viewport;
-  VkRect2D scissor;
+void Renderer::init_ring_bindings() {
+  auto add = [&](Material &material, int set, int binding, uint32_t &offset) {
+    _ring_bindings.push_back({&material.ds_allocator, set, binding, &offset});
+  };
+  add(shadow_pass.material, 0, 0, _camera_offset);
+  add(shadow_pass.material, 0, 1, _light_offset);
+  add(shadow_pass.material, 0, 2, _instance_offset);
+  add(deferred_pass.material, 1, 0, _camera_offset);
+  add(deferred_pass.material, 1, 3, _instance_offset);
+  add(screenspace_effects_pass.material, 1, 0, _camera_offset);
+  add(shading_pass.material, 1, 0, _camera_offset);
+  add(shading_pass.material, 1, 1, _light_offset);
+  add(shading_pass.material, 1, 7, _light_cluster_offset);
+  add(composite_pass.material, 0, 0, _camera_offset);
+  add(composite_pass.debug_material, 0, 0, _camera_offset);
+  add(composite_pass.debug_material, 0, 1, _debug_instance_offset);
+  if (hiz_reflections) {
+    for (RenderPass &pass : hiz_passes) {
+      add(pass.material, 0, 0, _camera_offset);
+    }
+    add(reflection_trace_pass.material, 0, 0, _camera_offset);
+    for (RenderPass &pass : reflection_history_passes) {
+      add(pass.material, 0, 0, _camera_offset);
+    }
+    add(screenspace_smoothing_pass.material, 0, 0, _camera_offset);
+  }
+}
 
-  viewport = {0, 0, SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION, 0, 1};
-  scissor = {0, 0, SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION};
+void Renderer::init_frame_materials() {
+  _frame_materials = {&shadow_pass.material,
+                      &deferred_pass.material,
+                      &screenspace_effects_pass.material,
+                      &shading_pass.material,
+                      &composite_pass.material,
+                      &composite_pass.debug_material};
+  if (hiz_reflections) {
+    for (RenderPass &pass : hiz_passes) {
+      _frame_materials.push_back(&pass.material);
+    }
+    _frame_materials.push_back(&reflection_trace_pass.material);
+    for (RenderPass &pass : reflection_history_passes) {
+      _frame_materials.push_back(&pass.material);
+    }
+    _frame_materials.push_back(&screenspace_smoothing_pass.material);
+  }
+}
 
-  for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
-           registry.archetype_iterator<Renderable, Transform>();
-       rb_iterator.valid(); ++rb_iterator) {
-    rend::ECS::EID eid = *rb_iterator;
+// Only needed when the ring buffer is created
+void Renderer::bind_upload_ring() {
+  for (RingBinding &ring_binding : _ring_bindings) {
+    ring_binding.ds_allocator->bind_buffer(
+        ring_binding.set, ring_binding.binding, _upload_ring.buffer,
+        _upload_ring.get_frame_size());
+  }
+}
 
-    Renderable &renderable = registry.get_component<Renderable>(eid);
-    Material &material = shadow_pass.material;
-    Mesh::Ptr mesh = renderable.p_mesh;
+void Renderer::set_ring_offsets() {
+  for (RingBinding &ring_binding : _ring_bindings) {
+    ring_binding.ds_allocator->set_dynamic_offset(
+        ring_binding.set, ring_binding.binding, *ring_binding.offset);
+  }
+}
 
-    Transform &transform = registry.get_component<Transform>(eid);
+void Renderer::find_reflective_tiles(const Eigen::Matrix4f &view_projection) {
+  _reflection_tiles.clear();
+  for (uint32_t item_idx : _camera_visible) {
+    if (_draw_items[item_idx].bitmask & 0x1) {
+      _reflection_tiles.add_box(_draw_bounds.get_min(item_idx),
+                                _draw_bounds.get_max(item_idx),
+                                view_projection);
+    }
+  }
+  _reflection_tiles.get_spans(_reflection_spans);
+}
 
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      material.pipeline);
+void Renderer::draw() {
+  Eigen::Matrix4f projection = camera->projection;
+  Eigen::Matrix4f view = camera->get_view_matrix();
+  Eigen::Matrix4f view_projection = projection * view;
 
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            material.pipeline_layout, 0,
-                            material.ds_allocator.descriptor_sets.size(),
-                            material.ds_allocator.descriptor_sets.data(), 0,
-                            nullptr);
+  gather_lights();
+  allocate_shadow_tiles();
+  build_light_clusters();
 
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(command_buffer, 0, 1,
-                           &mesh->buffer_allocation.buffer, &offset);
+  check_renderables();
+  cull_renderables();
+  schedule_shadow_updates();
+  build_draw_batches();
+  if (hiz_reflections) {
+    find_reflective_tiles(view_projection);
+  }
 
-    PushConstants constants;
-    Eigen::Matrix4f model = transform.get_model_matrix();
-    Eigen::Matrix4f::Map(constants.model) = model;
-    constants.texture_idx = texture_to_index[renderable.p_texture.get()] + 1;
-    constants.light_index = 0;
+  VkCommandBuffer &command_buffer = get_current_frame().command_buffer;
+  begin_command_buffer(command_buffer);
+  reserve_upload_ring();
+  _upload_ring.begin_frame(_frame_number);
+  // Data of the fullscreen passes first, their offsets only change with
+  // the light count and don't force the pre-recorded passes to re-record
+  upload_camera(view, projection, view_projection);
+  upload_lights();
+  upload_light_clusters();
+  upload_instances();
+  upload_debug_instances();
+  _upload_ring.flush();
+  set_ring_offsets();
+
+  render_shadow_maps(command_buffer);
+  render_g_buffer(command_buffer);
+  render_shading(command_buffer);
+  render_screenspace_effects(command_buffer);
+  if (hiz_reflections) {
+    render_hiz(command_buffer);
+    render_reflections(command_buffer);
+    render_screenspace_smoothing(command_buffer);
+  }
+  render_composite(command_buffer);
 
-    for (int light_idx = 0; light_idx < lights.size(); light_idx++) {
-      if (!lights[light_idx].enabled()) {
-        continue;
-      }
-      int light_x = light_idx % SHADOW_ATLAS_LIGHTS_PER_ROW;
-      int light_y = light_idx / SHADOW_ATLAS_LIGHTS_PER_ROW;
-
-      viewport = {static_cast<float>(light_x * SHADOW_MAP_RESOLUTION),
-                  static_cast<float>(light_y * SHADOW_MAP_RESOLUTION),
-                  SHADOW_MAP_RESOLUTION,
-                  SHADOW_MAP_RESOLUTION,
-                  0,
-                  1};
-      scissor = {light_x * SHADOW_MAP_RESOLUTION,
-                 light_y * SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION,
-                 SHADOW_MAP_RESOLUTION};
-
-      vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-      vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+  submit_command_buffer(command_buffer);
+  _previous_view_projection = view_projection;
+  _frame_number++;
+}
+
+void Renderer::render_shadow_maps(VkCommandBuffer &command_buffer) {
+  VkImage &static_atlas =
+      static_shadow_pass.depth_attachment.image_allocation.image;
+  VkImage &atlas = shadow_pass.depth_attachment.image_allocation.image;
+  if (!_shadow_atlases_initialized) {
+    // Every tile is drawn before it is first sampled, the contents can be
+    // discarded
+    static_shadow_pass.change_image_layout(
+        static_atlas, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 0,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+        command_buffer);
+    shadow_pass.change_image_layout(
+        atlas, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, 0,
+        VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+        command_buffer);
+    _shadow_atlases_initialized = true;
+  }
 
-      constants.light_index = light_idx;
-      vkCmdPushConstants(command_buffer, material.pipeline_layout,
-                         material.spec.push_constants_description.stageFlags, 0,
-                         sizeof(PushConstants), &constants);
-      vkCmdDraw(command_buffer, renderable.p_mesh->vertex_count(), 1, 0, 0);
+  std::vector<VkClearRect> clear_rects; // Static layers to redraw
+  std::vector<VkImageCopy> copies;      // Updated tiles
+  for (int light_idx = 0; light_idx < _lights.size(); light_idx++) {
+    if (!_shadow_updates[light_idx]) {
+      continue;
+    }
+    const ShadowAtlasRect &rect = _shadow_rects[light_idx];
+    if (_static_shadow_updates[light_idx]) {
+      clear_rects.push_back(VkClearRect{
+          {{static_cast<int32_t>(rect.x), static_cast<int32_t>(rect.y)},
+           {rect.size, rect.size}},
+          0,
+          1});
     }
+    VkImageCopy copy = {};
+    copy.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1};
+    copy.srcOffset = {static_cast<int32_t>(rect.x),
+                      static_cast<int32_t>(rect.y), 0};
+    copy.dstSubresource = copy.srcSubresource;
+    copy.dstOffset = copy.srcOffset;
+    copy.extent = {rect.size, rect.size, 1};
+    copies.push_back(copy);
+  }
+  // Every tile is cached, the atlas is still readable from the last update
+  if (copies.empty()) {
+    return;
+  }
+
+  std::vector<VkCommandBuffer> secondaries;
+  if (!clear_rects.empty()) {
+    begin_render_pass(
+        static_shadow_pass.render_pass, static_shadow_pass.framebuffer,
+        command_buffer,
+        VkExtent2D{SHADOW_ATLAS_RESOLUTION, SHADOW_ATLAS_RESOLUTION}, 1.0f,
+        nullptr, 0, 1.0f, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    // The subpass only takes secondary command buffers, even for the clear
+    VkCommandBuffer clear_buffer = _secondary_pools.begin(
+        static_shadow_pass.render_pass, static_shadow_pass.framebuffer);
+    VkClearAttachment clear = {};
+    clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    clear.clearValue.depthStencil = {1.0f, 0};
+    vkCmdClearAttachments(clear_buffer, 1, &clear, clear_rects.size(),
+                          clear_rects.data());
+    VK_CHECK(vkEndCommandBuffer(clear_buffer), "Failed to end command buffer");
+    secondaries.push_back(clear_buffer);
+    record_shadow_groups(static_shadow_pass, _static_shadow_groups,
+                         secondaries);
+    vkCmdExecuteCommands(command_buffer, secondaries.size(),
+                         secondaries.data());
+    end_render_pass(command_buffer);
   }
 
+  // Start the updated tiles from their static layer
+  static_shadow_pass.change_image_layout(
+      static_atlas, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+      command_buffer);
+  shadow_pass.change_image_layout(
+      atlas, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+      command_buffer);
+  vkCmdCopyImage(command_buffer, static_atlas,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, atlas,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies.size(),
+                 copies.data());
+  static_shadow_pass.change_image_layout(
+      static_atlas, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      VK_ACCESS_TRANSFER_READ_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+      command_buffer);
+  shadow_pass.change_image_layout(
+      atlas, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_IMAGE_ASPECT_DEPTH_BIT,
+      command_buffer);
+
+  begin_render_pass(
+      shadow_pass.render_pass, shadow_pass.framebuffer, command_buffer,
+      VkExtent2D{SHADOW_ATLAS_RESOLUTION, SHADOW_ATLAS_RESOLUTION}, 1.0f,
+      nullptr, 0, 1.0f, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  secondaries.clear();
+  record_shadow_groups(shadow_pass, _dynamic_shadow_groups, secondaries);
+  if (!secondaries.empty()) {
+    vkCmdExecuteCommands(command_buffer, secondaries.size(),
+                         secondaries.data());
+  }
   end_render_pass(command_buffer);
   shadow_pass.make_attachments_readable(command_buffer);
 }
 
+template <typename Function>
+void Renderer::record_secondary(RenderPass &pass, uint32_t count,
+                                uint32_t min_batch_size,
+                                const Function &record,
+                                std::vector<VkCommandBuffer> &secondaries) {
+  JobSystem &job_system = get_job_system();
+  uint32_t batch_size = job_system.get_batch_size(count, min_batch_size);
+  size_t first = secondaries.size();
+  secondaries.resize(first + (count + batch_size - 1) / batch_size);
+  job_system.parallel_for(
+      count, batch_size, [&](uint32_t begin, uint32_t end, uint32_t batch) {
+        VkCommandBuffer command_buffer =
+            _secondary_pools.begin(pass.render_pass, pass.framebuffer);
+        record(command_buffer, begin, end);
+        VK_CHECK(vkEndCommandBuffer(command_buffer),
+                 "Failed to end command buffer");
+        secondaries[first + batch] = command_buffer;
+      });
+}
+
+void Renderer::record_shadow_groups(RenderPass &pass,
+                                    const std::vector<ShadowGroup> &groups,
+                                    std::vector<VkCommandBuffer> &secondaries) {
+  shadow_pass.material.ds_allocator.flush(); // Not thread safe
+  record_secondary(
+      pass, groups.size(), 1,
+      [&](VkCommandBuffer command_buffer, uint32_t begin, uint32_t end) {
+        draw_shadow_groups(command_buffer, groups, begin, end);
+      },
+      secondaries);
+}
+
+void Renderer::draw_shadow_groups(VkCommandBuffer command_buffer,
+                                  const std::vector<ShadowGroup> &groups,
+                                  uint32_t begin, uint32_t end) {
+  // Both atlases are drawn with the shadow pass pipeline, their render
+  // passes are compatible
+  Material &material = shadow_pass.material;
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    material.pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          material.pipeline_layout, 0,
+                          material.ds_allocator.descriptor_sets.size(),
+                          material.ds_allocator.descriptor_sets.data(),
+                          material.ds_allocator.dynamic_offsets.size(),
+                          material.ds_allocator.dynamic_offsets.data());
+
+  // The pipeline's viewports are all dynamic, every one of them is set even
+  // when the group has fewer lights
+  int viewport_count = material.spec.viewport_count;
+  VkViewport viewports[MAX_SHADOW_VIEWPORTS];
+  VkRect2D scissors[MAX_SHADOW_VIEWPORTS];
+  for (uint32_t group_idx = begin; group_idx < end; group_idx++) {
+    const ShadowGroup &group = groups[group_idx];
+    // Viewport i of the group is the atlas tile of light first_light + i,
+    // lights without a tile and unused slots get a valid 1x1 viewport
+    for (int i = 0; i < viewport_count; i++) {
+      ShadowAtlasRect rect{};
+      if (i < group.light_count) {
+        rect = _shadow_rects[group.first_light + i];
+      }
+      if (rect.size == 0) {
+        rect.size = 1;
+      }
+      viewports[i] = {static_cast<float>(rect.x),
+                      static_cast<float>(rect.y),
+                      static_cast<float>(rect.size),
+                      static_cast<float>(rect.size),
+                      0,
+                      1};
+      scissors[i] = {static_cast<int32_t>(rect.x),
+                     static_cast<int32_t>(rect.y), rect.size, rect.size};
+    }
+    vkCmdSetViewport(command_buffer, 0, viewport_count, viewports);
+    vkCmdSetScissor(command_buffer, 0, viewport_count, scissors);
+
+    PushConstants constants;
+    constants.light_index = group.first_light;
+    vkCmdPushConstants(command_buffer, material.pipeline_layout,
+                       material.spec.push_constants_description.stageFlags, 0,
+                       sizeof(PushConstants), &constants);
+
+    // Casters inside the frustums of the group's lights, every instance
+    // carries the light it is drawn for
+    for (const DrawBatch &batch : group.batches) {
+      VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(command_buffer, 0, 1,
+                             &batch.mesh->buffer_allocation.buffer, &offset);
+      vkCmdDraw(command_buffer, batch.mesh->vertex_count(),
+                batch.instance_count, 0, batch.first_instance);
+    }
+  }
+}
+
 void Renderer::render_g_buffer(VkCommandBuffer &command_buffer) {
   float clear_values[3] = {0.0f, 0.0f, 0.0f};
   begin_render_pass(deferred_pass.render_pass, deferred_pass.framebuffer,
                     command_buffer, deferred_pass.spec.extent, 1.0f,
-                    clear_values, 3, 0.0f);
-
-  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+                    clear_values, deferred_pass.color_attachments.size(),
+                    0.0f, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
   VkViewport viewport{0,
                       0,
@@ -1293,46 +2224,41 @@ void Renderer::render_g_buffer(VkCommandBuffer &command_buffer) {
                       0,
                       1};
   VkRect2D scissor{0, 0, _window_dims.width, _window_dims.height};
-  deferred_pass.bind_buffer(1, 0, _camera_buffer);
-
-  for (rend::ECS::EntityRegistry::ArchetypeIterator rb_iterator =
-           registry.archetype_iterator<Renderable, Transform>();
-       rb_iterator.valid(); ++rb_iterator) {
-    rend::ECS::EID eid = *rb_iterator;
-
-    Renderable &renderable = registry.get_component<Renderable>(eid);
-
-    Material &material = deferred_pass.material;
-    Mesh::Ptr mesh = renderable.p_mesh;
-
-    Transform &transform = registry.get_component<Transform>(eid);
-
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      material.pipeline);
-
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            material.pipeline_layout, 0,
-                            material.ds_allocator.descriptor_sets.size(),
-                            material.ds_allocator.descriptor_sets.data(), 0,
-                            nullptr);
-
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(command_buffer, 0, 1,
-                           &mesh->buffer_allocation.buffer, &offset);
 
-    PushConstants constants;
-    Eigen::Matrix4f model = transform.get_model_matrix();
-    Eigen::Matrix4f::Map(constants.model) = model;
-    constants.texture_idx = texture_to_index[renderable.p_texture.get()] + 1;
-    constants.light_index = 0;
-    constants.bitmask = renderable.reflective ? 1 : 0; // Reflectance bitmask
-
-    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-    vkCmdPushConstants(command_buffer, material.pipeline_layout,
-                       material.spec.push_constants_description.stageFlags, 0,
-                       sizeof(PushConstants), &constants);
-    vkCmdDraw(command_buffer, renderable.p_mesh->vertex_count(), 1, 0, 0);
+  // Chunks of the batches are recorded in parallel, state isn't inherited
+  // by secondary command buffers so every chunk binds it again
+  Material &material = deferred_pass.material;
+  material.ds_allocator.flush(); // Not thread safe, before the jobs
+  std::vector<VkCommandBuffer> secondaries;
+  record_secondary(
+      deferred_pass, _camera_batches.size(), G_BUFFER_MIN_RECORD_BATCH,
+      [&](VkCommandBuffer secondary, uint32_t begin, uint32_t end) {
+        vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          material.pipeline);
+        vkCmdBindDescriptorSets(
+            secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+            material.pipeline_layout, 0,
+            material.ds_allocator.descriptor_sets.size(),
+            material.ds_allocator.descriptor_sets.data(),
+            material.ds_allocator.dynamic_offsets.size(),
+            material.ds_allocator.dynamic_offsets.data());
+        vkCmdSetViewport(secondary, 0, 1, &viewport);
+        vkCmdSetScissor(secondary, 0, 1, &scissor);
+
+        for (uint32_t batch_idx = begin; batch_idx < end; batch_idx++) {
+          const DrawBatch &batch = _camera_batches[batch_idx];
+          VkDeviceSize offset = 0;
+          vkCmdBindVertexBuffers(secondary, 0, 1,
+                                 &batch.mesh->buffer_allocation.buffer,
+                                 &offset);
+          vkCmdDraw(secondary, batch.mesh->vertex_count(),
+                    batch.instance_count, 0, batch.first_instance);
+        }
+      },
+      secondaries);
+  if (!secondaries.empty()) {
+    vkCmdExecuteCommands(command_buffer, secondaries.size(),
+                         secondaries.data());
   }
 
   end_render_pass(command_buffer);
@@ -1340,128 +2266,309 @@ void Renderer::render_g_buffer(VkCommandBuffer &command_buffer) {
   deferred_pass.make_attachments_readable(command_buffer);
 }
 
+void Renderer::bind_g_buffer(DescriptorSetAllocator &ds_allocator, int set,
+                             int first_binding) {
+  std::vector<Attachment> &color = deferred_pass.color_attachments;
+  Attachment &depth = deferred_pass.depth_attachment;
+  // The compact layout has no position attachment, the shaders rebuild the
+  // position from the depth bound in its place
+  Attachment *attachments[4] = {&color[0],
+                                compact_gbuffer ? &depth : &color[2],
+                                &color[1], &depth};
+  for (int i = 0; i < 4; i++) {
+    VkImageLayout layout = attachments[i] == &depth
+                               ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                               : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    ds_allocator.bind_image(set, first_binding + i,
+                            attachments[i]->image_allocation, layout,
+                            attachments[i]->sampler);
+  }
+}
+
 void Renderer::render_screenspace_effects(VkCommandBuffer &command_buffer) {
   float clear_values[2] = {0.0f, 0.0f};
   begin_render_pass(screenspace_effects_pass.render_pass,
                     screenspace_effects_pass.framebuffer, command_buffer,
-                    _window_dims, 1.0f, clear_values, 2, 0.0f);
-
-  screenspace_effects_pass.bind_buffer(1, 0, _camera_buffer);
+                    _window_dims, 1.0f, clear_values, 2, 0.0f,
+                    VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  VkCommandBuffer prerecorded = get_prerecorded_pass(
+      _prerecorded_screenspace, screenspace_effects_pass.material,
+      screenspace_effects_pass.render_pass,
+      screenspace_effects_pass.framebuffer, _window_dims);
+  vkCmdExecuteCommands(command_buffer, 1, &prerecorded);
+  end_render_pass(command_buffer);
+  screenspace_effects_pass.make_attachments_readable(command_buffer);
+}
 
-  for (int i = 0; i < deferred_pass.color_attachments.size(); i++) {
-    screenspace_effects_pass.bind_image_attachment(
-        1, 1 + i, deferred_pass.color_attachments[i]);
+VkCommandBuffer Renderer::get_prerecorded_pass(PrerecordedPass &prerecorded,
+                                               Material &material,
+                                               VkRenderPass render_pass,
+                                               VkFramebuffer framebuffer,
+                                               VkExtent2D extent) {
+  uint32_t frame_idx = _frame_number % _frames.size();
+  DescriptorSetAllocator &ds_allocator = material.ds_allocator;
+  ds_allocator.flush();
+  VkCommandBuffer command_buffer = prerecorded.command_buffers[frame_idx];
+  // The frame's fence was waited on, the buffer isn't pending anymore
+  if (prerecorded.update_counts[frame_idx] ==
+          ds_allocator.get_update_count(frame_idx) &&
+      prerecorded.dynamic_offsets[frame_idx] == ds_allocator.dynamic_offsets) {
+    return command_buffer;
   }
-  screenspace_effects_pass.bind_image_attachment(
-      1, 1 + deferred_pass.color_attachments.size(),
-      deferred_pass.depth_attachment);
-  screenspace_effects_pass.bind_image_attachment(
-      1, 1 + deferred_pass.color_attachments.size() + 1,
-      shading_pass.color_attachments[0]);
-
-  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  prerecorded.update_counts[frame_idx] =
+      ds_allocator.get_update_count(frame_idx);
+  prerecorded.dynamic_offsets[frame_idx] = ds_allocator.dynamic_offsets;
+
+  VkCommandBufferInheritanceInfo inheritance_info = {};
+  inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritance_info.pNext = nullptr;
+  inheritance_info.renderPass = render_pass;
+  inheritance_info.subpass = 0;
+  inheritance_info.framebuffer = framebuffer;
+
+  VkCommandBufferBeginInfo begin_info = {};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.pNext = nullptr;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  begin_info.pInheritanceInfo = &inheritance_info;
+  VK_CHECK(vkBeginCommandBuffer(command_buffer, &begin_info),
+           "Failed to begin command buffer");
 
   VkViewport viewport{0,
                       0,
-                      static_cast<float>(_window_dims.width),
-                      static_cast<float>(_window_dims.height),
+                      static_cast<float>(extent.width),
+                      static_cast<float>(extent.height),
                       0,
                       1};
-  VkRect2D scissor{0, 0, _window_dims.width, _window_dims.height};
+  VkRect2D scissor{0, 0, extent.width, extent.height};
   vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    screenspace_effects_pass.material.pipeline);
-  vkCmdBindDescriptorSets(
-      command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-      screenspace_effects_pass.material.pipeline_layout, 0,
-      screenspace_effects_pass.material.ds_allocator.descriptor_sets.size(),
-      screenspace_effects_pass.material.ds_allocator.descriptor_sets.data(), 0,
-      nullptr);
-
+                    material.pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          material.pipeline_layout, 0,
+                          ds_allocator.descriptor_sets.size(),
+                          ds_allocator.descriptor_sets.data(),
+                          ds_allocator.dynamic_offsets.size(),
+                          ds_allocator.dynamic_offsets.data());
   vkCmdSetViewport(command_buffer, 0, 1, &viewport);
   vkCmdSetScissor(command_buffer, 0, 1, &scissor);
   vkCmdDraw(command_buffer, 3, 1, 0, 0);
 
-  end_render_pass(command_buffer);
-  screenspace_effects_pass.make_attachments_readable(command_buffer);
+  VK_CHECK(vkEndCommandBuffer(command_buffer), "Failed to end command buffer");
+  return command_buffer;
 }
 
-void Renderer::render_shading(VkCommandBuffer &command_buffer) {
-  float clear_value = 0.0f;
-  begin_render_pass(shading_pass.render_pass, shading_pass.framebuffer,
-                    command_buffer, _window_dims, 1.0f, &clear_value, 1, 1.0f);
-
-  shading_pass.bind_buffer(1, 0, _camera_buffer);
-  shading_pass.bind_buffer(1, 1, _light_buffer);
+void Renderer::bind_fullscreen_inputs() {
   shading_pass.bind_image_attachment(1, 2, shadow_pass.depth_attachment);
+  bind_g_buffer(shading_pass.material.ds_allocator, 1, 3);
 
-  for (int i = 0; i < deferred_pass.color_attachments.size(); i++) {
-    shading_pass.bind_image_attachment(1, 3 + i,
-                                       deferred_pass.color_attachments[i]);
+  bind_g_buffer(screenspace_effects_pass.material.ds_allocator, 1, 1);
+  screenspace_effects_pass.bind_image_attachment(
+      1, 5, shading_pass.color_attachments[0]);
+
+  DescriptorSetAllocator &composite = composite_pass.material.ds_allocator;
+  composite.bind_image(1, 0, shadow_pass.depth_attachment.image_allocation,
+                       VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                       shadow_pass.depth_attachment.sampler);
+  bind_g_buffer(composite, 1, 1);
+  composite.bind_image(1, 5, shading_pass.color_attachments[0].image_allocation,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                       shading_pass.color_attachments[0].sampler);
+  for (int i = 0; i < screenspace_effects_pass.color_attachments.size(); i++) {
+    Attachment &attachment = screenspace_effects_pass.color_attachments[i];
+    composite.bind_image(1, 6 + i, attachment.image_allocation,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         attachment.sampler);
+  }
+  if (!hiz_reflections) {
+    return;
+  }
+  Attachment &smoothed = screenspace_smoothing_pass.color_attachments[0];
+  composite.bind_image(1, 7, smoothed.image_allocation,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                       smoothed.sampler);
+
+  for (int level = 0; level < HIZ_LEVELS; level++) {
+    hiz_passes[level].bind_image_attachment(
+        1, 0,
+        level == 0 ? deferred_pass.depth_attachment
+                   : hiz_passes[level - 1].color_attachments[0]);
   }
-  shading_pass.bind_image_attachment(1,
-                                     3 + deferred_pass.color_attachments.size(),
-                                     deferred_pass.depth_attachment);
 
-  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  bind_g_buffer(reflection_trace_pass.material.ds_allocator, 1, 0);
+  reflection_trace_pass.bind_image_attachment(
+      1, 4, shading_pass.color_attachments[0]);
+  std::vector<VkDescriptorImageInfo> hiz_infos(HIZ_LEVELS);
+  for (int level = 0; level < HIZ_LEVELS; level++) {
+    Attachment &attachment = hiz_passes[level].color_attachments[0];
+    hiz_infos[level].sampler = attachment.sampler;
+    hiz_infos[level].imageView = attachment.image_allocation.view;
+    hiz_infos[level].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+  reflection_trace_pass.material.ds_allocator.bind_image_infos(1, 5,
+                                                               hiz_infos);
+
+  // Every history pass accumulates into itself from the other one
+  for (int i = 0; i < 2; i++) {
+    RenderPass &accumulated = reflection_history_passes[i];
+    accumulated.bind_image_attachment(
+        1, 0, reflection_trace_pass.color_attachments[0]);
+    accumulated.bind_image_attachment(
+        1, 1, reflection_history_passes[1 - i].color_attachments[0]);
+    accumulated.bind_image_attachment(1, 2,
+                                      hiz_passes[0].color_attachments[0]);
+  }
+
+  screenspace_smoothing_pass.bind_image_attachment(
+      1, 0, deferred_pass.depth_attachment);
+  screenspace_smoothing_pass.bind_image_attachment(
+      1, 1, hiz_passes[0].color_attachments[0]);
+}
+
+void Renderer::render_fullscreen_pass(
+    VkCommandBuffer &command_buffer, RenderPass &pass,
+    const std::vector<ScreenTileMask::Span> *spans) {
+  float clear_value = 0.0f;
+  begin_render_pass(pass.render_pass, pass.framebuffer, command_buffer,
+                    pass.spec.extent, 1.0f, &clear_value, 1, 0.0f);
+  if (spans != nullptr && spans->empty()) { // Only cleared
+    end_render_pass(command_buffer);
+    pass.make_attachments_readable(command_buffer);
+    return;
+  }
 
   VkViewport viewport{0,
                       0,
-                      static_cast<float>(_window_dims.width),
-                      static_cast<float>(_window_dims.height),
+                      static_cast<float>(pass.spec.extent.width),
+                      static_cast<float>(pass.spec.extent.height),
                       0,
                       1};
-  VkRect2D scissor{0, 0, _window_dims.width, _window_dims.height};
+  pass.material.ds_allocator.flush();
   vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    shading_pass.material.pipeline);
+                    pass.material.pipeline);
   vkCmdBindDescriptorSets(
       command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-      shading_pass.material.pipeline_layout, 0,
-      shading_pass.material.ds_allocator.descriptor_sets.size(),
-      shading_pass.material.ds_allocator.descriptor_sets.data(), 0, nullptr);
-
+      pass.material.pipeline_layout, 0,
+      pass.material.ds_allocator.descriptor_sets.size(),
+      pass.material.ds_allocator.descriptor_sets.data(),
+      pass.material.ds_allocator.dynamic_offsets.size(),
+      pass.material.ds_allocator.dynamic_offsets.data());
   vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-  vkCmdDraw(command_buffer, 3, 1, 0, 0);
+
+  if (spans == nullptr) {
+    VkRect2D scissor{0, 0, pass.spec.extent.width, pass.spec.extent.height};
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+  } else {
+    for (const ScreenTileMask::Span &span : *spans) {
+      VkRect2D scissor{static_cast<int32_t>(span.x),
+                       static_cast<int32_t>(span.y), span.width, span.height};
+      vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+      vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    }
+  }
 
   end_render_pass(command_buffer);
+  pass.make_attachments_readable(command_buffer);
+}
 
-  shading_pass.make_attachments_readable(command_buffer);
+void Renderer::render_hiz(VkCommandBuffer &command_buffer) {
+  for (int level = 0; level < HIZ_LEVELS; level++) {
+    render_fullscreen_pass(command_buffer, hiz_passes[level]);
+  }
 }
 
-void Renderer::render_composite(VkCommandBuffer &command_buffer) {
+void Renderer::render_reflections(VkCommandBuffer &command_buffer) {
+  RenderPass &accumulated = reflection_history_passes[_frame_number % 2];
+  RenderPass &history = reflection_history_passes[(_frame_number + 1) % 2];
+  if (!_reflection_history_valid) {
+    // Cleared history, the temporal pass clamps it to the traced values
+    std::vector<ScreenTileMask::Span> no_spans;
+    render_fullscreen_pass(command_buffer, history, &no_spans);
+    _reflection_history_valid = true;
+  }
+
+  render_fullscreen_pass(command_buffer, reflection_trace_pass,
+                         &_reflection_spans);
+
+  // Outside of the spans nothing was traced and the history is clamped to 0
+  render_fullscreen_pass(command_buffer, accumulated, &_reflection_spans);
+}
+
+void Renderer::render_screenspace_smoothing(VkCommandBuffer &command_buffer) {
+  // Alternates with the history, the other inputs are bound at init
+  RenderPass &accumulated = reflection_history_passes[_frame_number % 2];
+  screenspace_smoothing_pass.bind_image_attachment(
+      1, 2, accumulated.color_attachments[0]);
+  render_fullscreen_pass(command_buffer, screenspace_smoothing_pass);
+}
+
+void Renderer::render_shading(VkCommandBuffer &command_buffer) {
   float clear_value = 0.0f;
-  begin_render_pass(composite_pass.render_pass,
-                    composite_pass.framebuffers[_swapchain_img_idx],
-                    command_buffer, _window_dims, 1.0f, &clear_value, 1, 1.0f);
+  begin_render_pass(shading_pass.render_pass, shading_pass.framebuffer,
+                    command_buffer, _window_dims, 1.0f, &clear_value, 1, 1.0f,
+                    VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  VkCommandBuffer prerecorded = get_prerecorded_pass(
+      _prerecorded_shading, shading_pass.material, shading_pass.render_pass,
+      shading_pass.framebuffer, _window_dims);
+  vkCmdExecuteCommands(command_buffer, 1, &prerecorded);
+  end_render_pass(command_buffer);
 
-  composite_pass.material.bind_descriptor_buffer(0, 0, _camera_buffer);
-  composite_pass.material.ds_allocator.bind_image(
-      1, 0, shadow_pass.depth_attachment.image_allocation,
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
-      shadow_pass.depth_attachment.sampler);
+  shading_pass.make_attachments_readable(command_buffer);
+}
 
-  for (int i = 0; i < deferred_pass.color_attachments.size(); i++) {
-    Attachment &attachment = deferred_pass.color_attachments[i];
-    composite_pass.material.ds_allocator.bind_image(
-        1, i + 1, attachment.image_allocation,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, attachment.sampler);
+void Renderer::render_composite(VkCommandBuffer &command_buffer) {
+  float clear_value = 0.0f;
+  VkFramebuffer &framebuffer = composite_pass.framebuffers[_swapchain_img_idx];
+  begin_render_pass(composite_pass.render_pass, framebuffer, command_buffer,
+                    _window_dims, 1.0f, &clear_value, 1, 1.0f,
+                    VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+  // Recorded without a framebuffer, it is the same for every swapchain image
+  VkCommandBuffer secondaries[2];
+  uint32_t secondary_count = 0;
+  secondaries[secondary_count++] = get_prerecorded_pass(
+      _prerecorded_composite, composite_pass.material,
+      composite_pass.render_pass, VK_NULL_HANDLE, _window_dims);
+
+  // The subpass only takes secondary command buffers
+  if (debug_mode || show_gui) {
+    VkCommandBuffer overlay =
+        _secondary_pools.begin(composite_pass.render_pass, framebuffer);
+    render_debug(overlay);
+    render_gui(overlay);
+    VK_CHECK(vkEndCommandBuffer(overlay), "Failed to end command buffer");
+    secondaries[secondary_count++] = overlay;
   }
+  vkCmdExecuteCommands(command_buffer, secondary_count, secondaries);
 
-  composite_pass.material.ds_allocator.bind_image(
-      1, 4, deferred_pass.depth_attachment.image_allocation,
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
-      deferred_pass.depth_attachment.sampler);
+  end_render_pass(command_buffer);
+}
 
-  composite_pass.material.ds_allocator.bind_image(
-      1, 5, shading_pass.color_attachments[0].image_allocation,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-      shading_pass.color_attachments[0].sampler);
+void Renderer::upload_debug_instances() {
+  // Recorded instances are merged straight into the mapped ring
+  uint32_t capacity =
+      std::min<uint32_t>(_debug_draw.get_instance_count(), MAX_DEBUG_INSTANCES);
+  UploadRing::Allocation allocation =
+      _upload_ring.allocate(sizeof(DebugInstance) * capacity);
+  _debug_instance_offset = allocation.offset;
+  _debug_draw.merge(static_cast<DebugInstance *>(allocation.data), capacity,
+                    composite_pass.debug_instance_ranges);
+  // Reported once when the frames start overflowing, not on every frame
+  uint32_t dropped = _debug_draw.take_dropped_count();
+  if (dropped > 0 && dropped_debug_primitives == 0) {
+    std::cerr << "Dropping debug primitives, more than " << MAX_DEBUG_INSTANCES
+              << " per frame" << std::endl;
+  }
+  dropped_debug_primitives = dropped;
+}
 
-  for (int i = 0; i < screenspace_effects_pass.color_attachments.size(); i++) {
-    Attachment &attachment = screenspace_effects_pass.color_attachments[i];
-    composite_pass.material.ds_allocator.bind_image(
-        1, 6 + i, attachment.image_allocation,
-        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, attachment.sampler);
+void Renderer::render_debug(VkCommandBuffer &command_buffer) {
+  bool has_instances = false;
+  for (const DebugInstanceRange &range : composite_pass.debug_instance_ranges) {
+    has_instances |= range.count > 0;
+  }
+  if (!has_instances) {
+    return;
   }
 
   VkViewport viewport{0,
@@ -1471,47 +2578,34 @@ void Renderer::render_composite(VkCommandBuffer &command_buffer) {
                       0,
                       1};
   VkRect2D scissor{0, 0, _window_dims.width, _window_dims.height};
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    composite_pass.material.pipeline);
-  vkCmdBindDescriptorSets(
-      command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-      composite_pass.material.pipeline_layout, 0,
-      composite_pass.material.ds_allocator.descriptor_sets.size(),
-      composite_pass.material.ds_allocator.descriptor_sets.data(), 0, nullptr);
-
-  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
-  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-  vkCmdDraw(command_buffer, 3, 1, 0, 0);
-
-  render_debug(command_buffer);
-
-  render_gui(command_buffer);
-
-  end_render_pass(command_buffer);
-}
-
-void Renderer::render_debug(VkCommandBuffer &command_buffer) {
-  if (composite_pass.debug_verts_to_draw == 0) {
-    return;
-  }
-  composite_pass.buffer_allocation.copy_from(
-      composite_pass.debug_buffer,
-      composite_pass.debug_verts_to_draw * 6 * sizeof(float));
-
-  composite_pass.debug_material.bind_descriptor_buffer(0, 0, _camera_buffer);
   VkDeviceSize offset = 0;
+  composite_pass.debug_material.ds_allocator.flush();
   vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     composite_pass.debug_material.pipeline);
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
   vkCmdBindVertexBuffers(command_buffer, 0, 1,
-                         &composite_pass.buffer_allocation.buffer, &offset);
+                         &composite_pass.debug_vertex_buffer.buffer, &offset);
   vkCmdBindDescriptorSets(
       command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
       composite_pass.debug_material.pipeline_layout, 0,
       composite_pass.debug_material.ds_allocator.descriptor_sets.size(),
-      composite_pass.debug_material.ds_allocator.descriptor_sets.data(), 0,
-      nullptr);
-  vkCmdDraw(command_buffer, composite_pass.debug_verts_to_draw, 1, 0, 0);
-  composite_pass.debug_verts_to_draw = 0;
+      composite_pass.debug_material.ds_allocator.descriptor_sets.data(),
+      composite_pass.debug_material.ds_allocator.dynamic_offsets.size(),
+      composite_pass.debug_material.ds_allocator.dynamic_offsets.data());
+  // One instanced draw per unit primitive
+  for (uint32_t primitive = 0; primitive < DEBUG_PRIMITIVE_COUNT;
+       primitive++) {
+    const DebugInstanceRange &instances =
+        composite_pass.debug_instance_ranges[primitive];
+    const DebugVertexRange &vertices =
+        composite_pass.debug_vertex_ranges[primitive];
+    if (instances.count == 0) {
+      continue;
+    }
+    vkCmdDraw(command_buffer, vertices.count, instances.count, vertices.first,
+              instances.first);
+  }
 }
 
 void Renderer::render_gui(VkCommandBuffer &command_buffer) {
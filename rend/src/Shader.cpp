@@ -1,8 +1,9 @@
 #include <rend/Rendering/Vulkan/Shader.h>
 
 VkPipelineShaderStageCreateInfo
-Shader::get_shader_stage_info(VkShaderStageFlagBits stage,
-                              VkShaderModule shaderModule) {
+Shader::get_shader_stage_info(
+    VkShaderStageFlagBits stage, VkShaderModule shaderModule,
+    const VkSpecializationInfo *specialization_info) {
   VkPipelineShaderStageCreateInfo info{};
   info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   info.pNext = nullptr;
@@ -13,6 +14,7 @@ Shader::get_shader_stage_info(VkShaderStageFlagBits stage,
   info.module = shaderModule;
   // the entry point of the shader
   info.pName = "main";
+  info.pSpecializationInfo = specialization_info;
   return info;
 }
 
@@ -74,16 +76,20 @@ void Shader::deinit(VkDevice &_device) {
   }
 }
 
-VkPipelineShaderStageCreateInfo Shader::get_vertex_shader_stage_info() {
+VkPipelineShaderStageCreateInfo Shader::get_vertex_shader_stage_info(
+    const VkSpecializationInfo *specialization_info) {
   if (!_built_modules) {
     throw std::runtime_error("Shader not initialized");
   }
-  return get_shader_stage_info(VK_SHADER_STAGE_VERTEX_BIT, _vertex_module);
+  return get_shader_stage_info(VK_SHADER_STAGE_VERTEX_BIT, _vertex_module,
+                               specialization_info);
 }
 
-VkPipelineShaderStageCreateInfo Shader::get_fragment_shader_stage_info() {
+VkPipelineShaderStageCreateInfo Shader::get_fragment_shader_stage_info(
+    const VkSpecializationInfo *specialization_info) {
   if (!_built_modules) {
     throw std::runtime_error("Shader not initialized");
   }
-  return get_shader_stage_info(VK_SHADER_STAGE_FRAGMENT_BIT, _fragment_module);
+  return get_shader_stage_info(VK_SHADER_STAGE_FRAGMENT_BIT, _fragment_module,
+                               specialization_info);
 }
@@ -30,13 +30,9 @@ Texture::Texture(PixelBuffer &pixel_buffer) : pixel_buffer(pixel_buffer) {}
 Texture::Texture(Path path) : pixel_buffer(path) {}
 
 void Texture::allocate_image(VkDevice &device, VmaAllocator &allocator,
+                             SamplerCache &sampler_cache,
                              Deallocator &deallocator_queue) {
-  VkSamplerCreateInfo sampler_info =
-      vk_struct_init::get_sampler_create_info(filter, address_mode);
-  VK_CHECK(vkCreateSampler(device, &sampler_info, nullptr, &sampler),
-           "Failed to create sampler");
-
-  deallocator_queue.push([&] { vkDestroySampler(device, sampler, nullptr); });
+  sampler = sampler_cache.get(filter, address_mode);
 
   VkImageCreateInfo image_info = vk_struct_init::get_image_create_info(
       VK_FORMAT_R8G8B8A8_SRGB,
@@ -0,0 +1,148 @@
+#include <Eigen/Dense>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <rend/Physics/AABBTree.h>
+#include <rend/math_utils.h>
+#include <vector>
+
+namespace {
+class AABBTreeTest : public ::testing::Test {
+protected:
+  rend::physics::AABBTree tree;
+  std::vector<rend::physics::Bounds> bounds;
+  std::vector<int> proxies;
+
+  static rend::physics::Bounds random_bounds() {
+    Eigen::Vector3f center = Eigen::Vector3f::Random() * 100.0f;
+    Eigen::Vector3f half_size =
+        (Eigen::Vector3f::Random().array().abs() + 0.1f).matrix();
+    return rend::physics::Bounds{center - half_size, center + half_size};
+  }
+
+  void SetUp() override {
+    std::srand(42);
+    for (rend::ECS::EID eid = 0; eid < 500; eid++) {
+      bounds.push_back(random_bounds());
+      proxies.push_back(tree.insert(eid, bounds.back()));
+    }
+  }
+
+  std::vector<rend::ECS::EID>
+  brute_force_box(const rend::physics::Bounds &query) const {
+    std::vector<rend::ECS::EID> result;
+    for (rend::ECS::EID eid = 0; eid < bounds.size(); eid++) {
+      if (bounds[eid].overlaps(query)) {
+        result.push_back(eid);
+      }
+    }
+    return result;
+  }
+
+  std::vector<rend::ECS::EID>
+  tree_box(const rend::physics::Bounds &query) const {
+    std::vector<rend::ECS::EID> result;
+    tree.query_box(query, result);
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+};
+
+TEST_F(AABBTreeTest, BoxQueryMatchesBruteForceTest) {
+  for (int i = 0; i < 50; i++) {
+    rend::physics::Bounds query = random_bounds().expanded(10.0f);
+    ASSERT_EQ(tree_box(query), brute_force_box(query));
+  }
+}
+
+TEST_F(AABBTreeTest, MovedLeavesAreRefittedTest) {
+  for (size_t i = 0; i < bounds.size(); i += 2) {
+    bounds[i] = random_bounds();
+    tree.update(proxies[i], bounds[i]);
+  }
+  for (int i = 0; i < 50; i++) {
+    rend::physics::Bounds query = random_bounds().expanded(10.0f);
+    ASSERT_EQ(tree_box(query), brute_force_box(query));
+  }
+}
+
+TEST_F(AABBTreeTest, RebuildKeepsProxiesTest) {
+  for (size_t i = 0; i < bounds.size(); i++) {
+    bounds[i] = random_bounds();
+    tree.update(proxies[i], bounds[i]);
+  }
+  float degraded_cost = tree.get_cost();
+  ASSERT_TRUE(tree.rebuild_if_degraded());
+  ASSERT_LE(tree.get_cost(), degraded_cost);
+
+  for (size_t i = 0; i < bounds.size(); i++) {
+    ASSERT_EQ(tree.get_eid(proxies[i]), i);
+  }
+  rend::physics::Bounds query = random_bounds().expanded(30.0f);
+  ASSERT_EQ(tree_box(query), brute_force_box(query));
+}
+
+TEST_F(AABBTreeTest, RemoveTest) {
+  for (size_t i = 0; i < bounds.size(); i += 3) {
+    tree.remove(proxies[i]);
+    bounds[i] = rend::physics::Bounds{Eigen::Vector3f::Constant(1e6f),
+                                      Eigen::Vector3f::Constant(1e6f)};
+  }
+  rend::physics::Bounds everything{Eigen::Vector3f::Constant(-200.0f),
+                                   Eigen::Vector3f::Constant(200.0f)};
+  ASSERT_EQ(tree_box(everything), brute_force_box(everything));
+}
+
+TEST_F(AABBTreeTest, NearestQueryTest) {
+  Eigen::Vector3f point{10.0f, -5.0f, 3.0f};
+  std::vector<float> distances;
+  for (const rend::physics::Bounds &b : bounds) {
+    distances.push_back(std::sqrt(b.squared_distance(point)));
+  }
+  std::sort(distances.begin(), distances.end());
+
+  std::vector<rend::physics::AABBTree::Hit> hits;
+  tree.query_nearest(point, 5, hits);
+  ASSERT_EQ(hits.size(), 5);
+  for (size_t i = 0; i < hits.size(); i++) {
+    ASSERT_FLOAT_EQ(hits[i].distance, distances[i]);
+  }
+}
+
+TEST_F(AABBTreeTest, RayQueryTest) {
+  rend::physics::Bounds target = bounds[7];
+  Eigen::Vector3f origin = target.center() + Eigen::Vector3f{0, 0, -300.0f};
+  std::vector<rend::physics::AABBTree::Hit> hits;
+  tree.query_ray(origin, Eigen::Vector3f::UnitZ(), 1000.0f, hits);
+
+  ASSERT_TRUE(std::any_of(hits.begin(), hits.end(),
+                          [](const rend::physics::AABBTree::Hit &hit) {
+                            return hit.eid == 7;
+                          }));
+  ASSERT_TRUE(std::is_sorted(hits.begin(), hits.end(),
+                             [](const rend::physics::AABBTree::Hit &a,
+                                const rend::physics::AABBTree::Hit &b) {
+                               return a.distance < b.distance;
+                             }));
+}
+
+TEST_F(AABBTreeTest, FrustumQueryTest) {
+  Eigen::Matrix4f view_projection =
+      get_projection_matrix(90.0f, 1.0f, 0.1f, 50.0f) *
+      get_view_matrix(Eigen::Vector3f::Zero(), Eigen::Vector3f::UnitZ());
+  rend::physics::Frustum frustum =
+      rend::physics::Frustum::from_view_projection(view_projection);
+
+  std::vector<rend::ECS::EID> visible;
+  tree.query_frustum(frustum, visible);
+  std::sort(visible.begin(), visible.end());
+
+  std::vector<rend::ECS::EID> expected;
+  for (rend::ECS::EID eid = 0; eid < bounds.size(); eid++) {
+    if (frustum.intersects_box(bounds[eid].min, bounds[eid].max)) {
+      expected.push_back(eid);
+    }
+  }
+  ASSERT_EQ(visible, expected);
+  ASSERT_LT(visible.size(), bounds.size());
+}
+} // namespace
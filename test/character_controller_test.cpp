@@ -0,0 +1,65 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/EntityRegistry.h>
+#include <rend/Systems/CharacterControllerSystem.h>
+#include <rend/Systems/PhysicsSystem.h>
+
+namespace {
+rend::ECS::EID create_character(const Eigen::Vector3f &position,
+                                const Eigen::Vector3f &desired_velocity) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  rend::ECS::EID eid = registry.register_entity();
+  Transform &transform = registry.add_component<Transform>(eid);
+  CharacterController &controller =
+      registry.add_component<CharacterController>(eid);
+  transform.position = position;
+  controller.desired_velocity = desired_velocity;
+  return eid;
+}
+
+TEST(CharacterControllerTest, CharactersCollideTest) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  registry.register_component<Transform>();
+  registry.register_component<Rigidbody>();
+  registry.register_component<CharacterController>();
+
+  rend::ECS::EID floor = registry.register_entity();
+  Transform &floor_transform = registry.add_component<Transform>(floor);
+  Rigidbody &floor_rigidbody = registry.add_component<Rigidbody>(floor);
+  floor_transform.position = Eigen::Vector3f{0.0f, -1.0f, 0.0f};
+  floor_rigidbody.primitive_type = Rigidbody::PrimitiveType::BOX;
+  floor_rigidbody.dimensions = Eigen::Vector3f{20.0f, 1.0f, 20.0f};
+  floor_rigidbody.static_body = true;
+
+  // Walking towards each other
+  rend::ECS::EID left = create_character(Eigen::Vector3f{-2.0f, 0.0f, 0.0f},
+                                         Eigen::Vector3f{1.5f, 0.0f, 0.0f});
+  rend::ECS::EID right = create_character(Eigen::Vector3f{2.0f, 0.0f, 0.0f},
+                                          Eigen::Vector3f{-1.5f, 0.0f, 0.0f});
+
+  rend::systems::PhysicsSystem physics_system{};
+  rend::systems::CharacterControllerSystem character_system{};
+  physics_system.init();
+  character_system.init();
+
+  // Long enough to walk past each other without the collision
+  float dt = get_jph_physics_interface().fixed_time_step;
+  for (int frame = 0; frame < 400; frame++) {
+    physics_system.update(dt);
+    character_system.update(dt);
+  }
+
+  const Transform &left_transform = registry.get_component<Transform>(left);
+  const Transform &right_transform = registry.get_component<Transform>(right);
+  float radius = registry.get_component<CharacterController>(left).radius;
+  ASSERT_LT(left_transform.position.x(), right_transform.position.x());
+  ASSERT_GT((right_transform.position - left_transform.position).norm(),
+            1.8f * radius);
+  ASSERT_TRUE(registry.get_component<CharacterController>(left).on_ground);
+
+  character_system.remove_entity(left);
+  character_system.remove_entity(right);
+  ASSERT_TRUE(
+      registry.get_component<CharacterController>(left).character == nullptr);
+}
+} // namespace
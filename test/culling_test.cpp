@@ -0,0 +1,69 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/Rendering/Culling.h>
+#include <rend/math_utils.h>
+#include <vector>
+
+namespace {
+rend::physics::Frustum get_test_frustum() {
+  Eigen::Matrix4f view_projection =
+      get_projection_matrix(60.0f, 1.5f, 0.1f, 80.0f) *
+      get_view_matrix(Eigen::Vector3f{1.0f, 2.0f, -3.0f},
+                      Eigen::Vector3f{0.3f, -0.1f, 1.0f});
+  return rend::physics::Frustum::from_view_projection(view_projection);
+}
+
+TEST(CullingTest, BatchesMatchSingleBoxTestsTest) {
+  std::srand(7);
+  rend::physics::Frustum frustum = get_test_frustum();
+  rend::CullingBounds bounds;
+  std::vector<uint32_t> expected;
+  // Not a multiple of the batch size to cover the tail batch
+  for (uint32_t i = 0; i < 3 * rend::CullingBounds::BATCH_SIZE + 17; i++) {
+    Eigen::Vector3f center = Eigen::Vector3f::Random() * 100.0f;
+    Eigen::Vector3f half_size =
+        (Eigen::Vector3f::Random().array().abs() + 0.1f).matrix();
+    bounds.add(center - half_size, center + half_size);
+    if (frustum.intersects_box(center - half_size, center + half_size)) {
+      expected.push_back(i);
+    }
+  }
+
+  std::vector<uint32_t> visible;
+  bounds.cull(frustum, visible);
+  ASSERT_EQ(visible, expected);
+  ASSERT_GT(visible.size(), 0);
+  ASSERT_LT(visible.size(), bounds.size());
+}
+
+TEST(CullingTest, TransformedBoundsContainCornersTest) {
+  Eigen::Vector3f min_local{-1.0f, -2.0f, -0.5f};
+  Eigen::Vector3f max_local{1.0f, 0.5f, 3.0f};
+  Eigen::Matrix4f model = Eigen::Matrix4f::Identity();
+  model.block<3, 3>(0, 0) =
+      Eigen::AngleAxisf(0.7f, Eigen::Vector3f{1, 2, 3}.normalized())
+          .toRotationMatrix() *
+      Eigen::Vector3f{2.0f, 1.0f, 0.5f}.asDiagonal();
+  model.block<3, 1>(0, 3) = Eigen::Vector3f{4.0f, -1.0f, 2.0f};
+
+  rend::physics::Frustum frustum;
+  rend::CullingBounds bounds;
+  bounds.add(min_local, max_local, model);
+
+  for (int corner = 0; corner < 8; corner++) {
+    Eigen::Vector4f local{corner & 1 ? max_local(0) : min_local(0),
+                          corner & 2 ? max_local(1) : min_local(1),
+                          corner & 4 ? max_local(2) : min_local(2), 1.0f};
+    Eigen::Vector3f world = (model * local).head<3>();
+    // Half space starting just behind this corner, the bounds must reach it
+    Eigen::Vector3f normal = (world - model.block<3, 1>(0, 3)).normalized();
+    frustum.planes.setZero();
+    frustum.planes.row(rend::physics::Frustum::NEAR)
+        << normal.transpose(), -normal.dot(world) + 1e-3f;
+
+    std::vector<uint32_t> visible;
+    bounds.cull(frustum, visible);
+    ASSERT_EQ(visible.size(), 1);
+  }
+}
+} // namespace
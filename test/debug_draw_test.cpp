@@ -0,0 +1,121 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/Rendering/DebugDraw.h>
+#include <thread>
+#include <vector>
+
+namespace {
+TEST(DebugDrawTest, PrimitiveVerticesTest) {
+  std::vector<Eigen::Vector3f> vertices;
+  rend::DebugVertexRange ranges[rend::DEBUG_PRIMITIVE_COUNT];
+  rend::build_debug_primitive_vertices(vertices, ranges);
+
+  rend::DebugVertexRange box =
+      ranges[static_cast<uint32_t>(rend::DebugPrimitive::BOX)];
+  ASSERT_EQ(box.count, 24); // 12 edges
+  for (uint32_t i = box.first; i < box.first + box.count; i += 2) {
+    // Edges connect corners differing in exactly one axis
+    Eigen::Vector3f delta = vertices[i + 1] - vertices[i];
+    ASSERT_FLOAT_EQ(delta.sum(), 2.0f);
+    ASSERT_FLOAT_EQ(delta.cwiseAbs().maxCoeff(), 2.0f);
+  }
+
+  rend::DebugVertexRange sphere =
+      ranges[static_cast<uint32_t>(rend::DebugPrimitive::SPHERE)];
+  ASSERT_EQ(sphere.count,
+            (rend::DEBUG_SPHERE_RESOLUTION + 1) *
+                rend::DEBUG_SPHERE_RESOLUTION * 2);
+  for (uint32_t i = sphere.first; i < sphere.first + sphere.count; i++) {
+    ASSERT_NEAR(vertices[i].norm(), 1.0f, 1e-5f);
+  }
+  ASSERT_EQ(sphere.first + sphere.count, vertices.size());
+}
+
+TEST(DebugDrawTest, ThreadedRecordingTest) {
+  constexpr int THREAD_COUNT = 4;
+  constexpr int LINES_PER_THREAD = 1000;
+  rend::DebugDrawRecorder recorder{THREAD_COUNT + 1};
+  std::vector<rend::DebugInstance> instances(THREAD_COUNT * LINES_PER_THREAD +
+                                             1);
+  rend::DebugInstanceRange ranges[rend::DEBUG_PRIMITIVE_COUNT];
+
+  for (int frame = 0; frame < 2; frame++) {
+    std::vector<std::thread> threads;
+    for (int thread_idx = 0; thread_idx < THREAD_COUNT; thread_idx++) {
+      threads.emplace_back([&recorder, thread_idx]() {
+        for (int i = 0; i < LINES_PER_THREAD; i++) {
+          recorder.line(Eigen::Vector3f{float(thread_idx), float(i), 0.0f},
+                        Eigen::Vector3f{float(thread_idx), float(i), 2.0f},
+                        Eigen::Vector3f::Ones());
+        }
+      });
+    }
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+    recorder.sphere(Eigen::Vector3f{1.0f, 2.0f, 3.0f}, 2.0f,
+                    Eigen::Vector3f::UnitX());
+    ASSERT_EQ(recorder.get_instance_count(),
+              THREAD_COUNT * LINES_PER_THREAD + 1);
+
+    uint32_t written = recorder.merge(instances.data(), instances.size(),
+                                      ranges);
+    ASSERT_EQ(written, THREAD_COUNT * LINES_PER_THREAD + 1);
+    ASSERT_EQ(recorder.take_dropped_count(), 0);
+
+    rend::DebugInstanceRange lines =
+        ranges[static_cast<uint32_t>(rend::DebugPrimitive::LINE)];
+    ASSERT_EQ(lines.first, 0);
+    ASSERT_EQ(lines.count, THREAD_COUNT * LINES_PER_THREAD);
+    ASSERT_EQ(ranges[static_cast<uint32_t>(rend::DebugPrimitive::BOX)].count,
+              0);
+    rend::DebugInstanceRange spheres =
+        ranges[static_cast<uint32_t>(rend::DebugPrimitive::SPHERE)];
+    ASSERT_EQ(spheres.first, lines.count);
+    ASSERT_EQ(spheres.count, 1);
+
+    for (uint32_t i = 0; i < lines.count; i++) {
+      Eigen::Matrix4f model = Eigen::Matrix4f::Map(instances[i].model);
+      Eigen::Vector4f start = model * Eigen::Vector4f{0, 0, 0, 1};
+      Eigen::Vector4f end = model * Eigen::Vector4f{0, 0, 1, 1};
+      ASSERT_FLOAT_EQ(start.z(), 0.0f);
+      ASSERT_FLOAT_EQ(end.z(), 2.0f);
+      ASSERT_FLOAT_EQ(start.x(), end.x());
+      ASSERT_FLOAT_EQ(instances[i].color[3], 1.0f);
+    }
+    Eigen::Matrix4f sphere_model =
+        Eigen::Matrix4f::Map(instances[spheres.first].model);
+    ASSERT_TRUE((sphere_model * Eigen::Vector4f{1, 0, 0, 1})
+                    .isApprox(Eigen::Vector4f{3.0f, 2.0f, 3.0f, 1.0f}));
+  }
+
+  // Beyond the capacity instances are dropped
+  for (int i = 0; i < 10; i++) {
+    recorder.box(-Eigen::Vector3f::Ones(), Eigen::Vector3f::Ones(),
+                 Eigen::Matrix4f::Identity(), Eigen::Vector3f::Ones());
+  }
+  ASSERT_EQ(recorder.merge(instances.data(), 4, ranges), 4);
+  ASSERT_EQ(recorder.take_dropped_count(), 6);
+}
+
+TEST(DebugDrawTest, SeveralRecordersTest) {
+  // One buffer each, alternating must not claim another one
+  rend::DebugDrawRecorder first{1};
+  rend::DebugDrawRecorder second{1};
+  std::vector<rend::DebugInstance> instances(16);
+  rend::DebugInstanceRange ranges[rend::DEBUG_PRIMITIVE_COUNT];
+
+  for (int frame = 0; frame < 2; frame++) {
+    for (int i = 0; i < 4; i++) {
+      first.sphere(Eigen::Vector3f::Zero(), 1.0f, Eigen::Vector3f::UnitX());
+      second.sphere(Eigen::Vector3f::Zero(), 2.0f, Eigen::Vector3f::UnitY());
+    }
+    ASSERT_EQ(first.merge(instances.data(), instances.size(), ranges), 4);
+    ASSERT_EQ(instances[0].model[0], 1.0f);
+    ASSERT_EQ(second.merge(instances.data(), instances.size(), ranges), 4);
+    ASSERT_EQ(instances[0].model[0], 2.0f);
+    ASSERT_EQ(first.take_dropped_count(), 0);
+    ASSERT_EQ(second.take_dropped_count(), 0);
+  }
+}
+} // namespace
@@ -52,6 +52,29 @@ TEST_F(RegisterEntity, ComponentInitializedTest) {
       << "Position is not initialized to zero" << position;
 }
 
+TEST_F(RegisterEntity, RemoveEntityKeepsComponentPoolTest) {
+  registry->add_component<Transform>(eid).position.x() = 1.0f;
+  rend::ECS::EID other_eid = registry->register_entity();
+  registry->add_component<Transform>(other_eid);
+  registry->remove_entity(other_eid);
+
+  ASSERT_FALSE(registry->is_entity_enabled(other_eid));
+  ASSERT_EQ(registry->get_component<Transform>(eid).position.x(), 1.0f);
+  ASSERT_EQ(registry->register_entity(), other_eid);
+}
+
+TEST_F(RegisterEntity, ChangeVersionTest) {
+  registry->add_component<Transform>(eid);
+  uint64_t added_version = registry->get_change_version<Transform>(eid);
+  ASSERT_GT(added_version, 0);
+
+  uint64_t seen_version = registry->change_version;
+  registry->mark_changed<Transform>(eid);
+  ASSERT_GT(registry->get_change_version<Transform>(eid), seen_version);
+  ASSERT_EQ(registry->get_change_version<Transform>(eid),
+            registry->change_version);
+}
+
 TEST_F(RegisterEntity, MaxEntityAmountTest) {
   EXPECT_THROW(
       [&]() {
@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include <rend/Rendering/FrameRing.h>
+#include <vector>
+
+namespace {
+TEST(FrameRingTest, AlignedAllocationsTest) {
+  rend::FrameRingAllocator ring;
+  ring.init(1000, 3, 256);
+  ASSERT_EQ(ring.get_frame_size(), 1024);
+
+  for (uint64_t frame = 0; frame < 7; frame++) {
+    ring.begin_frame(frame);
+    size_t region_begin = (frame % 3) * 1024;
+    std::vector<size_t> sizes = {4, 300, 1}; // 256 + 512 + 256
+    size_t previous_end = region_begin;
+    for (size_t size : sizes) {
+      size_t offset;
+      ASSERT_TRUE(ring.allocate(size, offset));
+      ASSERT_EQ(offset % 256, 0);
+      ASSERT_GE(offset, previous_end); // No overlap
+      previous_end = offset + size;
+    }
+    ASSERT_LE(previous_end, region_begin + 1024);
+    ASSERT_EQ(ring.get_used(), 1024);
+
+    // Region is full
+    size_t offset;
+    ASSERT_FALSE(ring.allocate(1, offset));
+  }
+}
+
+TEST(FrameRingTest, InvalidParametersTest) {
+  rend::FrameRingAllocator ring;
+  ASSERT_THROW(ring.init(1024, 0, 256), std::runtime_error);
+  ASSERT_THROW(ring.init(1024, 2, 48), std::runtime_error);
+
+  ring.init(512, 2, 64);
+  ring.begin_frame(0);
+  size_t offset;
+  ASSERT_FALSE(ring.allocate(513, offset));
+  ASSERT_TRUE(ring.allocate(512, offset));
+  ASSERT_EQ(offset, 0);
+}
+} // namespace
@@ -0,0 +1,80 @@
+#include <Eigen/Dense>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <rend/Rendering/LightClusters.h>
+#include <rend/math_utils.h>
+
+namespace {
+constexpr float NEAR = 0.1f;
+constexpr float FAR = 200.0f;
+
+uint32_t get_point_cluster(const rend::LightClusters &clusters,
+                           const Eigen::Matrix4f &projection,
+                           const Eigen::Vector3f &point_view) {
+  float depth = -point_view.z();
+  float ndc_x = projection(0, 0) * point_view.x() / depth;
+  float ndc_y = projection(1, 1) * point_view.y() / depth;
+  uint32_t x = std::clamp<int>((ndc_x * 0.5f + 0.5f) * clusters.TILES_X, 0,
+                               clusters.TILES_X - 1);
+  uint32_t y = std::clamp<int>((ndc_y * 0.5f + 0.5f) * clusters.TILES_Y, 0,
+                               clusters.TILES_Y - 1);
+  return rend::LightClusters::get_cluster_index(x, y,
+                                                clusters.get_slice(depth));
+}
+
+TEST(LightClustersTest, SlicesCoverDepthRangeTest) {
+  rend::LightClusters clusters;
+  clusters.set_projection(get_projection_matrix(90.0f, 1.6f, NEAR, FAR), NEAR,
+                          FAR);
+  ASSERT_EQ(clusters.get_slice(NEAR), 0);
+  ASSERT_EQ(clusters.get_slice(FAR * 0.999f),
+            rend::LightClusters::SLICES - 1);
+  for (uint32_t slice = 0; slice < rend::LightClusters::SLICES; slice++) {
+    float middle = 0.5f * (clusters.get_slice_depth(slice) +
+                           clusters.get_slice_depth(slice + 1));
+    ASSERT_EQ(clusters.get_slice(middle), slice);
+  }
+}
+
+TEST(LightClustersTest, LitPointsFindTheirLightTest) {
+  std::srand(3);
+  Eigen::Matrix4f projection = get_projection_matrix(90.0f, 1.6f, NEAR, FAR);
+  rend::LightClusters clusters;
+  clusters.set_projection(projection, NEAR, FAR);
+  clusters.clear();
+
+  constexpr int LIGHT_COUNT = 200;
+  std::vector<Eigen::Vector3f> centers;
+  std::vector<float> radii;
+  for (int i = 0; i < LIGHT_COUNT; i++) {
+    // Some of them behind the camera or crossing the near plane
+    Eigen::Vector3f center = Eigen::Vector3f::Random() * 60.0f;
+    center.z() -= 50.0f;
+    float radius = rand_float(0.5f, 15.0f);
+    centers.push_back(center);
+    radii.push_back(radius);
+    clusters.add_light(i, center, radius);
+  }
+  clusters.build();
+
+  ASSERT_LT(clusters.light_indices.size(),
+            LIGHT_COUNT * rend::LightClusters::CLUSTER_COUNT / 10);
+  for (int i = 0; i < 10000; i++) {
+    int light = std::rand() % LIGHT_COUNT;
+    Eigen::Vector3f point =
+        centers[light] + Eigen::Vector3f::Random() * radii[light];
+    float depth = -point.z();
+    if ((point - centers[light]).norm() > radii[light] || depth < NEAR ||
+        depth > FAR ||
+        std::abs(projection(0, 0) * point.x() / depth) > 1.0f ||
+        std::abs(projection(1, 1) * point.y() / depth) > 1.0f) {
+      continue;
+    }
+    uint32_t cluster = get_point_cluster(clusters, projection, point);
+    auto begin = clusters.light_indices.begin() + clusters.ranges[2 * cluster];
+    auto end = begin + clusters.ranges[2 * cluster + 1];
+    ASSERT_NE(std::find(begin, end, light), end)
+        << "Light " << light << " missing from cluster " << cluster;
+  }
+}
+} // namespace
@@ -0,0 +1,47 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/Light.h>
+
+namespace {
+TEST(LightTest, MatricesFollowSettersTest) {
+  Light light;
+  light.set_position(Eigen::Vector3f{1.0f, 2.0f, 3.0f});
+  light.set_direction(Eigen::Vector3f{0.2f, -1.0f, 0.5f});
+  Eigen::Matrix4f view = light.get_view_mat();
+  ASSERT_TRUE(view.isApprox(get_view_matrix(light.get_position(),
+                                            light.get_direction())));
+
+  light.set_position(Eigen::Vector3f{-4.0f, 1.0f, 0.0f});
+  light.set_range(50.0f);
+  ASSERT_FALSE(light.get_view_mat().isApprox(view));
+  ASSERT_TRUE(light.get_view_mat().isApprox(
+      get_view_matrix(light.get_position(), light.get_direction())));
+  ASSERT_TRUE(light.get_projection_mat().isApprox(get_projection_matrix(
+      180.0f * light.get_fov() / M_PI, 1, 0.01f, 50.0f)));
+}
+
+TEST(LightTest, BoundingSphereContainsConeTest) {
+  std::srand(5);
+  for (float fov : {0.3f, 1.2f, 2.5f}) {
+    Light light;
+    light.set_position(Eigen::Vector3f{1.0f, 5.0f, -2.0f});
+    light.set_direction(Eigen::Vector3f{0.3f, -1.0f, 0.2f}.normalized());
+    light.set_fov(fov);
+    light.set_range(20.0f);
+
+    Eigen::Vector3f center;
+    float radius;
+    light.get_bounding_sphere(center, radius);
+    for (int i = 0; i < 1000; i++) {
+      Eigen::Vector3f offset = Eigen::Vector3f::Random() * light.get_range();
+      if (offset.norm() > light.get_range() ||
+          offset.normalized().dot(light.get_direction()) <
+              std::cos(0.5f * fov)) {
+        continue;
+      }
+      ASSERT_LE((light.get_position() + offset - center).norm(),
+                radius * 1.0001f);
+    }
+  }
+}
+} // namespace
@@ -0,0 +1,75 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/EntityRegistry.h>
+#include <rend/Systems/PhysicsLODSystem.h>
+#include <rend/Systems/PhysicsSystem.h>
+
+namespace {
+rend::ECS::EID create_box(const Eigen::Vector3f &position,
+                          const Eigen::Vector3f &half_extents,
+                          bool static_body) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  rend::ECS::EID eid = registry.register_entity();
+  Transform &transform = registry.add_component<Transform>(eid);
+  Rigidbody &rigidbody = registry.add_component<Rigidbody>(eid);
+  transform.position = position;
+  transform.scale = half_extents;
+  rigidbody.primitive_type = Rigidbody::PrimitiveType::BOX;
+  rigidbody.dimensions = half_extents;
+  rigidbody.static_body = static_body;
+  return eid;
+}
+
+TEST(PhysicsLODTest, ReducedBodiesRestAndSlideTest) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  registry.register_component<Transform>();
+  registry.register_component<Rigidbody>();
+
+  create_box(Eigen::Vector3f{0.0f, -1.0f, 0.0f},
+             Eigen::Vector3f{10.0f, 1.0f, 10.0f}, true);
+  rend::ECS::EID box = create_box(Eigen::Vector3f{0.0f, 0.5f, 0.0f},
+                                  Eigen::Vector3f::Constant(0.5f), false);
+  // Pushed along the floor once the simulation runs
+  rend::ECS::EID sliding_box =
+      create_box(Eigen::Vector3f{-5.0f, 0.5f, 5.0f},
+                 Eigen::Vector3f::Constant(0.5f), false);
+  for (rend::ECS::EID eid : {box, sliding_box}) {
+    Rigidbody &rigidbody = registry.get_component<Rigidbody>(eid);
+    rigidbody.lod.enabled = true;
+    rigidbody.lod.reduced_distance = 10.0f;
+    rigidbody.lod.frozen_distance = 1000.0f;
+  }
+  Rigidbody &rigidbody = registry.get_component<Rigidbody>(box);
+  Rigidbody &sliding_rigidbody = registry.get_component<Rigidbody>(sliding_box);
+
+  // Between the reduced and the frozen distance
+  Transform observer;
+  observer.position = Eigen::Vector3f{100.0f, 0.0f, 0.0f};
+
+  rend::systems::PhysicsSystem physics_system{};
+  rend::systems::PhysicsLODSystem lod_system{physics_system};
+  lod_system.observers.push_back(&observer);
+  physics_system.init();
+  get_jph_physics_interface()
+      .jph_physics_system->GetBodyInterface()
+      .SetLinearVelocity(sliding_rigidbody.body_id,
+                         JPH::Vec3{2.0f, 0.0f, 0.0f});
+
+  // Long enough for a promotion cooldown to run out
+  for (int frame = 0; frame < 3 * lod_system.promotion_cooldown; frame++) {
+    physics_system.update(1.0f / 60.0f);
+    lod_system.update(1.0f / 60.0f);
+    ASSERT_EQ(rigidbody.lod_level, Rigidbody::LODLevel::REDUCED);
+    ASSERT_EQ(sliding_rigidbody.lod_level, Rigidbody::LODLevel::REDUCED);
+  }
+
+  // Resting on the floor instead of sinking through it
+  Transform &transform = registry.get_component<Transform>(box);
+  ASSERT_NEAR(transform.position.y(), 0.5f, 0.05f);
+
+  // Kept sliding on top of the floor instead of being stopped by it
+  Transform &sliding_transform = registry.get_component<Transform>(sliding_box);
+  ASSERT_GT(sliding_transform.position.x(), -2.0f);
+  ASSERT_NEAR(sliding_transform.position.y(), 0.5f, 0.05f);
+}
+} // namespace
@@ -0,0 +1,88 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/EntityRegistry.h>
+#include <rend/Physics/PhysicsSnapshot.h>
+#include <rend/Systems/PhysicsSystem.h>
+#include <vector>
+
+namespace {
+rend::ECS::EID create_box(const Eigen::Vector3f &position,
+                          const Eigen::Vector3f &half_extents,
+                          bool static_body) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  rend::ECS::EID eid = registry.register_entity();
+  Transform &transform = registry.add_component<Transform>(eid);
+  Rigidbody &rigidbody = registry.add_component<Rigidbody>(eid);
+  transform.position = position;
+  transform.scale = half_extents;
+  rigidbody.primitive_type = Rigidbody::PrimitiveType::BOX;
+  rigidbody.dimensions = half_extents;
+  rigidbody.static_body = static_body;
+  return eid;
+}
+
+TEST(PhysicsSnapshotTest, RestoredSimulationRepeatsTest) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  registry.register_component<Transform>();
+  registry.register_component<Rigidbody>();
+
+  create_box(Eigen::Vector3f{0.0f, -1.0f, 0.0f},
+             Eigen::Vector3f{10.0f, 1.0f, 10.0f}, true);
+  rend::ECS::EID resting = create_box(Eigen::Vector3f{0.0f, 0.5f, 0.0f},
+                                      Eigen::Vector3f::Constant(0.5f), false);
+  // Lands on the resting box after the saves and wakes it up
+  rend::ECS::EID falling = create_box(Eigen::Vector3f{0.2f, 20.0f, 0.0f},
+                                      Eigen::Vector3f::Constant(0.5f), false);
+  std::vector<rend::ECS::EID> boxes{resting, falling};
+
+  rend::systems::PhysicsSystem physics_system{};
+  physics_system.init();
+  float dt = get_jph_physics_interface().fixed_time_step;
+
+  // Rolling saves into the same snapshot, the resting box has fallen asleep
+  // before the first one and is left out of the second
+  rend::physics::PhysicsSnapshot snapshot{};
+  for (int frame = 0; frame < 100; frame++) {
+    physics_system.update(dt);
+  }
+  physics_system.save_state(snapshot);
+  for (int frame = 0; frame < 50; frame++) {
+    physics_system.update(dt);
+  }
+  physics_system.save_state(snapshot);
+  ASSERT_FALSE(snapshot.recorded.test(resting));
+  ASSERT_TRUE(snapshot.recorded.test(falling));
+
+  std::vector<Transform> saved;
+  for (rend::ECS::EID eid : boxes) {
+    saved.push_back(registry.get_component<Transform>(eid));
+  }
+
+  const int step_count = 300;
+  for (int frame = 0; frame < step_count; frame++) {
+    physics_system.update(dt);
+  }
+  std::vector<Transform> expected;
+  for (rend::ECS::EID eid : boxes) {
+    expected.push_back(registry.get_component<Transform>(eid));
+  }
+  // The collision moved the resting box
+  ASSERT_NE(expected[0].position, saved[0].position);
+
+  ASSERT_TRUE(physics_system.restore_state(snapshot));
+  for (size_t i = 0; i < boxes.size(); i++) {
+    const Transform &transform = registry.get_component<Transform>(boxes[i]);
+    ASSERT_EQ(transform.position, saved[i].position);
+    ASSERT_EQ(transform.rotation.coeffs(), saved[i].rotation.coeffs());
+  }
+
+  for (int frame = 0; frame < step_count; frame++) {
+    physics_system.update(dt);
+  }
+  for (size_t i = 0; i < boxes.size(); i++) {
+    const Transform &transform = registry.get_component<Transform>(boxes[i]);
+    ASSERT_EQ(transform.position, expected[i].position);
+    ASSERT_EQ(transform.rotation.coeffs(), expected[i].rotation.coeffs());
+  }
+}
+} // namespace
@@ -0,0 +1,57 @@
+#include <Eigen/Dense>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <rend/EntityRegistry.h>
+#include <rend/Systems/PhysicsSystem.h>
+#include <rend/Systems/SpatialIndexSystem.h>
+#include <vector>
+
+namespace {
+TEST(PhysicsSystemTest, StaticBodyBoundsTest) {
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  registry.register_component<Transform>();
+  registry.register_component<Rigidbody>();
+  registry.register_component<AABB>();
+
+  // Floor away from the origin, it never moves
+  rend::ECS::EID floor = registry.register_entity();
+  Transform &transform = registry.add_component<Transform>(floor);
+  Rigidbody &rigidbody = registry.add_component<Rigidbody>(floor);
+  AABB &aabb = registry.add_component<AABB>(floor);
+  transform.position = Eigen::Vector3f{100.0f, -1.0f, 0.0f};
+  transform.scale = Eigen::Vector3f{20.0f, 1.0f, 20.0f};
+  aabb.min_local = -Eigen::Vector3f::Ones();
+  aabb.max_local = Eigen::Vector3f::Ones();
+  rigidbody.primitive_type = Rigidbody::PrimitiveType::BOX;
+  rigidbody.dimensions = transform.scale;
+  rigidbody.mass = 1.0f;
+  rigidbody.static_body = true;
+
+  rend::systems::PhysicsSystem physics_system{};
+  rend::systems::SpatialIndexSystem spatial_index_system{};
+  physics_system.init();
+  for (int frame = 0; frame < 3; frame++) {
+    physics_system.update(1.0f / 60.0f);
+    spatial_index_system.update(1.0f / 60.0f);
+  }
+
+  AABB &floor_aabb = registry.get_component<AABB>(floor);
+  ASSERT_TRUE(floor_aabb.min_global.isApprox(
+      Eigen::Vector3f{80.0f, -2.0f, -20.0f}, 1e-4f));
+  ASSERT_TRUE(floor_aabb.max_global.isApprox(
+      Eigen::Vector3f{120.0f, 0.0f, 20.0f}, 1e-4f));
+
+  // Indexed where it is, not at the origin
+  std::vector<rend::ECS::EID> result;
+  spatial_index_system.query_box(
+      rend::physics::Bounds{Eigen::Vector3f{115.0f, -1.5f, 15.0f},
+                            Eigen::Vector3f{116.0f, -0.5f, 16.0f}},
+      result);
+  ASSERT_EQ(result, std::vector<rend::ECS::EID>{floor});
+  result.clear();
+  spatial_index_system.query_box(
+      rend::physics::Bounds{-Eigen::Vector3f::Ones(), Eigen::Vector3f::Ones()},
+      result);
+  ASSERT_TRUE(result.empty());
+}
+} // namespace
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <rend/Rendering/PipelineCacheFile.h>
+#include <vector>
+
+namespace {
+rend::PipelineCacheDevice get_device() {
+  rend::PipelineCacheDevice device{0x10de, 0x2484, 0x84c5c000, {}};
+  for (uint32_t i = 0; i < rend::PIPELINE_CACHE_UUID_SIZE; i++) {
+    device.cache_uuid[i] = i * 7;
+  }
+  return device;
+}
+
+// Data as vkGetPipelineCacheData returns it for the device
+std::vector<uint8_t> get_cache_data(const rend::PipelineCacheDevice &device) {
+  std::vector<uint8_t> data(rend::PIPELINE_CACHE_VK_HEADER_SIZE + 100);
+  uint32_t vk_header[4] = {rend::PIPELINE_CACHE_VK_HEADER_SIZE,
+                           rend::PIPELINE_CACHE_VK_HEADER_VERSION,
+                           device.vendor_id, device.device_id};
+  memcpy(data.data(), vk_header, sizeof(vk_header));
+  memcpy(data.data() + sizeof(vk_header), device.cache_uuid,
+         rend::PIPELINE_CACHE_UUID_SIZE);
+  for (size_t i = rend::PIPELINE_CACHE_VK_HEADER_SIZE; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i);
+  }
+  return data;
+}
+
+TEST(PipelineCacheTest, RoundTripTest) {
+  rend::PipelineCacheDevice device = get_device();
+  std::vector<uint8_t> data = get_cache_data(device);
+  std::vector<uint8_t> file = rend::pack_pipeline_cache(device, data);
+  ASSERT_EQ(file.size(), sizeof(rend::PipelineCacheFileHeader) + data.size());
+
+  std::vector<uint8_t> unpacked;
+  ASSERT_TRUE(rend::unpack_pipeline_cache(file, device, unpacked));
+  ASSERT_EQ(unpacked, data);
+
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() / "rend_pipeline_cache_test.bin";
+  ASSERT_TRUE(rend::write_pipeline_cache_file(path, device, data));
+  unpacked.clear();
+  ASSERT_TRUE(rend::read_pipeline_cache_file(path, device, unpacked));
+  ASSERT_EQ(unpacked, data);
+  std::filesystem::remove(path);
+  ASSERT_FALSE(rend::read_pipeline_cache_file(path, device, unpacked));
+}
+
+TEST(PipelineCacheTest, OverwriteLeavesNoTemporaryFilesTest) {
+  rend::PipelineCacheDevice device = get_device();
+  std::filesystem::path directory =
+      std::filesystem::temp_directory_path() / "rend_pipeline_cache_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directory(directory);
+  std::filesystem::path path = directory / "pipeline_cache.bin";
+
+  std::vector<uint8_t> data = get_cache_data(device);
+  ASSERT_TRUE(rend::write_pipeline_cache_file(path, device, data));
+  data.back()++;
+  ASSERT_TRUE(rend::write_pipeline_cache_file(path, device, data));
+
+  std::vector<uint8_t> unpacked;
+  ASSERT_TRUE(rend::read_pipeline_cache_file(path, device, unpacked));
+  ASSERT_EQ(unpacked, data);
+  std::vector<std::filesystem::path> files;
+  for (const std::filesystem::directory_entry &entry :
+       std::filesystem::directory_iterator(directory)) {
+    files.push_back(entry.path());
+  }
+  ASSERT_EQ(files, std::vector<std::filesystem::path>{path});
+  std::filesystem::remove_all(directory);
+}
+
+TEST(PipelineCacheTest, RejectsOtherDevicesTest) {
+  rend::PipelineCacheDevice device = get_device();
+  std::vector<uint8_t> file =
+      rend::pack_pipeline_cache(device, get_cache_data(device));
+  std::vector<uint8_t> unpacked;
+
+  rend::PipelineCacheDevice other = device;
+  other.driver_version++; // Updated driver
+  ASSERT_FALSE(rend::unpack_pipeline_cache(file, other, unpacked));
+  other = device;
+  other.device_id++;
+  ASSERT_FALSE(rend::unpack_pipeline_cache(file, other, unpacked));
+  other = device;
+  other.cache_uuid[rend::PIPELINE_CACHE_UUID_SIZE - 1]++;
+  ASSERT_FALSE(rend::unpack_pipeline_cache(file, other, unpacked));
+
+  // Data of another device behind a matching file header
+  other = device;
+  other.vendor_id++;
+  file = rend::pack_pipeline_cache(device, get_cache_data(other));
+  ASSERT_FALSE(rend::unpack_pipeline_cache(file, device, unpacked));
+  ASSERT_TRUE(unpacked.empty());
+}
+
+TEST(PipelineCacheTest, RejectsDamagedFilesTest) {
+  rend::PipelineCacheDevice device = get_device();
+  std::vector<uint8_t> file =
+      rend::pack_pipeline_cache(device, get_cache_data(device));
+  std::vector<uint8_t> unpacked;
+
+  std::vector<uint8_t> truncated(file.begin(), file.end() - 1);
+  ASSERT_FALSE(rend::unpack_pipeline_cache(truncated, device, unpacked));
+  truncated.resize(sizeof(rend::PipelineCacheFileHeader) - 1);
+  ASSERT_FALSE(rend::unpack_pipeline_cache(truncated, device, unpacked));
+
+  std::vector<uint8_t> corrupted = file;
+  corrupted.back() ^= 1;
+  ASSERT_FALSE(rend::unpack_pipeline_cache(corrupted, device, unpacked));
+
+  // Empty cache data has no Vulkan header
+  file = rend::pack_pipeline_cache(device, {});
+  ASSERT_FALSE(rend::unpack_pipeline_cache(file, device, unpacked));
+}
+} // namespace
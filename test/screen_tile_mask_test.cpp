@@ -0,0 +1,87 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/Rendering/ScreenTileMask.h>
+#include <rend/math_utils.h>
+#include <vector>
+
+namespace {
+constexpr uint32_t WIDTH = 640;
+constexpr uint32_t HEIGHT = 500; // Not a multiple of the tile size
+constexpr uint32_t TILE_SIZE = 16;
+
+Eigen::Matrix4f get_test_view_projection() {
+  return get_projection_matrix(90.0f, 1.28f, 0.1f, 200.0f) *
+         get_view_matrix(Eigen::Vector3f{0.0f, 1.0f, -10.0f},
+                         Eigen::Vector3f{0.0f, 0.0f, 1.0f});
+}
+
+TEST(ScreenTileMaskTest, SpansCoverProjectedPointsTest) {
+  std::srand(11);
+  Eigen::Matrix4f view_projection = get_test_view_projection();
+  rend::ScreenTileMask mask;
+  mask.resize(WIDTH, HEIGHT, TILE_SIZE);
+
+  std::vector<Eigen::Vector3f> points;
+  for (int i = 0; i < 20; i++) {
+    Eigen::Vector3f center = Eigen::Vector3f::Random() * 8.0f;
+    Eigen::Vector3f half_size =
+        (Eigen::Vector3f::Random().array().abs() * 2.0f + 0.1f).matrix();
+    mask.add_box(center - half_size, center + half_size, view_projection);
+    for (int j = 0; j < 50; j++) {
+      points.push_back(center + Eigen::Vector3f::Random().cwiseProduct(
+                                    half_size));
+    }
+  }
+  std::vector<rend::ScreenTileMask::Span> spans;
+  mask.get_spans(spans);
+  ASSERT_FALSE(spans.empty());
+
+  uint32_t covered = 0;
+  for (const rend::ScreenTileMask::Span &span : spans) {
+    ASSERT_LE(span.x + span.width, WIDTH);
+    ASSERT_LE(span.y + span.height, HEIGHT);
+    covered += span.width * span.height;
+  }
+  ASSERT_LT(covered, WIDTH * HEIGHT); // Boxes cover only part of the screen
+
+  for (const Eigen::Vector3f &point : points) {
+    Eigen::Vector4f clip = view_projection * point.homogeneous();
+    Eigen::Vector2f ndc = clip.head<2>() / clip.w();
+    if (clip.w() <= 0.0f || ndc.cwiseAbs().maxCoeff() >= 1.0f) {
+      continue;
+    }
+    float x = (ndc.x() * 0.5f + 0.5f) * WIDTH;
+    float y = (ndc.y() * 0.5f + 0.5f) * HEIGHT;
+    bool inside = false;
+    for (const rend::ScreenTileMask::Span &span : spans) {
+      inside |= x >= span.x && x < span.x + span.width && y >= span.y &&
+                y < span.y + span.height;
+    }
+    ASSERT_TRUE(inside) << "Point at pixel " << x << " " << y;
+  }
+}
+
+TEST(ScreenTileMaskTest, BoxesBehindAndAcrossCameraTest) {
+  Eigen::Matrix4f view_projection = get_test_view_projection();
+  rend::ScreenTileMask mask;
+  mask.resize(WIDTH, HEIGHT, TILE_SIZE);
+  std::vector<rend::ScreenTileMask::Span> spans;
+
+  // Off to the side of the frustum
+  mask.add_box(Eigen::Vector3f{100.0f, 0.0f, 0.0f},
+               Eigen::Vector3f{101.0f, 1.0f, 1.0f}, view_projection);
+  mask.get_spans(spans);
+  ASSERT_TRUE(spans.empty());
+
+  // Around the camera, every row is a single span of the full width
+  mask.add_box(Eigen::Vector3f{-1.0f, 0.0f, -11.0f},
+               Eigen::Vector3f{1.0f, 2.0f, -9.0f}, view_projection);
+  mask.get_spans(spans);
+  ASSERT_EQ(spans.size(), mask.get_tiles_y());
+  for (const rend::ScreenTileMask::Span &span : spans) {
+    ASSERT_EQ(span.x, 0);
+    ASSERT_EQ(span.width, WIDTH);
+  }
+  ASSERT_EQ(spans.back().y + spans.back().height, HEIGHT);
+}
+} // namespace
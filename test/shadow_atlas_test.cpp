@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <rend/Rendering/ShadowAtlas.h>
+#include <vector>
+
+namespace {
+bool overlap(const rend::ShadowAtlasRect &a, const rend::ShadowAtlasRect &b) {
+  return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size &&
+         b.y < a.y + a.size;
+}
+
+TEST(ShadowAtlasTest, ResolutionFromBudgetTest) {
+  // D32 texels
+  ASSERT_EQ(rend::get_shadow_atlas_resolution(64 * 1024 * 1024, 4), 4096);
+  ASSERT_EQ(rend::get_shadow_atlas_resolution(100 * 1024 * 1024, 4), 4096);
+  ASSERT_EQ(rend::get_shadow_atlas_resolution(256 * 1024 * 1024, 4), 8192);
+}
+
+TEST(ShadowAtlasTest, TilesDontOverlapTest) {
+  rend::ShadowAtlasAllocator allocator(4096, 128);
+  std::vector<rend::ShadowAtlasRect> rects;
+  uint32_t sizes[] = {1024, 128, 512, 2048, 256, 128, 1000};
+  for (uint32_t size : sizes) {
+    rend::ShadowAtlasRect rect;
+    ASSERT_TRUE(allocator.allocate(size, rect));
+    ASSERT_GE(rect.size, size);
+    ASSERT_LE(rect.x + rect.size, 4096);
+    ASSERT_LE(rect.y + rect.size, 4096);
+    for (const rend::ShadowAtlasRect &other : rects) {
+      ASSERT_FALSE(overlap(rect, other));
+    }
+    rects.push_back(rect);
+  }
+}
+
+TEST(ShadowAtlasTest, FullAtlasTest) {
+  rend::ShadowAtlasAllocator allocator(1024, 64);
+  rend::ShadowAtlasRect rect;
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(allocator.allocate(512, rect));
+  }
+  ASSERT_FALSE(allocator.allocate(64, rect));
+
+  allocator.clear();
+  ASSERT_TRUE(allocator.allocate(1024, rect));
+}
+
+TEST(ShadowAtlasTest, ImportantLightsFirstTest) {
+  rend::ShadowAtlasAllocator allocator(1024, 256);
+  std::vector<rend::ShadowAtlasAllocator::Request> requests = {
+      {0, 1.0f, 1024}, {1, 2.0f, 512}, {2, 3.0f, 512},
+      {3, 4.0f, 512},  {4, 0.0f, 256}};
+  std::vector<rend::ShadowAtlasRect> rects(5);
+  allocator.allocate(requests, rects);
+
+  ASSERT_EQ(rects[3].size, 512);
+  ASSERT_EQ(rects[2].size, 512);
+  ASSERT_EQ(rects[1].size, 512);
+  // Halved to the last free quadrant
+  ASSERT_EQ(rects[0].size, 512);
+  // Least important, nothing left
+  ASSERT_EQ(rects[4].size, 0);
+  for (int i = 0; i < 4; i++) {
+    for (int j = i + 1; j < 4; j++) {
+      ASSERT_FALSE(overlap(rects[i], rects[j]));
+    }
+  }
+}
+} // namespace
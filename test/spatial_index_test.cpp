@@ -0,0 +1,86 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <rend/EntityRegistry.h>
+#include <rend/Systems/SpatialIndexSystem.h>
+#include <vector>
+
+namespace {
+class SpatialIndexTest : public ::testing::Test {
+protected:
+  rend::ECS::EntityRegistry &registry = rend::ECS::get_entity_registry();
+  rend::systems::SpatialIndexSystem spatial_index_system{};
+
+  void SetUp() override {
+    registry.register_component<Transform>();
+    registry.register_component<AABB>();
+    registry.register_component<Rigidbody>();
+  }
+
+  std::vector<rend::ECS::EID> query_around(const Eigen::Vector3f &point) {
+    std::vector<rend::ECS::EID> result;
+    spatial_index_system.query_box(
+        rend::physics::Bounds{point - Eigen::Vector3f::Constant(0.5f),
+                              point + Eigen::Vector3f::Constant(0.5f)},
+        result);
+    return result;
+  }
+};
+
+TEST_F(SpatialIndexTest, StaticToDynamicTest) {
+  rend::ECS::EID eid = registry.register_entity();
+  registry.add_component<Transform>(eid);
+  AABB &aabb = registry.add_component<AABB>(eid);
+  Rigidbody &rigidbody = registry.add_component<Rigidbody>(eid);
+  // Rigidbody bounds come from the PhysicsSystem
+  aabb.min_global = Eigen::Vector3f::Constant(9.0f);
+  aabb.max_global = Eigen::Vector3f::Constant(11.0f);
+  rigidbody.static_body = true;
+
+  spatial_index_system.update(0.0f);
+  ASSERT_EQ(query_around(Eigen::Vector3f::Constant(10.0f)),
+            std::vector<rend::ECS::EID>{eid});
+
+  rigidbody.static_body = false;
+  for (int frame = 0; frame < 2; frame++) {
+    spatial_index_system.update(0.0f);
+    ASSERT_EQ(query_around(Eigen::Vector3f::Constant(10.0f)),
+              std::vector<rend::ECS::EID>{eid});
+  }
+
+  registry.remove_entity(eid);
+  for (int frame = 0; frame < 2; frame++) {
+    spatial_index_system.update(0.0f);
+    ASSERT_TRUE(query_around(Eigen::Vector3f::Constant(10.0f)).empty());
+  }
+}
+
+TEST_F(SpatialIndexTest, ChangedEntitiesAreRefittedTest) {
+  rend::ECS::EID eid = registry.register_entity();
+  Transform &transform = registry.add_component<Transform>(eid);
+  AABB &aabb = registry.add_component<AABB>(eid);
+  aabb.min_local = -Eigen::Vector3f::Ones();
+  aabb.max_local = Eigen::Vector3f::Ones();
+  transform.position = Eigen::Vector3f{-20.0f, 0.0f, 0.0f};
+
+  spatial_index_system.update(0.0f);
+  ASSERT_EQ(query_around(Eigen::Vector3f{-20.0f, 0.0f, 0.0f}),
+            std::vector<rend::ECS::EID>{eid});
+
+  // Unmarked changes are not picked up
+  transform.position = Eigen::Vector3f{20.0f, 0.0f, 0.0f};
+  spatial_index_system.update(0.0f);
+  ASSERT_TRUE(query_around(Eigen::Vector3f{20.0f, 0.0f, 0.0f}).empty());
+
+  registry.mark_changed<Transform>(eid);
+  spatial_index_system.update(0.0f);
+  ASSERT_EQ(query_around(Eigen::Vector3f{20.0f, 0.0f, 0.0f}),
+            std::vector<rend::ECS::EID>{eid});
+  ASSERT_TRUE(query_around(Eigen::Vector3f{-20.0f, 0.0f, 0.0f}).empty());
+
+  aabb.max_local = Eigen::Vector3f::Constant(10.0f);
+  registry.mark_changed<AABB>(eid);
+  spatial_index_system.update(0.0f);
+  ASSERT_EQ(query_around(Eigen::Vector3f{28.0f, 8.0f, 8.0f}),
+            std::vector<rend::ECS::EID>{eid});
+}
+} // namespace